@@ -0,0 +1,213 @@
+/* Times the same inserts spread over 1 to N threads, into the shared
+ * concurrent table (-j with -S) and into private tables merged afterwards
+ * (-j alone), and prints the rate and the speedup over one thread. The
+ * packet totals of both are checked to match. Speedups need as many cores
+ * as threads.
+ *
+ *     cd src && gcc -O2 -pthread -o ../concurrent-hash-scaling ../bench/concurrent-hash-scaling.c *.c && cd ..
+ *     ./concurrent-hash-scaling [max threads] [flows] [inserts]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "../src/concurrent-hash.h"
+
+#define DEFAULT_MAX_THREADS 8
+#define DEFAULT_FLOWS 100000
+#define DEFAULT_INSERTS 8000000
+#define MAX_THREADS 256
+
+typedef struct scaling_worker
+{
+    pthread_t thread;
+    pthread_barrier_t *start;
+    concurrent_table_t *shared;
+    hash_table_t hash_table;
+    const flow_key_t *keys;
+    const uint32_t *flow_ids;
+    uint32_t num_inserts;
+} scaling_worker_t;
+
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+/* Insert its slice of flow ids, into the shared table when there is one */
+static void *run_scaling_worker(void *argument)
+{
+    scaling_worker_t *worker = (scaling_worker_t *)argument;
+    uint32_t iteration = 0;
+
+    pthread_barrier_wait(worker->start);
+
+    for (iteration = 0; iteration < worker->num_inserts; iteration++)
+    {
+        if (worker->shared != NULL)
+        {
+            insert_into_concurrent_table(&worker->keys[worker->flow_ids[iteration]], 1, worker->shared);
+        }
+        else
+        {
+            add_to_hash_table(&worker->keys[worker->flow_ids[iteration]], 1, &worker->hash_table);
+        }
+    }
+
+    return NULL;
+}
+
+/* Run the inserts on num_threads threads and leave the counted flows in result */
+static uint64_t time_threads(uint32_t num_threads, bool_t is_shared, const flow_key_t *keys, const uint32_t *flow_ids,
+                             uint32_t num_inserts, hash_table_t *result)
+{
+    scaling_worker_t workers[MAX_THREADS];
+    pthread_barrier_t start;
+    concurrent_table_t shared;
+    uint64_t start_ns = 0;
+    uint64_t elapsed = 0;
+    uint32_t thread = 0;
+    uint32_t slice = num_inserts / num_threads;
+
+    if (is_shared)
+    {
+        init_concurrent_table(&shared, CONCURRENT_TABLE_SIZE);
+    }
+
+    /* One more party so the clock starts when every worker is ready */
+    pthread_barrier_init(&start, NULL, num_threads + 1);
+
+    for (thread = 0; thread < num_threads; thread++)
+    {
+        workers[thread].start = &start;
+        workers[thread].shared = is_shared ? &shared : NULL;
+        workers[thread].keys = keys;
+        workers[thread].flow_ids = flow_ids + thread * slice;
+        workers[thread].num_inserts = (thread == num_threads - 1) ? num_inserts - thread * slice : slice;
+        init_hash_table(&workers[thread].hash_table, TABLE_SIZE, KEY_FIVE_TUPLE);
+
+        if (pthread_create(&workers[thread].thread, NULL, run_scaling_worker, &workers[thread]) != 0)
+        {
+            perror("Failed to start scaling thread");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    pthread_barrier_wait(&start);
+    start_ns = now_ns();
+
+    for (thread = 0; thread < num_threads; thread++)
+    {
+        pthread_join(workers[thread].thread, NULL);
+    }
+
+    /* Merging is part of what private tables cost, exporting the shared one is not needed by -S either */
+    for (thread = 0; !is_shared && thread < num_threads; thread++)
+    {
+        merge_hash_table(result, &workers[thread].hash_table);
+    }
+
+    elapsed = now_ns() - start_ns;
+    pthread_barrier_destroy(&start);
+
+    for (thread = 0; thread < num_threads; thread++)
+    {
+        free_hash_table(&workers[thread].hash_table);
+    }
+
+    if (is_shared)
+    {
+        export_concurrent_table(&shared, result);
+        free_concurrent_table(&shared);
+    }
+
+    return elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t max_threads = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 10) : DEFAULT_MAX_THREADS;
+    uint32_t num_flows = (argc > 2) ? (uint32_t)strtoul(argv[2], NULL, 10) : DEFAULT_FLOWS;
+    uint32_t num_inserts = (argc > 3) ? (uint32_t)strtoul(argv[3], NULL, 10) : DEFAULT_INSERTS;
+    flow_key_t *keys = NULL;
+    uint32_t *flow_ids = NULL;
+    hash_table_t shared_result = {0};
+    hash_table_t private_result = {0};
+    uint64_t shared_ns = 0;
+    uint64_t private_ns = 0;
+    uint64_t single_shared_ns = 0;
+    uint64_t single_private_ns = 0;
+    uint32_t state = 1;
+    uint32_t iteration = 0;
+    uint32_t num_threads = 0;
+    bool_t is_same = true;
+
+    if (max_threads == 0 || max_threads > MAX_THREADS || num_flows == 0 || num_inserts < max_threads)
+    {
+        fprintf(stderr, "Usage: %s [max threads, 1 to %d] [flows] [inserts, at least max threads]\n", argv[0],
+                MAX_THREADS);
+
+        return EXIT_FAILURE;
+    }
+
+    keys = (flow_key_t *)calloc(num_flows, sizeof(flow_key_t));
+    flow_ids = (uint32_t *)malloc(num_inserts * sizeof(uint32_t));
+
+    if (keys == NULL || flow_ids == NULL)
+    {
+        perror("Memory allocation failed for scaling inputs");
+        exit(EXIT_FAILURE);
+    }
+
+    for (iteration = 0; iteration < num_flows; iteration++)
+    {
+        uint32_to_ip(iteration, keys[iteration].source_ip);
+        uint32_to_ip(iteration * 2654435761U, keys[iteration].destination_ip);
+        keys[iteration].destination_port = (uint16_t)iteration;
+        keys[iteration].protocol = UDP_PROTOCOL;
+    }
+
+    /* xorshift32, drawn up front so the timed loops only insert */
+    for (iteration = 0; iteration < num_inserts; iteration++)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        flow_ids[iteration] = state % num_flows;
+    }
+
+    printf("%u inserts over %u flows\n", num_inserts, num_flows);
+    printf("threads   shared Minserts/s  speedup   private+merge Minserts/s  speedup\n");
+
+    for (num_threads = 1; num_threads <= max_threads; num_threads++)
+    {
+        init_hash_table(&shared_result, TABLE_SIZE, KEY_FIVE_TUPLE);
+        init_hash_table(&private_result, TABLE_SIZE, KEY_FIVE_TUPLE);
+        shared_ns = time_threads(num_threads, true, keys, flow_ids, num_inserts, &shared_result);
+        private_ns = time_threads(num_threads, false, keys, flow_ids, num_inserts, &private_result);
+        single_shared_ns = (num_threads == 1) ? shared_ns : single_shared_ns;
+        single_private_ns = (num_threads == 1) ? private_ns : single_private_ns;
+        is_same = is_same && hash_table_packet_count(&shared_result) == num_inserts &&
+                  hash_table_packet_count(&private_result) == num_inserts &&
+                  shared_result.list.count == private_result.list.count;
+
+        printf("%7u   %19.1f  %6.2fx   %24.1f  %6.2fx\n", num_threads, (double)num_inserts * 1000.0 / (double)shared_ns,
+               (double)single_shared_ns / (double)shared_ns, (double)num_inserts * 1000.0 / (double)private_ns,
+               (double)single_private_ns / (double)private_ns);
+
+        free_hash_table(&shared_result);
+        free_hash_table(&private_result);
+    }
+
+    printf("%s\n", is_same ? "every run counted every insert" : "MISMATCH");
+
+    free(keys);
+    free(flow_ids);
+
+    return is_same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,204 @@
+/* Hammers one concurrent table from many threads, starting it at its smallest
+ * size so it grows many times while they insert, and checks every flow count
+ * against the same inserts replayed into an ordinary table on one thread.
+ * A few hot flows take a quarter of the inserts so threads also collide on
+ * the same slots and counters. Repeated for several rounds, as a race does
+ * not show up every time.
+ *
+ *     cd src && gcc -O2 -pthread -o ../concurrent-hash-stress ../bench/concurrent-hash-stress.c *.c && cd ..
+ *     ./concurrent-hash-stress [threads] [flows] [inserts per thread] [rounds]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "../src/concurrent-hash.h"
+#include "../src/linked-list.h"
+
+#define DEFAULT_THREADS 8
+#define DEFAULT_FLOWS 200000
+#define DEFAULT_INSERTS 500000
+#define DEFAULT_ROUNDS 10
+#define MAX_THREADS 256
+#define HOT_FLOWS 16
+#define MAX_INSERT_COUNT 3
+
+typedef struct stress_worker
+{
+    pthread_t thread;
+    pthread_barrier_t *start;
+    concurrent_table_t *table;
+    uint32_t seed;
+    uint32_t num_flows;
+    uint32_t num_inserts;
+} stress_worker_t;
+
+static uint32_t next_random(uint32_t *state)
+{
+    /* xorshift32, the same sequence for a seed on every run */
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+
+    return *state;
+}
+
+/* Flow flow_id as a full five tuple, distinct for every id */
+static void make_key(uint32_t flow_id, flow_key_t *key)
+{
+    uint32_t mixed = flow_id * 2654435761U;
+
+    memset(key, 0, sizeof(flow_key_t));
+    uint32_to_ip(flow_id, key->source_ip);
+    uint32_to_ip(mixed, key->destination_ip);
+    key->source_port = (uint16_t)(mixed >> 16);
+    key->destination_port = (uint16_t)flow_id;
+    key->protocol = UDP_PROTOCOL;
+
+    return;
+}
+
+/* The insert a worker makes for one random number: a hot flow a quarter of the time */
+static void pick_insert(uint32_t random, uint32_t num_flows, flow_key_t *key, uint32_t *count)
+{
+    uint32_t flow_id = ((random & 3) == 0) ? (random >> 2) % HOT_FLOWS : (random >> 2) % num_flows;
+
+    make_key(flow_id, key);
+    *count = 1 + (random >> 28) % MAX_INSERT_COUNT;
+
+    return;
+}
+
+static void *run_stress_worker(void *argument)
+{
+    stress_worker_t *worker = (stress_worker_t *)argument;
+    flow_key_t key;
+    uint32_t state = worker->seed;
+    uint32_t count = 0;
+    uint32_t iteration = 0;
+
+    pthread_barrier_wait(worker->start);
+
+    for (iteration = 0; iteration < worker->num_inserts; iteration++)
+    {
+        pick_insert(next_random(&state), worker->num_flows, &key, &count);
+        insert_into_concurrent_table(&key, count, worker->table);
+    }
+
+    return NULL;
+}
+
+/* Every flow of actual must be in expected with the same count, and no flow may be missing */
+static bool_t is_same_counts(hash_table_t *expected, const hash_table_t *actual)
+{
+    uint32_t num_expected = expected->list.count;
+    uint32_t flow_id = 0;
+    uint32_t expected_id = 0;
+
+    if (actual->list.count != num_expected)
+    {
+        fprintf(stderr, "%u flows, expected %u\n", actual->list.count, num_expected);
+
+        return false;
+    }
+
+    for (flow_id = 0; flow_id < actual->list.count; flow_id++)
+    {
+        /* Adding 0 finds the flow without changing its count */
+        expected_id = add_to_hash_table(&list_node(&actual->list, flow_id)->key, 0, expected);
+
+        if (expected_id >= num_expected ||
+            list_node(&expected->list, expected_id)->ref_count != list_node(&actual->list, flow_id)->ref_count)
+        {
+            fprintf(stderr, "Flow %u has a wrong count or should not exist\n", flow_id);
+
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t num_threads = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 10) : DEFAULT_THREADS;
+    uint32_t num_flows = (argc > 2) ? (uint32_t)strtoul(argv[2], NULL, 10) : DEFAULT_FLOWS;
+    uint32_t num_inserts = (argc > 3) ? (uint32_t)strtoul(argv[3], NULL, 10) : DEFAULT_INSERTS;
+    uint32_t num_rounds = (argc > 4) ? (uint32_t)strtoul(argv[4], NULL, 10) : DEFAULT_ROUNDS;
+    stress_worker_t workers[MAX_THREADS];
+    pthread_barrier_t start;
+    concurrent_table_t table;
+    hash_table_t expected = {0};
+    hash_table_t actual = {0};
+    flow_key_t key;
+    uint32_t state = 0;
+    uint32_t count = 0;
+    uint32_t round = 0;
+    uint32_t thread = 0;
+    uint32_t iteration = 0;
+    bool_t is_same = true;
+
+    if (num_threads < 2 || num_threads > MAX_THREADS || num_flows <= HOT_FLOWS || num_inserts == 0 || num_rounds == 0)
+    {
+        fprintf(stderr, "Usage: %s [threads, 2 to %d] [flows, over %d] [inserts per thread] [rounds]\n", argv[0],
+                MAX_THREADS, HOT_FLOWS);
+
+        return EXIT_FAILURE;
+    }
+
+    for (round = 0; round < num_rounds && is_same; round++)
+    {
+        /* Asking for one slot gives the smallest table, so it grows all through the round */
+        init_concurrent_table(&table, 1);
+        pthread_barrier_init(&start, NULL, num_threads);
+
+        for (thread = 0; thread < num_threads; thread++)
+        {
+            workers[thread].start = &start;
+            workers[thread].table = &table;
+            workers[thread].seed = round * MAX_THREADS + thread + 1;
+            workers[thread].num_flows = num_flows;
+            workers[thread].num_inserts = num_inserts;
+
+            if (pthread_create(&workers[thread].thread, NULL, run_stress_worker, &workers[thread]) != 0)
+            {
+                perror("Failed to start stress thread");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        for (thread = 0; thread < num_threads; thread++)
+        {
+            pthread_join(workers[thread].thread, NULL);
+        }
+
+        pthread_barrier_destroy(&start);
+
+        /* The same inserts on one thread into an ordinary table */
+        init_hash_table(&expected, TABLE_SIZE, KEY_FIVE_TUPLE);
+
+        for (thread = 0; thread < num_threads; thread++)
+        {
+            state = workers[thread].seed;
+
+            for (iteration = 0; iteration < num_inserts; iteration++)
+            {
+                pick_insert(next_random(&state), num_flows, &key, &count);
+                add_to_hash_table(&key, count, &expected);
+            }
+        }
+
+        init_hash_table(&actual, TABLE_SIZE, KEY_FIVE_TUPLE);
+        export_concurrent_table(&table, &actual);
+        is_same = is_same_counts(&expected, &actual);
+
+        printf("round %u: %u threads, %u flows, %llu packets, %s\n", round + 1, num_threads, actual.list.count,
+               (unsigned long long)hash_table_packet_count(&actual), is_same ? "counts match" : "MISMATCH");
+
+        free_hash_table(&expected);
+        free_hash_table(&actual);
+        free_concurrent_table(&table);
+    }
+
+    return is_same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,329 @@
+/* Times batched header parsing against the per-packet path on the frames of
+ * data/exported-packets.txt repeated many times: parsing and hashing alone
+ * (describe_frame + flow_key_hash_ip_pair against the SIMD lanes,
+ * add_header_lane + hash_header_batch), then end to end into a table
+ * (process_frame against add_to_header_batch, which only uses the lanes
+ * when built with -DHEADER_BATCH_LANES and is process_frame otherwise).
+ * Checks that both give the same hashes and count the same flows in the same
+ * order; each time is the best of BENCH_ROUNDS.
+ *
+ *     cd src && gcc -O2 -pthread -o ../header-batch-bench ../bench/header-batch-bench.c *.c && cd ..
+ *     ./header-batch-bench [copies] [export]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../src/file-handler.h"
+#include "../src/hex-decoder.h"
+#include "../src/linked-list.h"
+#include "../src/hash.h"
+
+#define DEFAULT_COPIES 200
+#define DUMP_OFFSET_WIDTH 6
+#define DUMP_BYTE_WIDTH 3
+#define SOURCE_IP_LAST_BYTE 29
+#define BENCH_ROUNDS 5
+
+#ifdef HEADER_BATCH_LANES
+    #define BATCH_PATH_NAME "lanes"
+#else
+    #define BATCH_PATH_NAME "per-packet path"
+#endif
+
+typedef struct frame_set
+{
+    uint8_t *data;
+    size_t *offsets;
+    size_t count;
+    size_t capacity;
+    size_t data_len;
+    size_t data_capacity;
+} frame_set_t;
+
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+/* The smaller of best and the time since start */
+static uint64_t keep_best(uint64_t best, uint64_t start)
+{
+    uint64_t elapsed = now_ns() - start;
+
+    return (elapsed < best) ? elapsed : best;
+}
+
+static void add_frame(frame_set_t *frames, const uint8_t *frame, size_t frame_len)
+{
+    while (frames->data_len + frame_len > frames->data_capacity)
+    {
+        frames->data_capacity = (frames->data_capacity == 0) ? 1 << 20 : frames->data_capacity * 2;
+        frames->data = (uint8_t *)realloc(frames->data, frames->data_capacity);
+    }
+
+    if (frames->count + 1 >= frames->capacity)
+    {
+        frames->capacity = (frames->capacity == 0) ? 1024 : frames->capacity * 2;
+        frames->offsets = (size_t *)realloc(frames->offsets, frames->capacity * sizeof(size_t));
+    }
+
+    if (frames->data == NULL || frames->offsets == NULL)
+    {
+        perror("Memory allocation failed for frames");
+        exit(EXIT_FAILURE);
+    }
+
+    memcpy(frames->data + frames->data_len, frame, frame_len);
+    frames->offsets[frames->count] = frames->data_len;
+    frames->data_len += frame_len;
+    frames->count++;
+    frames->offsets[frames->count] = frames->data_len;
+
+    return;
+}
+
+/* Rebuild the frames of the export from its hex dump lines */
+static void read_export(const char *export, frame_set_t *frames)
+{
+    FILE *file = NULL;
+    char line[MAX_LINE_LENGTH] = {0};
+    uint8_t packet[1 << 16];
+    size_t packet_len = 0;
+    const char *hex = NULL;
+    size_t column = 0;
+
+    file = fopen(export, "r");
+
+    if (file == NULL)
+    {
+        fprintf(stderr, "Error opening file: %s\n", export);
+        exit(EXIT_FAILURE);
+    }
+
+    while (fgets(line, sizeof(line), file))
+    {
+        if (strncmp(line, "0000", 4) == 0 && packet_len > 0)
+        {
+            add_frame(frames, packet, packet_len);
+            packet_len = 0;
+        }
+
+        if (strlen(line) < DUMP_OFFSET_WIDTH)
+        {
+            continue;
+        }
+
+        hex = line + DUMP_OFFSET_WIDTH;
+
+        for (column = 0; column < MAX_HEX_IN_LINE && packet_len < sizeof(packet); column++)
+        {
+            if (hex_decode(hex + column * DUMP_BYTE_WIDTH, packet + packet_len, 1) != 1)
+            {
+                break;
+            }
+
+            packet_len++;
+        }
+    }
+
+    if (packet_len > 0)
+    {
+        add_frame(frames, packet, packet_len);
+    }
+
+    fclose(file);
+
+    return;
+}
+
+/* Repeat the export, each copy with its own last source address byte so the table keeps growing */
+static void scale_frames(const frame_set_t *export_frames, size_t copies, frame_set_t *frames)
+{
+    uint8_t frame[1 << 16];
+    size_t copy = 0;
+    size_t index = 0;
+    size_t frame_len = 0;
+
+    for (copy = 0; copy < copies; copy++)
+    {
+        for (index = 0; index < export_frames->count; index++)
+        {
+            frame_len = export_frames->offsets[index + 1] - export_frames->offsets[index];
+            memcpy(frame, export_frames->data + export_frames->offsets[index], frame_len);
+
+            if (frame_len > SOURCE_IP_LAST_BYTE)
+            {
+                frame[SOURCE_IP_LAST_BYTE] = (uint8_t)(frame[SOURCE_IP_LAST_BYTE] + copy);
+            }
+
+            add_frame(frames, frame, frame_len);
+        }
+    }
+
+    return;
+}
+
+/* Sum of the IP pair hashes of the IPv4/UDP frames, one frame at a time */
+static uint64_t hash_per_packet(const frame_set_t *frames)
+{
+    packet_descriptor_t descriptor = {0};
+    flow_key_t key = {0};
+    uint64_t sum = 0;
+    size_t index = 0;
+
+    for (index = 0; index < frames->count; index++)
+    {
+        if (describe_frame(frames->data + frames->offsets[index], frames->offsets[index + 1] - frames->offsets[index],
+                           &descriptor))
+        {
+            memcpy(key.source_ip, descriptor.source_ip, sizeof(key.source_ip));
+            memcpy(key.destination_ip, descriptor.destination_ip, sizeof(key.destination_ip));
+            sum += flow_key_hash_ip_pair(&key);
+        }
+    }
+
+    return sum;
+}
+
+/* The same sum from lanes filled and hashed the way add_to_header_batch does */
+static uint64_t hash_batched(const frame_set_t *frames, header_batch_t *batch)
+{
+    uint64_t sum = 0;
+    size_t index = 0;
+    uint32_t lane = 0;
+
+    batch->count = 0;
+
+    for (index = 0; index < frames->count; index++)
+    {
+        add_header_lane(batch, frames->data + frames->offsets[index], frames->offsets[index + 1] - frames->offsets[index]);
+
+        if (batch->count == HEADER_BATCH_SIZE || index + 1 == frames->count)
+        {
+            hash_header_batch(batch);
+
+            for (lane = 0; lane < batch->count; lane++)
+            {
+                sum += ((batch->valid_mask >> lane) & 1) ? batch->hash[lane] : 0;
+            }
+
+            batch->count = 0;
+        }
+    }
+
+    return sum;
+}
+
+static bool_t is_same_table(const hash_table_t *expected, const hash_table_t *actual)
+{
+    uint32_t flow_id = 0;
+
+    if (expected->list.count != actual->list.count)
+    {
+        return false;
+    }
+
+    for (flow_id = 0; flow_id < expected->list.count; flow_id++)
+    {
+        if (memcmp(&list_node(&expected->list, flow_id)->key, &list_node(&actual->list, flow_id)->key,
+                   sizeof(flow_key_t)) != 0 ||
+            list_node(&expected->list, flow_id)->ref_count != list_node(&actual->list, flow_id)->ref_count)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t copies = (argc > 1) ? strtoul(argv[1], NULL, 10) : DEFAULT_COPIES;
+    const char *export = (argc > 2) ? argv[2] : PACKET_FILE;
+    frame_set_t export_frames = {0};
+    frame_set_t frames = {0};
+    hash_table_t per_packet = {0};
+    hash_table_t batched = {0};
+    header_batch_t batch = {0};
+    uint64_t best_ns[4] = {UINT64_MAX, UINT64_MAX, UINT64_MAX, UINT64_MAX};
+    uint64_t per_packet_sum = 0;
+    uint64_t batched_sum = 0;
+    uint64_t start = 0;
+    size_t index = 0;
+    uint32_t round = 0;
+    bool_t is_same = true;
+
+    if (copies == 0)
+    {
+        fprintf(stderr, "Usage: %s [copies, at least 1] [export]\n", argv[0]);
+
+        return EXIT_FAILURE;
+    }
+
+    init_hex_decoder();
+    init_jhash_lanes();
+    read_export(export, &export_frames);
+    scale_frames(&export_frames, copies, &frames);
+
+    for (round = 0; round < BENCH_ROUNDS; round++)
+    {
+        start = now_ns();
+        per_packet_sum = hash_per_packet(&frames);
+        best_ns[0] = keep_best(best_ns[0], start);
+
+        start = now_ns();
+        batched_sum = hash_batched(&frames, &batch);
+        best_ns[1] = keep_best(best_ns[1], start);
+
+        is_same = is_same && (per_packet_sum == batched_sum);
+
+        init_hash_table(&per_packet, TABLE_SIZE, KEY_IP_PAIR);
+        start = now_ns();
+
+        for (index = 0; index < frames.count; index++)
+        {
+            process_frame(frames.data + frames.offsets[index], frames.offsets[index + 1] - frames.offsets[index],
+                          &per_packet);
+        }
+
+        best_ns[2] = keep_best(best_ns[2], start);
+
+        init_hash_table(&batched, TABLE_SIZE, KEY_IP_PAIR);
+        start = now_ns();
+
+        for (index = 0; index < frames.count; index++)
+        {
+            add_to_header_batch(&batch, frames.data + frames.offsets[index],
+                                frames.offsets[index + 1] - frames.offsets[index], &batched);
+        }
+
+        flush_header_batch(&batch, &batched);
+        best_ns[3] = keep_best(best_ns[3], start);
+
+        is_same = is_same && is_same_table(&per_packet, &batched);
+        free_hash_table(&per_packet);
+        free_hash_table(&batched);
+    }
+
+    printf("%zu frames, hash lanes %s, add_to_header_batch uses the %s, best of %d rounds\n", frames.count,
+           jhash_lanes_name(), BATCH_PATH_NAME, BENCH_ROUNDS);
+    printf("parse + hash  per-packet %6.1f ns  lanes   %6.1f ns per frame (%.2fx)\n",
+           (double)best_ns[0] / (double)frames.count, (double)best_ns[1] / (double)frames.count,
+           (double)best_ns[0] / (double)(best_ns[1] > 0 ? best_ns[1] : 1));
+    printf("into a table  per-packet %6.1f ns  batched %6.1f ns per frame (%.2fx)\n",
+           (double)best_ns[2] / (double)frames.count, (double)best_ns[3] / (double)frames.count,
+           (double)best_ns[2] / (double)(best_ns[3] > 0 ? best_ns[3] : 1));
+    printf("%s\n", is_same ? "both paths give the same hashes and flows" : "MISMATCH");
+
+    free(export_frames.data);
+    free(export_frames.offsets);
+    free(frames.data);
+    free(frames.offsets);
+
+    return is_same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,147 @@
+/* Times the sscanf("%2hhx") loop the decoder replaced against the scalar,
+ * SSE2 and AVX2 kernels on the same hex strings, after checking that they
+ * all decode the same bytes.
+ *
+ *     cd src && gcc -O2 -pthread -o ../hex-decode-bench ../bench/hex-decode-bench.c *.c && cd ..
+ *     ./hex-decode-bench [strings] [bytes per string]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../src/hex-decoder.h"
+
+#define DEFAULT_NUM_STRINGS 200000
+#define DEFAULT_STRING_BYTES 42
+#define MAX_STRING_BYTES 1024
+#define NUM_KERNELS 3
+
+static const char *kernel_names[NUM_KERNELS] = {"scalar", "sse2", "avx2"};
+
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+/* The decoding loop of the original hex_to_byte_array() */
+static void sscanf_decode(const char *hex, uint8_t *bytes, size_t len)
+{
+    size_t iteration = 0;
+
+    for (iteration = 0; iteration < len; iteration++)
+    {
+        sscanf(&hex[iteration * 2], "%2hhx", &bytes[iteration]);
+    }
+
+    return;
+}
+
+/* Random hex in both cases, as Wireshark exports vary */
+static char *make_strings(size_t num_strings, size_t num_bytes)
+{
+    static const char digits[] = "0123456789abcdefABCDEF";
+    char *hex = NULL;
+    size_t iteration = 0;
+
+    hex = (char *)malloc(num_strings * (2 * num_bytes + 1));
+
+    if (hex == NULL)
+    {
+        perror("Memory allocation failed for hex strings");
+        exit(EXIT_FAILURE);
+    }
+
+    srand(1);
+
+    for (iteration = 0; iteration < num_strings * (2 * num_bytes + 1); iteration++)
+    {
+        hex[iteration] = ((iteration + 1) % (2 * num_bytes + 1) == 0) ? '\0' : digits[rand() % (sizeof(digits) - 1)];
+    }
+
+    return hex;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t num_strings = (argc > 1) ? strtoul(argv[1], NULL, 10) : DEFAULT_NUM_STRINGS;
+    size_t num_bytes = (argc > 2) ? strtoul(argv[2], NULL, 10) : DEFAULT_STRING_BYTES;
+    size_t stride = 2 * num_bytes + 1;
+    char *hex = NULL;
+    uint8_t *expected = NULL;
+    uint8_t bytes[MAX_STRING_BYTES];
+    uint64_t start = 0;
+    uint64_t checksum = 0;
+    size_t iteration = 0;
+    size_t kernel = 0;
+    bool_t is_same = true;
+
+    if (num_strings == 0 || num_bytes == 0 || num_bytes > MAX_STRING_BYTES)
+    {
+        fprintf(stderr, "Usage: %s [strings] [bytes per string, 1 to %d]\n", argv[0], MAX_STRING_BYTES);
+
+        return EXIT_FAILURE;
+    }
+
+    hex = make_strings(num_strings, num_bytes);
+    expected = (uint8_t *)malloc(num_strings * num_bytes);
+
+    if (expected == NULL)
+    {
+        perror("Memory allocation failed for decoded bytes");
+        exit(EXIT_FAILURE);
+    }
+
+    start = now_ns();
+
+    for (iteration = 0; iteration < num_strings; iteration++)
+    {
+        sscanf_decode(hex + iteration * stride, expected + iteration * num_bytes, num_bytes);
+    }
+
+    printf("%-7s %8.1f ns per %zu byte string\n", "sscanf", (double)(now_ns() - start) / (double)num_strings,
+           num_bytes);
+
+    for (kernel = 0; kernel < NUM_KERNELS; kernel++)
+    {
+        if (!use_hex_decoder(kernel_names[kernel]))
+        {
+            printf("%-7s not supported by this CPU\n", kernel_names[kernel]);
+            continue;
+        }
+
+        /* Checked in a separate pass so the timed loop does nothing else */
+        for (iteration = 0; iteration < num_strings; iteration++)
+        {
+            if (hex_decode(hex + iteration * stride, bytes, num_bytes) != num_bytes ||
+                memcmp(bytes, expected + iteration * num_bytes, num_bytes) != 0)
+            {
+                fprintf(stderr, "%s differs from sscanf on string %zu\n", kernel_names[kernel], iteration);
+                is_same = false;
+                break;
+            }
+        }
+
+        start = now_ns();
+
+        for (iteration = 0; iteration < num_strings; iteration++)
+        {
+            hex_decode(hex + iteration * stride, bytes, num_bytes);
+            checksum += bytes[iteration % num_bytes];
+        }
+
+        printf("%-7s %8.1f ns per %zu byte string\n", kernel_names[kernel],
+               (double)(now_ns() - start) / (double)num_strings, num_bytes);
+    }
+
+    /* Printed so the compiler cannot drop the timed decoding */
+    printf("checksum %llu, %s\n", (unsigned long long)checksum, is_same ? "all kernels match sscanf" : "MISMATCH");
+
+    free(hex);
+    free(expected);
+
+    return is_same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
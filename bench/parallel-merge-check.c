@@ -0,0 +1,159 @@
+/* Checks that -j N builds the same table as -t: counts input records with
+ * many thousands of flows on one thread (process_input_file) and on 2 to N
+ * threads (process_input_file_parallel), then compares the two tables slot
+ * by slot and flow by flow, which is everything the report prints. Hot
+ * flows repeat all through the input so the slices share flows and growth
+ * happens while packets of known flows keep arriving.
+ *
+ *     cd src && gcc -O2 -pthread -o ../parallel-merge-check ../bench/parallel-merge-check.c *.c && cd ..
+ *     ./parallel-merge-check [max threads] [packets]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/file-handler.h"
+#include "../src/parallel-ingest.h"
+#include "../src/linked-list.h"
+
+#define DEFAULT_MAX_THREADS 8
+#define DEFAULT_PACKETS 60000
+#define CHECK_INPUT_FILE "parallel-merge-check.txt"
+#define HOT_FLOWS 64
+#define FRAME_HEADER_HEX "01005e7ffffaecd68ac4d8e50800"
+
+static uint32_t next_random(uint32_t *state)
+{
+    /* xorshift32, the same input on every run */
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+
+    return *state;
+}
+
+/* One record per line, like the records -t writes: an Ethernet/IPv4/UDP
+ * frame in hex. A third of the packets go to a few hot pairs, the rest
+ * mostly start new flows. */
+static void write_input(const char *file_name, uint32_t num_packets)
+{
+    FILE *file = NULL;
+    uint32_t state = 1;
+    uint32_t packet = 0;
+    uint32_t pair = 0;
+
+    file = fopen(file_name, "w");
+
+    if (file == NULL)
+    {
+        fprintf(stderr, "Error opening file: %s\n", file_name);
+        exit(EXIT_FAILURE);
+    }
+
+    for (packet = 0; packet < num_packets; packet++)
+    {
+        pair = (packet % 3 == 0) ? next_random(&state) % HOT_FLOWS : next_random(&state) % num_packets;
+
+        fprintf(file, "%s4500002e%04x000040110000%08x%08x%04x0035001a0000%08x%08x%08x%04x\n", FRAME_HEADER_HEX,
+                packet & 0xFFFF, pair * 2654435761U, pair, 1024 + pair % 60000, next_random(&state),
+                next_random(&state), next_random(&state), packet & 0xFFFF);
+    }
+
+    fclose(file);
+
+    return;
+}
+
+/* Same slot layout, keys and counts, and the same first-seen list */
+static bool_t is_same_table(const hash_table_t *expected, const hash_table_t *actual)
+{
+    const data_list_node_t *expected_node = NULL;
+    const data_list_node_t *actual_node = NULL;
+    uint32_t index = 0;
+    uint32_t flow_id = 0;
+
+    if (expected->table_size != actual->table_size || expected->list.count != actual->list.count)
+    {
+        fprintf(stderr, "%u slots and %u flows, expected %u and %u\n", actual->table_size, actual->list.count,
+                expected->table_size, expected->list.count);
+
+        return false;
+    }
+
+    for (index = 0; index < expected->table_size; index++)
+    {
+        if (expected->control[index] != actual->control[index] ||
+            (expected->control[index] != CONTROL_EMPTY &&
+             (memcmp(&expected->slots[index].key, &actual->slots[index].key, sizeof(flow_key_t)) != 0 ||
+              expected->slots[index].flow_id != actual->slots[index].flow_id)))
+        {
+            fprintf(stderr, "Slot %u differs\n", index);
+
+            return false;
+        }
+    }
+
+    for (flow_id = 0; flow_id < expected->list.count; flow_id++)
+    {
+        expected_node = list_node(&expected->list, flow_id);
+        actual_node = list_node(&actual->list, flow_id);
+
+        if (memcmp(&expected_node->key, &actual_node->key, sizeof(flow_key_t)) != 0 ||
+            expected_node->ref_count != actual_node->ref_count)
+        {
+            fprintf(stderr, "Flow %u differs\n", flow_id);
+
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t max_threads = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 10) : DEFAULT_MAX_THREADS;
+    uint32_t num_packets = (argc > 2) ? (uint32_t)strtoul(argv[2], NULL, 10) : DEFAULT_PACKETS;
+    hash_table_t expected = {0};
+    hash_table_t actual = {0};
+    uint32_t num_threads = 0;
+    bool_t is_same = true;
+
+    if (max_threads < 2 || max_threads > MAX_THREADS || num_packets <= HOT_FLOWS)
+    {
+        fprintf(stderr, "Usage: %s [max threads, 2 to %d] [packets, over %d]\n", argv[0], MAX_THREADS, HOT_FLOWS);
+
+        return EXIT_FAILURE;
+    }
+
+    write_input(CHECK_INPUT_FILE, num_packets);
+
+    init_hash_table(&expected, TABLE_SIZE, KEY_IP_PAIR);
+    process_input_file(CHECK_INPUT_FILE, &expected);
+    complete_rehash(&expected);
+
+    for (num_threads = 2; num_threads <= max_threads; num_threads++)
+    {
+        init_hash_table(&actual, TABLE_SIZE, KEY_IP_PAIR);
+
+        if (!process_input_file_parallel(CHECK_INPUT_FILE, &actual, num_threads, false))
+        {
+            is_same = false;
+        }
+
+        complete_rehash(&actual);
+        is_same = is_same && is_same_table(&expected, &actual);
+        printf("%u threads: %u flows in %u slots, %s\n", num_threads, actual.list.count, actual.table_size,
+               is_same ? "same table as one thread" : "MISMATCH");
+        free_hash_table(&actual);
+
+        if (!is_same)
+        {
+            break;
+        }
+    }
+
+    free_hash_table(&expected);
+    remove(CHECK_INPUT_FILE);
+
+    return is_same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -1,30 +1,245 @@
 #include "src/file-handler.h"
 #include "src/linked-list.h"
 #include "src/hash.h"
+#include "src/pcap-reader.h"
+#include "src/options.h"
+#include "src/parallel-ingest.h"
+#include "src/pipeline.h"
+#include "src/heavy-hitters.h"
+#include "src/cardinality.h"
+#include "src/sampling.h"
+#include "src/packet-filter.h"
+#include "src/subnet-trie.h"
+#include "src/host-index.h"
+#include "src/export-follow.h"
+#include "src/capture-stream.h"
 
-int main()
+static void print_report(const options_t *options, hash_table_t *hash_table);
+
+/* Every table the options asked for, from the flows counted so far */
+static void print_report(const options_t *options, hash_table_t *hash_table)
 {
-    if (process_extracted_packets(PACKET_FILE, INPUT_FILE))
+    uint32_t query = 0;
+
+    if (hash_table->approximate != NULL)
+    {
+        print_heavy_hitters(hash_table->approximate, hash_table->schema);
+
+        if (options->verbose)
+        {
+            print_heavy_hitters_stats(hash_table->approximate);
+        }
+    }
+    else
     {
-        uint32_t table_size = 0;
-        hash_table_entry_t **hash_table = NULL;
+        complete_rehash(hash_table);
+        print_linked_list(&hash_table->list, hash_table->schema);
+        print_hash_table(hash_table);
+
+        if (hash_table->stats.enabled != 0)
+        {
+            print_flow_stats(&hash_table->stats, &hash_table->list, hash_table->schema);
+        }
 
-        table_size = next_prime(TABLE_SIZE);
-        hash_table = (hash_table_entry_t **)calloc(table_size, sizeof(hash_table_entry_t *));
+        if (options->num_subnet_views > 0)
+        {
+            print_subnet_views(hash_table, options->subnet_views, options->num_subnet_views, options->verbose);
+        }
 
-        if(hash_table == NULL)
+        for (query = 0; query < options->num_host_queries; query++)
         {
-            perror("Memory Initialized Failed For Hash Table");
-            exit(EXIT_FAILURE);
+            print_host_flows(hash_table, hash_table->host_index, options->host_queries[query]);
         }
 
-        process_input_file(INPUT_FILE, &hash_table, &table_size);
-        print_linked_list();
-        print_hash_table(hash_table, table_size);
-        free_hash_table(hash_table, table_size);
-        free_linked_list(data_list_node_root);
-        free(hash_table);
+        if (options->verbose)
+        {
+            print_hash_table_stats(hash_table);
+
+            if (hash_table->host_index != NULL)
+            {
+                print_host_index_stats(hash_table->host_index);
+            }
+        }
     }
 
+    if (hash_table->cardinality != NULL)
+    {
+        print_cardinality(hash_table->cardinality, options->num_fan_hosts,
+                          (hash_table->sampler != NULL) ? hash_table->sampler->rate : 1);
+
+        if (options->verbose)
+        {
+            print_cardinality_stats(hash_table->cardinality);
+        }
+    }
+
+    if (hash_table->sampler != NULL)
+    {
+        print_sampling_note(hash_table->sampler, hash_table->schema, hash_table_packet_count(hash_table));
+    }
+
+    return;
+}
+
+int main(int argc, char *argv[])
+{
+    options_t options = {0};
+    hash_table_t hash_table = {0};
+    heavy_hitters_t heavy_hitters = {0};
+    cardinality_t cardinality = {0};
+    sampler_t sampler = {0};
+    packet_filter_t filter = {0};
+    host_index_t host_index = {0};
+    capture_stream_t capture = {0};
+    uint64_t checkpoint_offset = 0;
+    bool_t is_processed = false;
+
+    if (!parse_options(argc, argv, &options))
+    {
+        print_usage(argv[0]);
+
+        return EXIT_FAILURE;
+    }
+
+    /* Compiled before the export is converted so a typo fails straight away */
+    if (options.filter_text != NULL && !compile_packet_filter(options.filter_text, &filter))
+    {
+        print_usage(argv[0]);
+
+        return EXIT_FAILURE;
+    }
+
+    /* The two-pass path keeps the intermediate input.txt around for debugging */
+    if (options.mode == INGEST_TWO_PASS && !process_extracted_packets(options.source_file, INPUT_FILE))
+    {
+        free_packet_filter(&filter);
+
+        return EXIT_SUCCESS;
+    }
+
+    /* Approximate mode keeps a fixed amount of memory however many flows there are */
+    if (options.num_top_flows > 0)
+    {
+        init_heavy_hitters(&heavy_hitters, options.num_top_flows);
+        init_approximate_hash_table(&hash_table, &heavy_hitters, options.key_schema);
+    }
+    else if (options.mode == INGEST_SNAPSHOT)
+    {
+        is_processed = load_hash_table(&hash_table, options.snapshot_file, options.key_schema,
+                                       options.is_snapshot_checked, NULL);
+    }
+    else if (options.mode == INGEST_APPEND)
+    {
+        is_processed = resume_hash_table(&hash_table, options.checkpoint_file, options.key_schema, &checkpoint_offset);
+    }
+    else
+    {
+        init_hash_table(&hash_table, TABLE_SIZE, options.key_schema);
+        enable_flow_stats(&hash_table, options.stats_columns);
+    }
+
+    if (options.num_fan_hosts > 0)
+    {
+        init_cardinality(&cardinality);
+        hash_table.cardinality = &cardinality;
+    }
+
+    if (options.sample_rate > 0)
+    {
+        init_sampler(&sampler, options.sample_rate, options.sample_seed);
+        enable_sampling(&hash_table, &sampler);
+    }
+
+    if (options.filter_text != NULL)
+    {
+        hash_table.filter = &filter;
+    }
+
+    if (options.num_host_queries > 0)
+    {
+        init_host_index(&host_index, options.key_schema);
+        hash_table.host_index = &host_index;
+    }
+
+    switch (options.mode)
+    {
+    case INGEST_CAPTURE:
+        is_processed = process_capture_file(options.source_file, &hash_table);
+        break;
+
+    case INGEST_CAPTURE_STREAM:
+        if (open_capture_stream(&capture, options.source_file))
+        {
+            /* Reports come from the live table, counting carries on after each one */
+            while (read_capture_stream(&capture, options.report_interval, &hash_table))
+            {
+                printf("Partial report after %llu packets\n", (unsigned long long)capture.parser.num_packets);
+                print_report(&options, &hash_table);
+                fflush(stdout);
+            }
+
+            is_processed = close_capture_stream(&capture);
+        }
+        break;
+
+    case INGEST_TWO_PASS:
+        if (options.num_decoders > 0)
+        {
+            is_processed = process_input_file_pipelined(INPUT_FILE, &hash_table, options.num_decoders,
+                                                        options.verbose);
+        }
+        else if (options.num_threads > 1)
+        {
+            is_processed = process_input_file_parallel(INPUT_FILE, &hash_table, options.num_threads,
+                                                       options.is_shared_table);
+        }
+        else
+        {
+            process_input_file(INPUT_FILE, &hash_table);
+            is_processed = true;
+        }
+        break;
+
+    case INGEST_SNAPSHOT:
+        /* Its flows were never inserted here, so the host index is filled from the list */
+        if (is_processed && hash_table.host_index != NULL)
+        {
+            index_table_hosts(&host_index, &hash_table);
+        }
+        break;
+
+    case INGEST_APPEND:
+        if (is_processed && hash_table.host_index != NULL)
+        {
+            index_table_hosts(&host_index, &hash_table);
+        }
+
+        is_processed = is_processed && follow_export(options.source_file, options.checkpoint_file, checkpoint_offset,
+                                                     options.is_following, options.verbose, &hash_table);
+        break;
+
+    case INGEST_STREAM:
+    default:
+        is_processed = process_exported_stream(options.source_file, &hash_table);
+        break;
+    }
+
+    if (is_processed && options.save_file != NULL && hash_table.approximate == NULL)
+    {
+        complete_rehash(&hash_table);
+        save_hash_table(&hash_table, options.save_file, SNAPSHOT_NO_SOURCE_OFFSET);
+    }
+
+    if (is_processed)
+    {
+        print_report(&options, &hash_table);
+    }
+
+    free_hash_table(&hash_table);
+    free_heavy_hitters(&heavy_hitters);
+    free_cardinality(&cardinality);
+    free_packet_filter(&filter);
+    free_host_index(&host_index);
+
     return EXIT_SUCCESS;
 }
\ No newline at end of file
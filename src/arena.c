@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "arena.h"
+
+/* Block headers are padded so the first allocation keeps ARENA_ALIGNMENT */
+#define ARENA_HEADER_SIZE ((sizeof(arena_block_t) + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1))
+
+static arena_block_t *new_arena_block(arena_t *arena, size_t size);
+
+static arena_block_t *new_arena_block(arena_t *arena, size_t size)
+{
+    arena_block_t *block = NULL;
+
+    block = (arena_block_t *)malloc(ARENA_HEADER_SIZE + size);
+
+    if (block == NULL)
+    {
+        perror("Memory allocation failed for arena block");
+        exit(EXIT_FAILURE);
+    }
+
+    block->used = 0;
+    block->size = size;
+    arena->total_bytes += ARENA_HEADER_SIZE + size;
+
+    return block;
+}
+
+void init_arena(arena_t *arena, size_t block_size)
+{
+    arena->head = NULL;
+    arena->block_size = block_size;
+    arena->total_bytes = 0;
+
+    return;
+}
+
+/* Carve size bytes out of the current block, starting a new block when it is full */
+void *arena_alloc(arena_t *arena, size_t size)
+{
+    arena_block_t *block = arena->head;
+    uint8_t *memory = NULL;
+
+    size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+
+    if (block == NULL || block->size - block->used < size)
+    {
+        block = new_arena_block(arena, size > arena->block_size ? size : arena->block_size);
+
+        /* An oversized request gets its own block behind the head so the head keeps its free space */
+        if (arena->head != NULL && size > arena->block_size)
+        {
+            block->next = arena->head->next;
+            arena->head->next = block;
+        }
+        else
+        {
+            block->next = arena->head;
+            arena->head = block;
+        }
+    }
+
+    memory = (uint8_t *)block + ARENA_HEADER_SIZE + block->used;
+    block->used += size;
+
+    return memory;
+}
+
+void free_arena(arena_t *arena)
+{
+    arena_block_t *block = arena->head;
+    arena_block_t *temp = NULL;
+
+    while (block != NULL)
+    {
+        temp = block;
+        block = block->next;
+        free(temp);
+    }
+
+    arena->head = NULL;
+    arena->total_bytes = 0;
+
+    return;
+}
\ No newline at end of file
@@ -0,0 +1,29 @@
+#ifndef ARENA_H_INCLUDED
+#define ARENA_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ARENA_BLOCK_SIZE (1024 * 1024)
+#define ARENA_ALIGNMENT 16
+
+typedef struct arena_block
+{
+    struct arena_block *next;
+    size_t used;
+    size_t size;
+} arena_block_t;
+
+/* Bump allocator over large blocks, everything is released at once by free_arena */
+typedef struct arena
+{
+    arena_block_t *head;
+    size_t block_size;
+    size_t total_bytes;
+} arena_t;
+
+void init_arena(arena_t *arena, size_t block_size);
+void *arena_alloc(arena_t *arena, size_t size);
+void free_arena(arena_t *arena);
+
+#endif // ARENA_H_INCLUDED
\ No newline at end of file
@@ -0,0 +1,195 @@
+#if defined(__linux__)
+    #define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "capture-stream.h"
+
+static volatile sig_atomic_t is_report_requested = 0;
+static volatile sig_atomic_t is_stop_requested = 0;
+
+static void request_report(int signal_number);
+static void request_stop(int signal_number);
+static void make_room(capture_stream_t *stream);
+
+static void request_report(int signal_number)
+{
+    (void)signal_number;
+    is_report_requested = 1;
+
+    return;
+}
+
+static void request_stop(int signal_number)
+{
+    (void)signal_number;
+    is_stop_requested = 1;
+
+    return;
+}
+
+/* Open file_name, or standard input for "-", and catch the signals that
+ * ask for a partial report (SIGUSR1) or for the final one (SIGINT, SIGTERM).
+ * They interrupt a read that is waiting for the pipe. */
+bool_t open_capture_stream(capture_stream_t *stream, const char *file_name)
+{
+    struct sigaction action;
+
+    memset(stream, 0, sizeof(capture_stream_t));
+    stream->file_name = file_name;
+    stream->fd = (strcmp(file_name, CAPTURE_STDIN) == 0) ? STDIN_FILENO : open(file_name, O_RDONLY);
+
+    if (stream->fd < 0)
+    {
+        fprintf(stderr, "Error opening file: %s\n", file_name);
+
+        return false;
+    }
+
+#if defined(F_SETPIPE_SZ)
+    /* A bigger pipe keeps the writer going while a report is printed, failing is harmless */
+    (void)fcntl(stream->fd, F_SETPIPE_SZ, CAPTURE_PIPE_SIZE);
+#endif
+
+    stream->capacity = CAPTURE_STREAM_BUFFER_SIZE;
+    stream->buffer = (uint8_t *)malloc(stream->capacity);
+
+    if (stream->buffer == NULL)
+    {
+        perror("Memory allocation failed for capture buffer");
+        exit(EXIT_FAILURE);
+    }
+
+    init_capture_parser(&stream->parser);
+
+    is_report_requested = 0;
+    is_stop_requested = 0;
+    memset(&action, 0, sizeof(action));
+    sigemptyset(&action.sa_mask);
+    action.sa_handler = request_report;
+    sigaction(SIGUSR1, &action, NULL);
+    action.sa_handler = request_stop;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    return true;
+}
+
+/* Move the unfinished record to the front, and grow the buffer when that
+ * record alone fills it. The parser refuses records over
+ * CAPTURE_MAX_RECORD_SIZE, which bounds the growth. */
+static void make_room(capture_stream_t *stream)
+{
+    uint8_t *resized = NULL;
+
+    if (stream->start > 0)
+    {
+        memmove(stream->buffer, stream->buffer + stream->start, stream->len - stream->start);
+        stream->len -= stream->start;
+        stream->start = 0;
+    }
+
+    if (stream->len == stream->capacity)
+    {
+        stream->capacity *= 2;
+        resized = (uint8_t *)realloc(stream->buffer, stream->capacity);
+
+        if (resized == NULL)
+        {
+            perror("Memory allocation failed for capture buffer");
+            exit(EXIT_FAILURE);
+        }
+
+        stream->buffer = resized;
+    }
+
+    return;
+}
+
+/* Count packets until a partial report is due, every report_interval
+ * packets (0 for never) or on SIGUSR1, and return true with the table up to
+ * date. False once the capture is over: end of stream, SIGINT or SIGTERM, a
+ * corrupt capture or a read error. */
+bool_t read_capture_stream(capture_stream_t *stream, uint64_t report_interval, hash_table_t *hash_table)
+{
+    uint64_t report_at = UINT64_MAX;
+    ssize_t read_len = 0;
+    bool_t is_report_due = false;
+
+    if (report_interval > 0)
+    {
+        report_at = (stream->parser.num_packets / report_interval + 1) * report_interval;
+    }
+
+    while (!stream->is_eof)
+    {
+        stream->start += parse_capture(&stream->parser, stream->buffer + stream->start, stream->len - stream->start,
+                                       report_at, &stream->batch, hash_table);
+
+        is_report_due = (stream->parser.num_packets >= report_at || is_report_requested);
+
+        if (is_report_due || stream->parser.is_failed || is_stop_requested)
+        {
+            break;
+        }
+
+        make_room(stream);
+        read_len = read(stream->fd, stream->buffer + stream->len, stream->capacity - stream->len);
+
+        if (read_len < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (read_len < 0)
+        {
+            fprintf(stderr, "Error reading file: %s\n", stream->file_name);
+            stream->is_failed = true;
+            break;
+        }
+
+        stream->len += (size_t)read_len;
+        stream->is_eof = (read_len == 0);
+    }
+
+    flush_header_batch(&stream->batch, hash_table);
+
+    if (is_report_due)
+    {
+        is_report_requested = 0;
+
+        return true;
+    }
+
+    stream->is_eof = true;
+
+    return false;
+}
+
+/* False when the stream was not a capture or could not be read to its end */
+bool_t close_capture_stream(capture_stream_t *stream)
+{
+    bool_t is_capture = false;
+
+    signal(SIGUSR1, SIG_DFL);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+
+    is_capture = finish_capture_parser(&stream->parser, stream->file_name, stream->len - stream->start);
+
+    if (stream->fd != STDIN_FILENO)
+    {
+        close(stream->fd);
+    }
+
+    free(stream->buffer);
+    stream->buffer = NULL;
+
+    return is_capture && !stream->is_failed;
+}
@@ -0,0 +1,36 @@
+#ifndef CAPTURE_STREAM_H_INCLUDED
+#define CAPTURE_STREAM_H_INCLUDED
+
+#include <stdint.h>
+#include "packets.h"
+#include "hash.h"
+#include "header-batch.h"
+#include "pcap-reader.h"
+
+#define CAPTURE_STDIN "-"
+#define CAPTURE_STREAM_BUFFER_SIZE (1024 * 1024)
+#define CAPTURE_PIPE_SIZE (1024 * 1024)
+
+/* A pcap or pcapng capture read from a descriptor that cannot seek, such as
+ * `tcpdump -w - | packet-management -`. Reads take whatever the pipe holds,
+ * up to the buffer size, and the unfinished record at the end of the buffer
+ * is moved to its front to be completed by the next read. */
+typedef struct capture_stream
+{
+    const char *file_name;
+    int fd;
+    uint8_t *buffer;
+    size_t capacity;
+    size_t start;
+    size_t len;
+    capture_parser_t parser;
+    header_batch_t batch;
+    bool_t is_eof;
+    bool_t is_failed;
+} capture_stream_t;
+
+bool_t open_capture_stream(capture_stream_t *stream, const char *file_name);
+bool_t read_capture_stream(capture_stream_t *stream, uint64_t report_interval, hash_table_t *hash_table);
+bool_t close_capture_stream(capture_stream_t *stream);
+
+#endif // CAPTURE_STREAM_H_INCLUDED
@@ -0,0 +1,561 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "cardinality.h"
+
+#define HLL_ALPHA_INFINITY 0.7213475204444817
+#define HLL_STANDARD_ERROR 1.04
+#define PERCENT 100
+
+typedef struct host_estimate
+{
+    uint64_t estimate;
+    uint32_t ip;
+} host_estimate_t;
+
+static void *allocate_sketch_memory(void *memory, size_t size);
+static double estimator_sigma(double value);
+static double estimator_tau(double value);
+static double square_root(double value);
+static void set_register(hll_t *hll, uint32_t index, uint8_t rank);
+static void make_dense(hll_t *hll);
+static inline uint32_t host_hash(uint32_t ip);
+static void init_host_sketches(host_sketches_t *host_sketches);
+static void grow_host_index(host_sketches_t *host_sketches);
+static hll_t *find_host_sketch(host_sketches_t *host_sketches, uint32_t ip);
+static void free_host_sketches(host_sketches_t *host_sketches);
+static int compare_host_estimates(const void *first, const void *second);
+static void print_host_sketches(const host_sketches_t *host_sketches, key_schema_t schema, const char *title,
+                                const char *heading, uint32_t num_hosts, uint32_t scale);
+
+/* realloc that gives up like every other allocation in the program */
+static void *allocate_sketch_memory(void *memory, size_t size)
+{
+    void *resized = realloc(memory, size);
+
+    if (resized == NULL)
+    {
+        perror("Memory allocation failed for cardinality sketch");
+        exit(EXIT_FAILURE);
+    }
+
+    return resized;
+}
+
+/* sigma(x) = x + sum of x^(2^k) * 2^(k-1), the small range term of the estimator */
+static double estimator_sigma(double value)
+{
+    double power = 1.0;
+    double result = value;
+    double previous = 0.0;
+
+    if (value == 1.0)
+    {
+        return HUGE_VAL;
+    }
+
+    do
+    {
+        value *= value;
+        previous = result;
+        result += value * power;
+        power += power;
+    } while (result != previous);
+
+    return result;
+}
+
+/* tau(x) = (1 - x - sum of (1 - x^(2^-k))^2 * 2^-k) / 3, the large range term */
+static double estimator_tau(double value)
+{
+    double power = 1.0;
+    double result = 1.0 - value;
+    double previous = 0.0;
+
+    if (value == 0.0 || value == 1.0)
+    {
+        return 0.0;
+    }
+
+    do
+    {
+        value = square_root(value);
+        previous = result;
+        power *= 0.5;
+        result -= (1.0 - value) * (1.0 - value) * power;
+    } while (result != previous);
+
+    return result / 3.0;
+}
+
+/* Newton's method, enough for tau without pulling in libm */
+static double square_root(double value)
+{
+    double root = (value > 1.0) ? value : 1.0;
+    double previous = 0.0;
+
+    do
+    {
+        previous = root;
+        root = 0.5 * (root + value / root);
+    } while (root < previous);
+
+    return previous;
+}
+
+void init_hll(hll_t *hll, uint8_t precision)
+{
+    memset(hll, 0, sizeof(hll_t));
+    hll->precision = precision;
+
+    return;
+}
+
+/* Switch to one byte per register */
+static void make_dense(hll_t *hll)
+{
+    uint32_t iteration = 0;
+
+    hll->registers = (uint8_t *)calloc((size_t)1 << hll->precision, sizeof(uint8_t));
+
+    if (hll->registers == NULL)
+    {
+        perror("Memory allocation failed for cardinality sketch");
+        exit(EXIT_FAILURE);
+    }
+
+    for (iteration = 0; iteration < hll->num_sparse; iteration++)
+    {
+        hll->registers[hll->sparse[iteration] >> HLL_RANK_BITS] = (uint8_t)(hll->sparse[iteration] & HLL_RANK_MASK);
+    }
+
+    free(hll->sparse);
+    hll->sparse = NULL;
+    hll->num_sparse = 0;
+    hll->sparse_capacity = 0;
+
+    return;
+}
+
+/* Raise a register to rank if it is lower */
+static void set_register(hll_t *hll, uint32_t index, uint8_t rank)
+{
+    uint32_t low = 0;
+    uint32_t high = hll->num_sparse;
+    uint32_t middle = 0;
+
+    if (hll->registers != NULL)
+    {
+        hll->registers[index] = (rank > hll->registers[index]) ? rank : hll->registers[index];
+
+        return;
+    }
+
+    while (low < high)
+    {
+        middle = (low + high) / 2;
+
+        if ((hll->sparse[middle] >> HLL_RANK_BITS) < index)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    if (low < hll->num_sparse && (hll->sparse[low] >> HLL_RANK_BITS) == index)
+    {
+        if (rank > (hll->sparse[low] & HLL_RANK_MASK))
+        {
+            hll->sparse[low] = (index << HLL_RANK_BITS) | rank;
+        }
+
+        return;
+    }
+
+    /* Four bytes per sparse register, so past a quarter of the registers dense is smaller */
+    if ((hll->num_sparse + 1) * sizeof(uint32_t) > ((size_t)1 << hll->precision))
+    {
+        make_dense(hll);
+        hll->registers[index] = rank;
+
+        return;
+    }
+
+    if (hll->num_sparse == hll->sparse_capacity)
+    {
+        hll->sparse_capacity = (hll->sparse_capacity == 0) ? HLL_SPARSE_INITIAL : hll->sparse_capacity * 2;
+        hll->sparse = allocate_sketch_memory(hll->sparse, hll->sparse_capacity * sizeof(uint32_t));
+    }
+
+    memmove(&hll->sparse[low + 1], &hll->sparse[low], (hll->num_sparse - low) * sizeof(uint32_t));
+    hll->sparse[low] = (index << HLL_RANK_BITS) | rank;
+    hll->num_sparse++;
+
+    return;
+}
+
+/* The top precision bits pick the register, the rest give the rank of the first set bit */
+void add_to_hll(hll_t *hll, uint32_t hash)
+{
+    uint32_t index = hash >> (HLL_HASH_BITS - hll->precision);
+    uint32_t rest = hash << hll->precision;
+    uint8_t rank = (rest == 0) ? (uint8_t)(HLL_HASH_BITS - hll->precision + 1) : (uint8_t)(__builtin_clz(rest) + 1);
+
+    set_register(hll, index, rank);
+
+    return;
+}
+
+/* Fold source into target, both must have the same precision */
+void merge_hll(hll_t *target, const hll_t *source)
+{
+    uint32_t iteration = 0;
+
+    if (source->registers != NULL)
+    {
+        if (target->registers == NULL)
+        {
+            make_dense(target);
+        }
+
+        for (iteration = 0; iteration < (1U << source->precision); iteration++)
+        {
+            set_register(target, iteration, source->registers[iteration]);
+        }
+
+        return;
+    }
+
+    for (iteration = 0; iteration < source->num_sparse; iteration++)
+    {
+        set_register(target, source->sparse[iteration] >> HLL_RANK_BITS,
+                     (uint8_t)(source->sparse[iteration] & HLL_RANK_MASK));
+    }
+
+    return;
+}
+
+/* Ertl's improved estimator ("New cardinality estimation algorithms for
+ * HyperLogLog sketches"): built from the histogram of register values, it has
+ * no bias to correct around the switch from linear counting to the raw
+ * estimate and handles saturated registers, without empirical tables */
+uint64_t estimate_hll(const hll_t *hll)
+{
+    uint32_t histogram[HLL_HASH_BITS + 2] = {0};
+    uint32_t num_registers = 1U << hll->precision;
+    uint32_t max_rank = HLL_HASH_BITS - hll->precision;
+    uint32_t iteration = 0;
+    double denominator = 0.0;
+
+    if (hll->registers != NULL)
+    {
+        for (iteration = 0; iteration < num_registers; iteration++)
+        {
+            histogram[hll->registers[iteration]]++;
+        }
+    }
+    else
+    {
+        histogram[0] = num_registers - hll->num_sparse;
+
+        for (iteration = 0; iteration < hll->num_sparse; iteration++)
+        {
+            histogram[hll->sparse[iteration] & HLL_RANK_MASK]++;
+        }
+    }
+
+    denominator = num_registers * estimator_tau(1.0 - (double)histogram[max_rank + 1] / num_registers);
+
+    for (iteration = max_rank; iteration >= 1; iteration--)
+    {
+        denominator = 0.5 * (denominator + histogram[iteration]);
+    }
+
+    denominator += num_registers * estimator_sigma((double)histogram[0] / num_registers);
+
+    return (uint64_t)(HLL_ALPHA_INFINITY * num_registers * num_registers / denominator + 0.5);
+}
+
+void free_hll(hll_t *hll)
+{
+    free(hll->registers);
+    free(hll->sparse);
+    init_hll(hll, hll->precision);
+
+    return;
+}
+
+static inline uint32_t host_hash(uint32_t ip)
+{
+    uint32_t b = 0;
+
+    jhash(&ip, &b);
+
+    return b;
+}
+
+static void init_host_sketches(host_sketches_t *host_sketches)
+{
+    memset(host_sketches, 0, sizeof(host_sketches_t));
+    host_sketches->index_size = HOST_INDEX_INITIAL_SIZE;
+    host_sketches->index = (uint32_t *)calloc(host_sketches->index_size, sizeof(uint32_t));
+
+    if (host_sketches->index == NULL)
+    {
+        perror("Memory allocation failed for cardinality sketch");
+        exit(EXIT_FAILURE);
+    }
+
+    return;
+}
+
+/* Double the index and put every host back */
+static void grow_host_index(host_sketches_t *host_sketches)
+{
+    uint32_t mask = host_sketches->index_size * 2 - 1;
+    uint32_t slot = 0;
+    uint32_t host = 0;
+
+    free(host_sketches->index);
+    host_sketches->index_size *= 2;
+    host_sketches->index = (uint32_t *)calloc(host_sketches->index_size, sizeof(uint32_t));
+
+    if (host_sketches->index == NULL)
+    {
+        perror("Memory allocation failed for cardinality sketch");
+        exit(EXIT_FAILURE);
+    }
+
+    for (host = 0; host < host_sketches->num_hosts; host++)
+    {
+        slot = host_hash(host_sketches->hosts[host].ip) & mask;
+
+        while (host_sketches->index[slot] != HOST_INDEX_EMPTY)
+        {
+            slot = (slot + 1) & mask;
+        }
+
+        host_sketches->index[slot] = host + 1;
+    }
+
+    return;
+}
+
+/* The sketch of a host, added empty the first time the host is seen */
+static hll_t *find_host_sketch(host_sketches_t *host_sketches, uint32_t ip)
+{
+    uint32_t mask = host_sketches->index_size - 1;
+    uint32_t slot = host_hash(ip) & mask;
+    uint32_t host = 0;
+
+    while (host_sketches->index[slot] != HOST_INDEX_EMPTY)
+    {
+        host = host_sketches->index[slot] - 1;
+
+        if (host_sketches->hosts[host].ip == ip)
+        {
+            return &host_sketches->hosts[host].sketch;
+        }
+
+        slot = (slot + 1) & mask;
+    }
+
+    if (host_sketches->num_hosts == host_sketches->capacity)
+    {
+        host_sketches->capacity = (host_sketches->capacity == 0) ? HOST_INDEX_INITIAL_SIZE : host_sketches->capacity * 2;
+        host_sketches->hosts = allocate_sketch_memory(host_sketches->hosts, host_sketches->capacity * sizeof(host_entry_t));
+    }
+
+    host = host_sketches->num_hosts++;
+    host_sketches->hosts[host].ip = ip;
+    init_hll(&host_sketches->hosts[host].sketch, HOST_HLL_PRECISION);
+    host_sketches->index[slot] = host + 1;
+
+    /* Keep the index at most half full */
+    if (host_sketches->num_hosts * 2 > host_sketches->index_size)
+    {
+        grow_host_index(host_sketches);
+    }
+
+    return &host_sketches->hosts[host].sketch;
+}
+
+static void free_host_sketches(host_sketches_t *host_sketches)
+{
+    uint32_t host = 0;
+
+    for (host = 0; host < host_sketches->num_hosts; host++)
+    {
+        free_hll(&host_sketches->hosts[host].sketch);
+    }
+
+    free(host_sketches->hosts);
+    free(host_sketches->index);
+    memset(host_sketches, 0, sizeof(host_sketches_t));
+
+    return;
+}
+
+void init_cardinality(cardinality_t *cardinality)
+{
+    init_host_sketches(&cardinality->sources);
+    init_host_sketches(&cardinality->destinations);
+    init_hll(&cardinality->pairs, PAIR_HLL_PRECISION);
+
+    return;
+}
+
+/* Count one packet of the IP pair, pair_hash is host_pair_hash() of it */
+void add_host_pair(cardinality_t *cardinality, uint32_t source_ip, uint32_t destination_ip, uint32_t pair_hash)
+{
+    add_to_hll(find_host_sketch(&cardinality->sources, source_ip), pair_hash);
+    add_to_hll(find_host_sketch(&cardinality->destinations, destination_ip), pair_hash);
+    add_to_hll(&cardinality->pairs, pair_hash);
+
+    return;
+}
+
+/* Fold the sketches of another thread or run into target */
+void merge_cardinality(cardinality_t *target, const cardinality_t *source)
+{
+    uint32_t host = 0;
+
+    for (host = 0; host < source->sources.num_hosts; host++)
+    {
+        merge_hll(find_host_sketch(&target->sources, source->sources.hosts[host].ip),
+                  &source->sources.hosts[host].sketch);
+    }
+
+    for (host = 0; host < source->destinations.num_hosts; host++)
+    {
+        merge_hll(find_host_sketch(&target->destinations, source->destinations.hosts[host].ip),
+                  &source->destinations.hosts[host].sketch);
+    }
+
+    merge_hll(&target->pairs, &source->pairs);
+
+    return;
+}
+
+/* Biggest estimate first, ties by address */
+static int compare_host_estimates(const void *first, const void *second)
+{
+    const host_estimate_t *first_host = (const host_estimate_t *)first;
+    const host_estimate_t *second_host = (const host_estimate_t *)second;
+
+    if (first_host->estimate != second_host->estimate)
+    {
+        return (first_host->estimate > second_host->estimate) ? -1 : 1;
+    }
+
+    return (first_host->ip > second_host->ip) - (first_host->ip < second_host->ip);
+}
+
+static void print_host_sketches(const host_sketches_t *host_sketches, key_schema_t schema, const char *title,
+                                const char *heading, uint32_t num_hosts, uint32_t scale)
+{
+    host_estimate_t *estimates = NULL;
+    flow_key_t key = {0};
+    uint32_t width = LIST_NUMBER_WIDTH + key_columns_width(schema) + COUNT_COLUMN_WIDTH;
+    uint32_t host = 0;
+
+    estimates = (host_estimate_t *)allocate_sketch_memory(NULL, (host_sketches->num_hosts + 1) * sizeof(host_estimate_t));
+
+    for (host = 0; host < host_sketches->num_hosts; host++)
+    {
+        estimates[host].estimate = estimate_hll(&host_sketches->hosts[host].sketch) * scale;
+        estimates[host].ip = host_sketches->hosts[host].ip;
+    }
+
+    qsort(estimates, host_sketches->num_hosts, sizeof(host_estimate_t), compare_host_estimates);
+    num_hosts = (num_hosts < host_sketches->num_hosts) ? num_hosts : host_sketches->num_hosts;
+
+    print_table_rule(width);
+    print_table_title(title, (width - 2 - (uint32_t)strlen(title)) / 2, width);
+    fputs("+-----", stdout);
+    print_key_rule(schema);
+    puts("+--------------+");
+    fputs("|  No ", stdout);
+    print_key_heading(schema);
+    printf("| %*s%-*s |\n", (int)(12 - strlen(heading)) / 2, "", 12 - (int)(12 - strlen(heading)) / 2, heading);
+    fputs("+-----", stdout);
+    print_key_rule(schema);
+    puts("+--------------+");
+
+    for (host = 0; host < num_hosts; host++)
+    {
+        uint32_to_ip(estimates[host].ip, key.source_ip);
+        uint32_to_ip(estimates[host].ip, key.destination_ip);
+        printf("| %3u ", host + 1);
+        print_key_cells(&key, schema);
+        printf("| %12llu |\n", (unsigned long long)estimates[host].estimate);
+        fputs("+-----", stdout);
+        print_key_rule(schema);
+        puts("+--------------+");
+    }
+
+    free(estimates);
+
+    return;
+}
+
+/* The num_hosts sources with the most distinct destinations and destinations
+ * with the most distinct sources, then the distinct pairs overall. Under 1 in
+ * scale pair sampling every estimate is multiplied by scale. */
+void print_cardinality(const cardinality_t *cardinality, uint32_t num_hosts, uint32_t scale)
+{
+    print_host_sketches(&cardinality->sources, KEY_SOURCE, "Fan-out (approximate)", "Destinations", num_hosts, scale);
+    print_host_sketches(&cardinality->destinations, KEY_DESTINATION, "Fan-in (approximate)", "Sources", num_hosts, scale);
+    printf("Sources: %u, Destinations: %u, Distinct IP pairs: about %llu\n",
+           cardinality->sources.num_hosts, cardinality->destinations.num_hosts,
+           (unsigned long long)(estimate_hll(&cardinality->pairs) * scale));
+    printf("Standard error %.1f%% per host, %.1f%% for the pairs\n",
+           HLL_STANDARD_ERROR * PERCENT / (double)(1U << (HOST_HLL_PRECISION / 2)),
+           HLL_STANDARD_ERROR * PERCENT / (double)(1U << (PAIR_HLL_PRECISION / 2)));
+
+    return;
+}
+
+/* How many hosts went dense, and the memory of all sketches */
+void print_cardinality_stats(const cardinality_t *cardinality)
+{
+    const host_sketches_t *tables[] = {&cardinality->sources, &cardinality->destinations};
+    const hll_t *sketch = NULL;
+    size_t bytes = 0;
+    uint32_t num_dense = 0;
+    uint32_t table = 0;
+    uint32_t host = 0;
+
+    for (table = 0; table < sizeof(tables) / sizeof(tables[0]); table++)
+    {
+        bytes += tables[table]->capacity * sizeof(host_entry_t) + tables[table]->index_size * sizeof(uint32_t);
+
+        for (host = 0; host < tables[table]->num_hosts; host++)
+        {
+            sketch = &tables[table]->hosts[host].sketch;
+            num_dense += (sketch->registers != NULL);
+            bytes += (sketch->registers != NULL) ? ((size_t)1 << sketch->precision)
+                                                 : sketch->sparse_capacity * sizeof(uint32_t);
+        }
+    }
+
+    sketch = &cardinality->pairs;
+    bytes += (sketch->registers != NULL) ? ((size_t)1 << sketch->precision) : sketch->sparse_capacity * sizeof(uint32_t);
+    fprintf(stderr, "Host sketches: %u, Dense: %u, Sketch memory: %zu bytes\n",
+            cardinality->sources.num_hosts + cardinality->destinations.num_hosts, num_dense, bytes);
+
+    return;
+}
+
+void free_cardinality(cardinality_t *cardinality)
+{
+    free_host_sketches(&cardinality->sources);
+    free_host_sketches(&cardinality->destinations);
+    free_hll(&cardinality->pairs);
+
+    return;
+}
@@ -0,0 +1,79 @@
+#ifndef CARDINALITY_H_INCLUDED
+#define CARDINALITY_H_INCLUDED
+
+#include <stdint.h>
+#include "hash.h"
+
+#define HOST_HLL_PRECISION 12
+#define PAIR_HLL_PRECISION 14
+#define HLL_HASH_BITS 32
+#define HLL_SPARSE_INITIAL 8
+#define HLL_RANK_BITS 8
+#define HLL_RANK_MASK ((1U << HLL_RANK_BITS) - 1)
+#define HOST_INDEX_INITIAL_SIZE 1024
+#define HOST_INDEX_EMPTY 0
+
+/* HyperLogLog over 32 bit hashes. A sketch starts sparse: a sorted array of
+ * (register << HLL_RANK_BITS | rank) for the registers that are not zero, which
+ * costs 4 bytes per register in use. Once that would be as big as the dense
+ * array of one byte per register it converts, so the memory of a sketch is
+ * bounded by 2^precision bytes whatever it counts. Sketches of the same
+ * precision merge by taking the larger rank of every register. */
+typedef struct hll
+{
+    uint8_t *registers;
+    uint32_t *sparse;
+    uint32_t num_sparse;
+    uint32_t sparse_capacity;
+    uint8_t precision;
+} hll_t;
+
+/* One sketch per address, found through an open-addressing index of host + 1 */
+typedef struct host_entry
+{
+    uint32_t ip;
+    hll_t sketch;
+} host_entry_t;
+
+typedef struct host_sketches
+{
+    host_entry_t *hosts;
+    uint32_t num_hosts;
+    uint32_t capacity;
+    uint32_t *index;
+    uint32_t index_size;
+} host_sketches_t;
+
+/* Distinct peers per source (fan-out) and per destination (fan-in), and the
+ * distinct IP pairs overall. Every sketch is fed the packet's IP pair hash:
+ * for a fixed source distinct pairs are distinct destinations, and the other
+ * way round, so one hash per packet serves all three. */
+typedef struct cardinality
+{
+    host_sketches_t sources;
+    host_sketches_t destinations;
+    hll_t pairs;
+} cardinality_t;
+
+void init_hll(hll_t *hll, uint8_t precision);
+void add_to_hll(hll_t *hll, uint32_t hash);
+void merge_hll(hll_t *target, const hll_t *source);
+uint64_t estimate_hll(const hll_t *hll);
+void free_hll(hll_t *hll);
+
+void init_cardinality(cardinality_t *cardinality);
+void add_host_pair(cardinality_t *cardinality, uint32_t source_ip, uint32_t destination_ip, uint32_t pair_hash);
+void merge_cardinality(cardinality_t *target, const cardinality_t *source);
+void print_cardinality(const cardinality_t *cardinality, uint32_t num_hosts, uint32_t scale);
+void print_cardinality_stats(const cardinality_t *cardinality);
+void free_cardinality(cardinality_t *cardinality);
+
+/* Same value as flow_key_hash_ip_pair() and the header batch lane hashes */
+static inline uint32_t host_pair_hash(uint32_t source_ip, uint32_t destination_ip)
+{
+    jhash(&source_ip, &destination_ip);
+
+    return destination_ip;
+}
+
+#endif // CARDINALITY_H_INCLUDED
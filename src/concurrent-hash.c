@@ -0,0 +1,356 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include "concurrent-hash.h"
+
+static concurrent_generation_t *new_generation(uint32_t table_size);
+static concurrent_flow_t *flow_record(concurrent_table_t *table, uint32_t flow_id);
+static uint32_t publish_flow(concurrent_table_t *table, const flow_key_t *key, uint32_t count);
+static inline uint32_t wait_for_key(concurrent_slot_t *slot);
+static void start_growth(concurrent_generation_t *generation);
+static void copy_into_generation(concurrent_generation_t *generation, const flow_key_t *key, uint32_t state);
+static void help_migrate(concurrent_table_t *table, concurrent_generation_t *generation);
+
+static concurrent_generation_t *new_generation(uint32_t table_size)
+{
+    concurrent_generation_t *generation = NULL;
+
+    generation = (concurrent_generation_t *)calloc(STRUCT_MULTIPLIER, sizeof(concurrent_generation_t));
+
+    if (generation == NULL)
+    {
+        perror("Memory allocation failed for concurrent table");
+        exit(EXIT_FAILURE);
+    }
+
+    /* Zeroed memory is SLOT_EMPTY everywhere */
+    generation->slots = (concurrent_slot_t *)calloc(table_size, sizeof(concurrent_slot_t));
+
+    if (generation->slots == NULL)
+    {
+        perror("Memory allocation failed for concurrent table");
+        exit(EXIT_FAILURE);
+    }
+
+    generation->table_size = table_size;
+    atomic_init(&generation->num_elements, 0);
+    atomic_init(&generation->migrate_cursor, 0);
+    atomic_init(&generation->migrated_chunks, 0);
+    atomic_init(&generation->next, NULL);
+    generation->retired_next = NULL;
+
+    return generation;
+}
+
+void init_concurrent_table(concurrent_table_t *table, uint32_t table_size)
+{
+    uint32_t power_of_two = MIGRATE_CHUNK;
+
+    while (power_of_two < table_size)
+    {
+        power_of_two *= NEXT_MULTIPLIER;
+    }
+
+    table->blocks = (_Atomic(concurrent_flow_t *) *)calloc(CONCURRENT_MAX_BLOCKS, sizeof(*table->blocks));
+
+    if (table->blocks == NULL)
+    {
+        perror("Memory allocation failed for concurrent table");
+        exit(EXIT_FAILURE);
+    }
+
+    atomic_init(&table->current, new_generation(power_of_two));
+    atomic_init(&table->retired, NULL);
+    atomic_init(&table->num_flows, 0);
+
+    return;
+}
+
+/* Flow records live in fixed blocks that are installed once with CAS and never move */
+static concurrent_flow_t *flow_record(concurrent_table_t *table, uint32_t flow_id)
+{
+    _Atomic(concurrent_flow_t *) *slot = &table->blocks[flow_id >> CONCURRENT_BLOCK_SHIFT];
+    concurrent_flow_t *block = atomic_load_explicit(slot, memory_order_acquire);
+    concurrent_flow_t *expected = NULL;
+
+    if (block == NULL)
+    {
+        block = (concurrent_flow_t *)calloc(CONCURRENT_BLOCK_FLOWS, sizeof(concurrent_flow_t));
+
+        if (block == NULL)
+        {
+            perror("Memory allocation failed for concurrent flow block");
+            exit(EXIT_FAILURE);
+        }
+
+        if (!atomic_compare_exchange_strong(slot, &expected, block))
+        {
+            /* Another thread installed the block first */
+            free(block);
+            block = expected;
+        }
+    }
+
+    return &block[flow_id & CONCURRENT_BLOCK_MASK];
+}
+
+/* Take the next flow id and fill its record before the slot makes it visible */
+static uint32_t publish_flow(concurrent_table_t *table, const flow_key_t *key, uint32_t count)
+{
+    concurrent_flow_t *flow = NULL;
+    uint32_t flow_id = 0;
+
+    flow_id = atomic_fetch_add(&table->num_flows, 1);
+    flow = flow_record(table, flow_id);
+    flow->key = *key;
+    atomic_store_explicit(&flow->ref_count, count, memory_order_relaxed);
+
+    return flow_id;
+}
+
+/* A claimed slot is BUSY only for the few stores that publish its key */
+static inline uint32_t wait_for_key(concurrent_slot_t *slot)
+{
+    uint32_t state = SLOT_BUSY;
+
+    while ((state = atomic_load_explicit(&slot->state, memory_order_acquire)) == SLOT_BUSY)
+    {
+        sched_yield();
+    }
+
+    return state;
+}
+
+/* Link a twice bigger generation, the thread that loses the race drops its copy */
+static void start_growth(concurrent_generation_t *generation)
+{
+    concurrent_generation_t *next = NULL;
+    concurrent_generation_t *expected = NULL;
+
+    if (atomic_load(&generation->next) != NULL)
+    {
+        return;
+    }
+
+    next = new_generation(generation->table_size * NEXT_MULTIPLIER);
+
+    if (!atomic_compare_exchange_strong(&generation->next, &expected, next))
+    {
+        free(next->slots);
+        free(next);
+    }
+
+    return;
+}
+
+/* Migrated keys are unique and no insert reaches the new generation until
+ * migration ends, so a key simply takes the first empty slot of its probe */
+static void copy_into_generation(concurrent_generation_t *generation, const flow_key_t *key, uint32_t state)
+{
+    concurrent_slot_t *slot = NULL;
+    uint32_t mask = generation->table_size - 1;
+    uint32_t index = flow_key_hash(key) & mask;
+    uint32_t expected = SLOT_EMPTY;
+
+    for (;;)
+    {
+        slot = &generation->slots[index];
+        expected = SLOT_EMPTY;
+
+        if (atomic_compare_exchange_strong(&slot->state, &expected, SLOT_BUSY))
+        {
+            slot->key = *key;
+            atomic_store_explicit(&slot->state, state, memory_order_release);
+            atomic_fetch_add(&generation->num_elements, 1);
+
+            return;
+        }
+
+        index = (index + 1) & mask;
+    }
+}
+
+/* Claim chunks of the old generation until none are left, wait for the other
+ * helpers to finish theirs, then switch the table over to the new generation.
+ * This wait is a spin (with sched_yield) on a chunk another thread owns,
+ * which is why the table blocks while it grows. */
+static void help_migrate(concurrent_table_t *table, concurrent_generation_t *generation)
+{
+    concurrent_generation_t *next = atomic_load(&generation->next);
+    concurrent_generation_t *expected = generation;
+    concurrent_slot_t *slot = NULL;
+    uint32_t num_chunks = generation->table_size / MIGRATE_CHUNK;
+    uint32_t chunk = 0;
+    uint32_t index = 0;
+    uint32_t state = SLOT_EMPTY;
+
+    while ((chunk = atomic_fetch_add(&generation->migrate_cursor, 1)) < num_chunks)
+    {
+        for (index = chunk * MIGRATE_CHUNK; index < (chunk + 1) * MIGRATE_CHUNK; index++)
+        {
+            slot = &generation->slots[index];
+            state = SLOT_EMPTY;
+
+            /* Sealing empty slots is what stops new keys landing in the old generation */
+            if (atomic_compare_exchange_strong(&slot->state, &state, SLOT_MOVED))
+            {
+                continue;
+            }
+
+            if (state == SLOT_BUSY)
+            {
+                state = wait_for_key(slot);
+            }
+
+            copy_into_generation(next, &slot->key, state);
+        }
+
+        atomic_fetch_add(&generation->migrated_chunks, 1);
+    }
+
+    while (atomic_load(&generation->migrated_chunks) < num_chunks)
+    {
+        sched_yield();
+    }
+
+    /* Old generations are only retired, inserts may still be reading them */
+    if (atomic_compare_exchange_strong(&table->current, &expected, next))
+    {
+        generation->retired_next = atomic_load(&table->retired);
+
+        while (!atomic_compare_exchange_weak(&table->retired, &generation->retired_next, generation))
+        {
+            /* Retry with the refreshed list head */
+        }
+    }
+
+    return;
+}
+
+/* Count a flow key count times, any number of threads may call this at once */
+void insert_into_concurrent_table(const flow_key_t *key, uint32_t count, concurrent_table_t *table)
+{
+    concurrent_generation_t *generation = NULL;
+    concurrent_slot_t *slot = NULL;
+    uint32_t hash = flow_key_hash(key);
+    uint32_t mask = 0;
+    uint32_t index = 0;
+    uint32_t probes = 0;
+    uint32_t state = SLOT_EMPTY;
+    uint32_t flow_id = 0;
+
+    for (;;)
+    {
+        generation = atomic_load(&table->current);
+
+        /* Growth in progress: help it finish, then retry in the new generation */
+        if (atomic_load(&generation->next) != NULL)
+        {
+            help_migrate(table, generation);
+            continue;
+        }
+
+        mask = generation->table_size - 1;
+        index = hash & mask;
+
+        for (probes = 0; probes < generation->table_size; probes++)
+        {
+            slot = &generation->slots[index];
+            state = atomic_load_explicit(&slot->state, memory_order_acquire);
+
+            if (state == SLOT_EMPTY && atomic_compare_exchange_strong(&slot->state, &state, SLOT_BUSY))
+            {
+                slot->key = *key;
+                flow_id = publish_flow(table, key, count);
+                atomic_store_explicit(&slot->state, flow_id + SLOT_FLOW_BASE, memory_order_release);
+
+                if ((uint64_t)(atomic_fetch_add(&generation->num_elements, 1) + 1) * MAX_LOAD_DENOMINATOR >
+                    (uint64_t)generation->table_size * MAX_LOAD_NUMERATOR)
+                {
+                    start_growth(generation);
+                }
+
+                return;
+            }
+
+            /* A lost CAS left state holding what the winner stored, handle it like any other slot */
+
+            if (state == SLOT_MOVED)
+            {
+                break;
+            }
+
+            if (state == SLOT_BUSY)
+            {
+                state = wait_for_key(slot);
+            }
+
+            if (is_same_flow_key(&slot->key, key))
+            {
+                atomic_fetch_add_explicit(&flow_record(table, state - SLOT_FLOW_BASE)->ref_count, count,
+                                          memory_order_relaxed);
+
+                return;
+            }
+
+            index = (index + 1) & mask;
+        }
+
+        /* Reached a sealed slot or a full generation, growth has to happen first */
+        start_growth(generation);
+    }
+}
+
+/* Copy the flows in flow id order into an ordinary table for reporting */
+void export_concurrent_table(const concurrent_table_t *table, hash_table_t *hash_table)
+{
+    concurrent_flow_t *block = NULL;
+    uint32_t num_flows = atomic_load(&table->num_flows);
+    uint32_t flow_id = 0;
+
+    for (flow_id = 0; flow_id < num_flows; flow_id++)
+    {
+        block = atomic_load(&table->blocks[flow_id >> CONCURRENT_BLOCK_SHIFT]);
+        add_to_hash_table(&block[flow_id & CONCURRENT_BLOCK_MASK].key,
+                          atomic_load(&block[flow_id & CONCURRENT_BLOCK_MASK].ref_count), hash_table);
+    }
+
+    return;
+}
+
+void free_concurrent_table(concurrent_table_t *table)
+{
+    concurrent_generation_t *generation = atomic_load(&table->current);
+    concurrent_generation_t *temp = NULL;
+    uint32_t iteration = 0;
+
+    /* A generation linked as next but never switched to still needs freeing */
+    if (atomic_load(&generation->next) != NULL)
+    {
+        free(atomic_load(&generation->next)->slots);
+        free(atomic_load(&generation->next));
+    }
+
+    free(generation->slots);
+    free(generation);
+    generation = atomic_load(&table->retired);
+
+    while (generation != NULL)
+    {
+        temp = generation;
+        generation = generation->retired_next;
+        free(temp->slots);
+        free(temp);
+    }
+
+    for (iteration = 0; iteration < CONCURRENT_MAX_BLOCKS; iteration++)
+    {
+        free(atomic_load(&table->blocks[iteration]));
+    }
+
+    free(table->blocks);
+    table->blocks = NULL;
+
+    return;
+}
\ No newline at end of file
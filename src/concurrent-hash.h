@@ -0,0 +1,66 @@
+#ifndef CONCURRENT_HASH_H_INCLUDED
+#define CONCURRENT_HASH_H_INCLUDED
+
+#include <stdatomic.h>
+#include "hash.h"
+
+#define CONCURRENT_TABLE_SIZE 1024
+#define CONCURRENT_BLOCK_SHIFT 16
+#define CONCURRENT_BLOCK_FLOWS (1U << CONCURRENT_BLOCK_SHIFT)
+#define CONCURRENT_BLOCK_MASK (CONCURRENT_BLOCK_FLOWS - 1)
+#define CONCURRENT_MAX_BLOCKS (1U << (32 - CONCURRENT_BLOCK_SHIFT))
+#define MIGRATE_CHUNK 1024
+#define SLOT_EMPTY 0
+#define SLOT_MOVED 1
+#define SLOT_BUSY 2
+#define SLOT_FLOW_BASE 3
+
+/* Keys arrive already masked to the schema, so the schema independent
+ * flow_key_hash and is_same_flow_key serve every schema here */
+
+/* Slot state is EMPTY, MOVED (sealed by a migration), BUSY (key being
+ * written) or SLOT_FLOW_BASE + flow id once the key is published */
+typedef struct concurrent_slot
+{
+    _Atomic uint32_t state;
+    flow_key_t key;
+} concurrent_slot_t;
+
+typedef struct concurrent_flow
+{
+    flow_key_t key;
+    _Atomic uint32_t ref_count;
+} concurrent_flow_t;
+
+/* One slot array; growing links a twice bigger generation through next
+ * and every thread that notices helps migrate it chunk by chunk */
+typedef struct concurrent_generation
+{
+    concurrent_slot_t *slots;
+    uint32_t table_size;
+    _Atomic uint32_t num_elements;
+    _Atomic uint32_t migrate_cursor;
+    _Atomic uint32_t migrated_chunks;
+    _Atomic(struct concurrent_generation *) next;
+    struct concurrent_generation *retired_next;
+} concurrent_generation_t;
+
+/* Flow table shared by all ingestion threads: slots are claimed with
+ * CAS, counters are bumped atomically and flow records never move. It is
+ * not lock-free: a thread that meets a BUSY slot waits for its key, and
+ * growth waits until every claimed chunk has been migrated, so a stalled
+ * thread can hold up the others. */
+struct concurrent_table
+{
+    _Atomic(concurrent_generation_t *) current;
+    _Atomic(concurrent_generation_t *) retired;
+    _Atomic(concurrent_flow_t *) *blocks;
+    _Atomic uint32_t num_flows;
+};
+
+void init_concurrent_table(concurrent_table_t *table, uint32_t table_size);
+void insert_into_concurrent_table(const flow_key_t *key, uint32_t count, concurrent_table_t *table);
+void export_concurrent_table(const concurrent_table_t *table, hash_table_t *hash_table);
+void free_concurrent_table(concurrent_table_t *table);
+
+#endif // CONCURRENT_HASH_H_INCLUDED
\ No newline at end of file
@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include "export-follow.h"
+#include "file-handler.h"
+
+#if defined(__linux__)
+    #define HAVE_INOTIFY 1
+    #include <sys/inotify.h>
+#else
+    #define HAVE_INOTIFY 0
+#endif
+
+#define INOTIFY_BUFFER_SIZE 4096
+
+/* Wakes the follow loop when the export changes, a plain timer when inotify is missing */
+typedef struct export_watch
+{
+    const char *file_name;
+    int fd;
+    int wd;
+} export_watch_t;
+
+static volatile sig_atomic_t is_stop_requested = 0;
+
+static void request_stop(int signal_number);
+static void open_export_watch(export_watch_t *watch, const char *file_name);
+static void wait_for_export(export_watch_t *watch);
+static void close_export_watch(export_watch_t *watch);
+static bool_t save_checkpoint(hash_table_t *hash_table, const char *checkpoint, uint64_t offset, bool_t verbose);
+
+static void request_stop(int signal_number)
+{
+    (void)signal_number;
+    is_stop_requested = 1;
+
+    return;
+}
+
+/* Carry on from checkpoint, or start an empty table at offset 0 when there is none yet */
+bool_t resume_hash_table(hash_table_t *hash_table, const char *checkpoint, key_schema_t schema, uint64_t *offset)
+{
+    FILE *file = NULL;
+
+    file = fopen(checkpoint, "rb");
+
+    if (file == NULL && errno == ENOENT)
+    {
+        init_hash_table(hash_table, TABLE_SIZE, schema);
+        *offset = 0;
+
+        return true;
+    }
+
+    if (file != NULL)
+    {
+        fclose(file);
+    }
+
+    if (!load_hash_table(hash_table, checkpoint, schema, false, offset))
+    {
+        return false;
+    }
+
+    if (*offset == SNAPSHOT_NO_SOURCE_OFFSET)
+    {
+        fprintf(stderr, "%s was saved with -w and has no checkpoint to append from\n", checkpoint);
+        free_hash_table(hash_table);
+
+        return false;
+    }
+
+    return true;
+}
+
+static void open_export_watch(export_watch_t *watch, const char *file_name)
+{
+    watch->file_name = file_name;
+    watch->fd = -1;
+    watch->wd = -1;
+
+#if HAVE_INOTIFY
+    watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+
+    return;
+}
+
+/* Return once the export may have grown, at the latest after FOLLOW_POLL_MS,
+ * or early on a signal. The file is read again either way, events only
+ * make the wait shorter. */
+static void wait_for_export(export_watch_t *watch)
+{
+    struct pollfd poll_fd;
+    int num_fds = 0;
+
+#if HAVE_INOTIFY
+    char events[INOTIFY_BUFFER_SIZE];
+    const struct inotify_event *event = NULL;
+    ssize_t len = 0;
+    ssize_t position = 0;
+
+    /* A watch is lost when the file is replaced, put it on the new one */
+    if (watch->fd >= 0 && watch->wd < 0)
+    {
+        watch->wd = inotify_add_watch(watch->fd, watch->file_name, IN_MODIFY | IN_CLOSE_WRITE | IN_MOVE_SELF |
+                                                                   IN_DELETE_SELF | IN_ATTRIB);
+    }
+
+    num_fds = (watch->fd >= 0 && watch->wd >= 0) ? 1 : 0;
+#endif
+
+    poll_fd.fd = watch->fd;
+    poll_fd.events = POLLIN;
+    poll_fd.revents = 0;
+
+    if (poll(num_fds > 0 ? &poll_fd : NULL, (nfds_t)num_fds, FOLLOW_POLL_MS) <= 0)
+    {
+        return;
+    }
+
+#if HAVE_INOTIFY
+    while ((len = read(watch->fd, events, sizeof(events))) > 0)
+    {
+        for (position = 0; position < len; position += (ssize_t)(sizeof(struct inotify_event) + event->len))
+        {
+            event = (const struct inotify_event *)(events + position);
+
+            if ((event->mask & IN_IGNORED) != 0)
+            {
+                watch->wd = -1;
+            }
+        }
+    }
+#endif
+
+    return;
+}
+
+static void close_export_watch(export_watch_t *watch)
+{
+    if (watch->fd >= 0)
+    {
+        close(watch->fd);
+    }
+
+    watch->fd = -1;
+    watch->wd = -1;
+
+    return;
+}
+
+static bool_t save_checkpoint(hash_table_t *hash_table, const char *checkpoint, uint64_t offset, bool_t verbose)
+{
+    if (!save_hash_table(hash_table, checkpoint, offset))
+    {
+        return false;
+    }
+
+    if (verbose)
+    {
+        fprintf(stderr, "Checkpoint: %llu bytes, Flows: %u\n", (unsigned long long)offset, hash_table->list.count);
+    }
+
+    return true;
+}
+
+/* Count the export from offset on, then save the table with the offset it
+ * reached as checkpoint. When following, keep counting what is appended
+ * until SIGINT or SIGTERM, saving at most every FOLLOW_SAVE_SECONDS. The
+ * trailing packet is only counted after the last save, so the report has
+ * every packet while the checkpoint still starts at that packet. */
+bool_t follow_export(const char *export, const char *checkpoint, uint64_t offset, bool_t is_following, bool_t verbose,
+                     hash_table_t *hash_table)
+{
+    export_watch_t watch;
+    struct sigaction action;
+    uint64_t saved_offset = offset;
+    time_t saved_at = time(NULL);
+    bool_t is_ok = true;
+
+    if (is_following)
+    {
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = request_stop;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGINT, &action, NULL);
+        sigaction(SIGTERM, &action, NULL);
+        open_export_watch(&watch, export);
+    }
+
+    while (is_ok)
+    {
+        is_ok = process_exported_increment(export, &offset, false, hash_table);
+
+        if (!is_following || is_stop_requested || !is_ok)
+        {
+            break;
+        }
+
+        if (offset != saved_offset && time(NULL) - saved_at >= FOLLOW_SAVE_SECONDS)
+        {
+            is_ok = save_checkpoint(hash_table, checkpoint, offset, verbose);
+            saved_offset = offset;
+            saved_at = time(NULL);
+        }
+
+        wait_for_export(&watch);
+    }
+
+    if (is_following)
+    {
+        close_export_watch(&watch);
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+    }
+
+    /* A one-off run always leaves a checkpoint behind, even for an empty export */
+    if (is_ok && (offset != saved_offset || !is_following))
+    {
+        is_ok = save_checkpoint(hash_table, checkpoint, offset, verbose);
+    }
+
+    return is_ok && process_exported_increment(export, &offset, true, hash_table);
+}
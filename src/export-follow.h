@@ -0,0 +1,15 @@
+#ifndef EXPORT_FOLLOW_H_INCLUDED
+#define EXPORT_FOLLOW_H_INCLUDED
+
+#include <stdint.h>
+#include "packets.h"
+#include "hash.h"
+
+#define FOLLOW_POLL_MS 1000
+#define FOLLOW_SAVE_SECONDS 10
+
+bool_t resume_hash_table(hash_table_t *hash_table, const char *checkpoint, key_schema_t schema, uint64_t *offset);
+bool_t follow_export(const char *export, const char *checkpoint, uint64_t offset, bool_t is_following, bool_t verbose,
+                     hash_table_t *hash_table);
+
+#endif // EXPORT_FOLLOW_H_INCLUDED
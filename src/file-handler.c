@@ -3,15 +3,140 @@
 #include "file-handler.h"
 #include "linked-list.h"
 #include "hash.h"
-
+#include "hex-decoder.h"
+#include "cardinality.h"
+#include "sampling.h"
+#include "packet-filter.h"
+#include "record-scanner.h"
+#include "input-stream.h"
+
+static void add_descriptor_pair(const packet_descriptor_t *descriptor, cardinality_t *cardinality);
 static void process_line(char *line, FILE *output_file, bool_t *skip_newline_flag);
+static size_t decode_dump_line(const char *line, uint8_t *bytes);
+
+/* Feed a packet's IP pair to the fan-out/fan-in sketches */
+static void add_descriptor_pair(const packet_descriptor_t *descriptor, cardinality_t *cardinality)
+{
+    uint32_t source_ip = ip_to_uint32(descriptor->source_ip);
+    uint32_t destination_ip = ip_to_uint32(descriptor->destination_ip);
+
+    add_host_pair(cardinality, source_ip, destination_ip, host_pair_hash(source_ip, destination_ip));
+
+    return;
+}
+
+/* Count the flow a packet descriptor belongs to */
+void insert_descriptor(const packet_descriptor_t *descriptor, hash_table_t *hash_table)
+{
+    flow_sample_t sample;
+    flow_key_t key;
+    uint32_t flow_id = 0;
+
+    if (hash_table->filter != NULL && !is_descriptor_accepted(hash_table->filter, descriptor))
+    {
+        return;
+    }
+
+    make_flow_key(descriptor, hash_table->schema, &key);
+    flow_id = insert_into_hash_table(&key, hash_table);
+
+    if (hash_table->stats.enabled != 0 && flow_id != FLOW_ID_NONE)
+    {
+        make_flow_sample(descriptor, &sample);
+        record_flow_sample(&hash_table->stats, flow_id, &sample);
+    }
+
+    if (hash_table->cardinality != NULL)
+    {
+        add_descriptor_pair(descriptor, hash_table->cardinality);
+    }
+
+    return;
+}
+
+/* Like insert_descriptor, but the key waits in batch until a full batch can be inserted */
+void batch_descriptor(const packet_descriptor_t *descriptor, key_batch_t *batch, hash_table_t *hash_table)
+{
+    flow_sample_t sample;
+    flow_key_t key;
+
+    if (hash_table->filter != NULL && !is_descriptor_accepted(hash_table->filter, descriptor))
+    {
+        return;
+    }
+
+    make_flow_key(descriptor, hash_table->schema, &key);
+    make_flow_sample(descriptor, &sample);
+    add_to_key_batch(batch, &key, &sample, hash_table);
+
+    if (hash_table->cardinality != NULL)
+    {
+        add_descriptor_pair(descriptor, hash_table->cardinality);
+    }
+
+    return;
+}
+
+/* Parse one raw Ethernet frame and count its IP pair if it is IPv4/UDP */
+void process_frame(const uint8_t *frame, size_t frame_len, hash_table_t *hash_table)
+{
+    packet_descriptor_t descriptor = {0};
+
+    if (describe_frame(frame, frame_len, &descriptor))
+    {
+        insert_descriptor(&descriptor, hash_table);
+    }
+
+    return;
+}
+
+/* Hex-decode the header prefix of one input.txt record, is_complete is false on invalid hex.
+ * With a sampler only the bytes up to the IP pair are decoded first, and a
+ * record of an unsampled pair stops there with length 0. */
+size_t decode_record(const char *record, size_t record_len, const sampler_t *sampler, uint8_t frame[MAX_RECORD_BYTES],
+                     bool_t *is_complete)
+{
+    size_t expected_len = 0;
+    size_t peek_len = 0;
+    size_t frame_len = 0;
+
+    expected_len = record_len / 2;
+
+    if (expected_len > MAX_RECORD_BYTES)
+    {
+        expected_len = MAX_RECORD_BYTES;
+    }
+
+    if (sampler != NULL)
+    {
+        peek_len = (expected_len < SAMPLE_PEEK_BYTES) ? expected_len : SAMPLE_PEEK_BYTES;
+        frame_len = hex_decode(record, frame, peek_len);
+        *is_complete = (frame_len == peek_len);
+
+        if (!*is_complete)
+        {
+            return frame_len;
+        }
+
+        if (!is_frame_sampled(sampler, frame, frame_len))
+        {
+            return 0;
+        }
+    }
+
+    frame_len = peek_len + hex_decode(record + 2 * peek_len, frame + peek_len, expected_len - peek_len);
+    *is_complete = (frame_len == expected_len);
+
+    return frame_len;
+}
 
 bool_t process_extracted_packets(const char *export, const char *input)
 {
-    FILE *exported_file = NULL;
+    input_stream_t exported_file;
     FILE *input_file_for_processing = NULL;
     char line[MAX_LINE_LENGTH] = {0};
     bool_t skip_newline_flag = false;
+    bool_t is_failed = false;
 
     input_file_for_processing = fopen(input, "r");
 
@@ -23,12 +148,8 @@ bool_t process_extracted_packets(const char *export, const char *input)
         return true;
     }
 
-    exported_file = fopen(export, "r");
-
-    if (exported_file == NULL)
+    if (!open_input_stream(&exported_file, export))
     {
-        fprintf(stderr, "Error opening file: %s\n", PACKET_FILE);
-
         return false;
     }
 
@@ -37,114 +158,254 @@ bool_t process_extracted_packets(const char *export, const char *input)
     if (input_file_for_processing == NULL)
     {
         fprintf(stderr, "Error opening file: %s\n", INPUT_FILE);
-        fclose(exported_file);
+        close_input_stream(&exported_file);
 
         return false;
     }
 
     /* Read each line and process it */
-    while (fgets(line, sizeof(line), exported_file))
+    while (read_input_line(&exported_file, line, sizeof(line)))
     {
         process_line(line, input_file_for_processing, &skip_newline_flag);
     }
 
-    fclose(exported_file);
+    is_failed = exported_file.is_failed;
+    close_input_stream(&exported_file);
     fclose(input_file_for_processing);
 
+    /* A half converted file would be taken as finished on the next run */
+    if (is_failed)
+    {
+        remove(input);
+
+        return false;
+    }
+
     return true;
 }
 
-void process_input_file(const char *file_name, hash_table_entry_t ***hash_table, uint32_t *table_size)
+/* Decode the hex bytes of one "Packet Bytes" dump line, same layout rules as process_line */
+static size_t decode_dump_line(const char *line, uint8_t *bytes)
 {
-    char input_buffer[BUFFER_SIZE] = {0};
-    FILE *input_file = NULL;
-    ethernet_header_t *ethernet_header = NULL;
-    ipv4_header_t *ipv4_header = NULL;
-    udp_header_t *udp_header = NULL;
-    key_ip_pair_t *ip_pair = NULL;
-    size_t len = 0;
-    int ch = 0;
+    size_t count = 0;
+
+    if (strlen(line) < FIRST_SIX_CHAR)
+    {
+        return 0;
+    }
 
-    input_file = fopen(file_name, "r");
+    line += FIRST_SIX_CHAR;
 
-    if (input_file == NULL)
+    /* Padding spaces after a short last line end the hex column; a byte is
+     * only decoded before the terminator, so its second digit stays in line */
+    while (count < MAX_HEX_IN_LINE && line[0] != '\0' && hex_decode(line, bytes + count, 1) == 1)
     {
-        fprintf(stderr, "Error opening file: %s\n", file_name);
-        exit(EXIT_FAILURE);
+        count++;
+
+        if (line[2] != ' ')
+        {
+            break;
+        }
+
+        line += 3;
     }
 
-    ethernet_header = (ethernet_header_t *)calloc(STRUCT_MULTIPLIER, sizeof(ethernet_header_t));
-    ipv4_header = (ipv4_header_t *)calloc(STRUCT_MULTIPLIER, sizeof(ipv4_header_t));
-    udp_header = (udp_header_t *)calloc(STRUCT_MULTIPLIER, sizeof(udp_header_t));
-    ip_pair = (key_ip_pair_t *)calloc(STRUCT_MULTIPLIER, sizeof(key_ip_pair_t));
+    return count;
+}
 
-    if (ethernet_header == NULL || ipv4_header == NULL || udp_header == NULL || ip_pair == NULL)
+/* A line with nothing but its line ending separates two packets of the export */
+static inline bool_t is_blank_line(const char *line)
+{
+    while (*line == '\r')
     {
-        perror("Memory allocation failed for header structures");
-        free(ethernet_header);
-        free(ipv4_header);
-        free(udp_header);
-        free(ip_pair);
-        fclose(input_file);
-        ethernet_header = NULL;
-        ipv4_header = NULL;
-        udp_header = NULL;
-        ip_pair = NULL;
+        line++;
+    }
+
+    return *line == '\n';
+}
+
+/* Rebuild each packet of the export from its hex lines and count it,
+ * reading from offset start on. A packet is complete once the blank line
+ * after it, or the next packet, has been read; the offset just past the last
+ * complete one is returned. The trailing packet may still be half written,
+ * it is only counted when is_final. */
+static uint64_t count_exported_packets(input_stream_t *exported_file, uint64_t start, bool_t is_final,
+                                       hash_table_t *hash_table)
+{
+    char line[MAX_LINE_LENGTH] = {0};
+    uint8_t *packet = NULL;
+    uint8_t *resized = NULL;
+    size_t packet_len = 0;
+    size_t packet_capacity = PACKET_BUFFER_SIZE;
+    uint64_t position = start;
+    uint64_t consumed = start;
+    header_batch_t batch = {0};
+
+    packet = (uint8_t *)malloc(packet_capacity);
+
+    if (packet == NULL)
+    {
+        perror("Memory allocation failed for packet buffer");
+        close_input_stream(exported_file);
         exit(EXIT_FAILURE);
     }
 
-    /* Read the input file line by line */
-    while (fgets(input_buffer, sizeof(input_buffer), input_file))
+    while (read_input_line(exported_file, line, sizeof(line)))
     {
-        /* Get the length of the input line */
-        len = strlen(input_buffer);
+        /* Offset 0000 starts the next packet, so the previous one is complete */
+        if (strncmp(line, "0000", 4) == 0 && packet_len > 0)
+        {
+            add_to_header_batch(&batch, packet, packet_len, hash_table);
+            packet_len = 0;
+            consumed = position;
+        }
 
-        /* If the line exceeds the buffer size, discard the excess */
-        if (len == BUFFER_SIZE - 1 && input_buffer[BUFFER_SIZE - 2] != '\n')
+        position += strlen(line);
+
+        if (is_blank_line(line))
         {
-            /* Discard the rest of the line, This is payload.*/
-            while ((ch = fgetc(input_file)) != '\n' && ch != EOF)
+            if (packet_len > 0)
             {
-                /* Continue reading until end of line */
+                add_to_header_batch(&batch, packet, packet_len, hash_table);
+                packet_len = 0;
             }
-        }
 
-        /* Remove the newline character if present */
-        if (len > 0 && input_buffer[len - 1] == '\n')
-        {
-            input_buffer[len - 1] = '\0';
+            consumed = position;
+            continue;
         }
 
-        process_ethernet_header(input_buffer, ethernet_header);
-
-        if (is_ipv4(ethernet_header))
+        if (packet_len + MAX_HEX_IN_LINE > packet_capacity)
         {
-            process_ipv4_header(input_buffer, ipv4_header);
+            packet_capacity *= 2;
+            resized = (uint8_t *)realloc(packet, packet_capacity);
 
-            if (is_udp(ipv4_header))
+            if (resized == NULL)
             {
-                process_udp_header(input_buffer, udp_header, ipv4_header);
-                memcpy(ip_pair->source_ip, ipv4_header->source_ip, IP_SECTION_SIZE);
-                memcpy(ip_pair->destination_ip, ipv4_header->destination_ip, IP_SECTION_SIZE);
-                insert_into_hash_table(ip_pair, hash_table, table_size);
-
-                /*If Debug is turned on then this will work*/
-                PRINT_ETHERNET(ethernet_header);
-                PRINT_IP(ipv4_header);
-                PRINT_UDP(udp_header);
+                perror("Memory allocation failed for packet buffer");
+                free(packet);
+                close_input_stream(exported_file);
+                exit(EXIT_FAILURE);
             }
+
+            packet = resized;
+        }
+
+        packet_len += decode_dump_line(line, packet + packet_len);
+    }
+
+    if (is_final && packet_len > 0)
+    {
+        add_to_header_batch(&batch, packet, packet_len, hash_table);
+    }
+
+    flush_header_batch(&batch, hash_table);
+
+    free(packet);
+    packet = NULL;
+
+    return consumed;
+}
+
+/* Read the export once, rebuild each packet in memory and count it, nothing is written to disk */
+bool_t process_exported_stream(const char *export, hash_table_t *hash_table)
+{
+    input_stream_t exported_file;
+    bool_t is_failed = false;
+
+    if (!open_input_stream(&exported_file, export))
+    {
+        return false;
+    }
+
+    (void)count_exported_packets(&exported_file, 0, true, hash_table);
+    is_failed = exported_file.is_failed;
+    close_input_stream(&exported_file);
+
+    return !is_failed;
+}
+
+/* Count what was appended to the export since *offset. The file is reopened
+ * every call, so it may keep growing in between, and *offset only moves past
+ * complete packets. The trailing packet is left for the next call, or
+ * counted anyway when is_final, with *offset still before it. */
+bool_t process_exported_increment(const char *export, uint64_t *offset, bool_t is_final, hash_table_t *hash_table)
+{
+    input_stream_t exported_file;
+    bool_t is_failed = false;
+
+    if (!open_input_stream(&exported_file, export))
+    {
+        return false;
+    }
+
+    if (exported_file.compression != COMPRESSION_NONE)
+    {
+        fprintf(stderr, "%s is compressed, appending needs a plain export\n", export);
+        close_input_stream(&exported_file);
+
+        return false;
+    }
+
+    /* A file shorter than what was already counted has been replaced */
+    if (!seek_input_stream(&exported_file, *offset))
+    {
+        fprintf(stderr, "%s is shorter than its checkpoint, it was truncated or replaced\n", export);
+        close_input_stream(&exported_file);
+
+        return false;
+    }
+
+    *offset = count_exported_packets(&exported_file, *offset, is_final, hash_table);
+    is_failed = exported_file.is_failed;
+    close_input_stream(&exported_file);
+
+    return !is_failed;
+}
+
+/* Decode the header prefix of one input.txt record in one call and parse it as a raw frame */
+bool_t process_record(const char *record, size_t record_len, header_batch_t *batch, hash_table_t *hash_table)
+{
+    uint8_t frame[MAX_RECORD_BYTES] = {0};
+    size_t frame_len = 0;
+    bool_t is_complete = false;
+
+    frame_len = decode_record(record, record_len, hash_table->sampler, frame, &is_complete);
+
+    if (frame_len > 0)
+    {
+        add_to_header_batch(batch, frame, frame_len, hash_table);
+    }
+
+    return is_complete;
+}
+
+/* Count every record of input.txt. Only the header prefix of a record is
+ * decoded, however long its payload hex is. */
+void process_input_file(const char *file_name, hash_table_t *hash_table)
+{
+    record_scanner_t scanner;
+    header_batch_t batch = {0};
+    const char *record = NULL;
+    size_t record_len = 0;
+    uint32_t line_number = 0;
+
+    if (!open_record_scanner(&scanner, file_name, MAX_RECORD_HEX))
+    {
+        exit(EXIT_FAILURE);
+    }
+
+    while (next_record(&scanner, &record, &record_len))
+    {
+        line_number++;
+
+        if (!process_record(record, record_len, &batch, hash_table))
+        {
+            fprintf(stderr, "Invalid hex character on line %u, packet cut short\n", line_number);
         }
     }
 
-    free(ethernet_header);
-    free(ipv4_header);
-    free(udp_header);
-    free(ip_pair);
-    fclose(input_file);
-    ethernet_header = NULL;
-    ipv4_header = NULL;
-    udp_header = NULL;
-    ip_pair = NULL;
+    flush_header_batch(&batch, hash_table);
+    close_record_scanner(&scanner);
 
     return;
 }
@@ -4,16 +4,32 @@
 #include <stdio.h>
 #include "packets.h"
 #include "hash.h"
+#include "header-batch.h"
 
 #define INPUT_FILE "data/input.txt"
 #define PACKET_FILE "data/exported-packets.txt"
 #define SEPARATOR '\n'
 #define MAX_LINE_LENGTH 257
-#define BUFFER_SIZE 257
 #define FIRST_SIX_CHAR 6
 #define MAX_HEX_IN_LINE 16
+#define PACKET_BUFFER_SIZE 2048
+#define MAX_RECORD_BYTES 128
+#define MAX_RECORD_HEX (2 * MAX_RECORD_BYTES)
 
-void process_input_file(const char *file_name, hash_table_entry_t ***hash_table, uint32_t *table_size);
+/* Bytes decoded from the front of each input.txt record, the rest is payload.
+ * Sized for the headers, not for any line buffer: every lane of a header batch
+ * must come out whole, longest VLAN tags and IPv4 options included. */
+_Static_assert(MAX_RECORD_BYTES >= HEADER_PEEK_SIZE, "a record must decode to a full header batch lane");
+
+void process_input_file(const char *file_name, hash_table_t *hash_table);
 bool_t process_extracted_packets(const char *export, const char *input);
+bool_t process_exported_stream(const char *export, hash_table_t *hash_table);
+bool_t process_exported_increment(const char *export, uint64_t *offset, bool_t is_final, hash_table_t *hash_table);
+size_t decode_record(const char *record, size_t record_len, const sampler_t *sampler, uint8_t frame[MAX_RECORD_BYTES],
+                     bool_t *is_complete);
+void insert_descriptor(const packet_descriptor_t *descriptor, hash_table_t *hash_table);
+void batch_descriptor(const packet_descriptor_t *descriptor, key_batch_t *batch, hash_table_t *hash_table);
+bool_t process_record(const char *record, size_t record_len, header_batch_t *batch, hash_table_t *hash_table);
+void process_frame(const uint8_t *frame, size_t frame_len, hash_table_t *hash_table);
 
 #endif // FILE_HANDLER_H_INCLUDED
\ No newline at end of file
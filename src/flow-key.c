@@ -0,0 +1,206 @@
+#include <stdio.h>
+#include <string.h>
+#include "flow-key.h"
+
+#define IP_MASK {0xFF, 0xFF, 0xFF, 0xFF}
+
+const flow_key_t key_schema_masks[NUM_KEY_SCHEMAS] =
+{
+    [KEY_SOURCE] = {.source_ip = IP_MASK},
+    [KEY_DESTINATION] = {.destination_ip = IP_MASK},
+    [KEY_IP_PAIR] = {.source_ip = IP_MASK, .destination_ip = IP_MASK},
+    [KEY_DESTINATION_PORT] = {.destination_ip = IP_MASK, .destination_port = 0xFFFF},
+    [KEY_FIVE_TUPLE] = {.source_ip = IP_MASK, .destination_ip = IP_MASK,
+                        .source_port = 0xFFFF, .destination_port = 0xFFFF, .protocol = 0xFF}
+};
+
+static const char *const key_schema_names[NUM_KEY_SCHEMAS] =
+{
+    [KEY_SOURCE] = "src",
+    [KEY_DESTINATION] = "dst",
+    [KEY_IP_PAIR] = "pair",
+    [KEY_DESTINATION_PORT] = "dport",
+    [KEY_FIVE_TUPLE] = "5tuple"
+};
+
+/* Build the key of a packet under a schema */
+void make_flow_key(const packet_descriptor_t *descriptor, key_schema_t schema, flow_key_t *key)
+{
+    memset(key, 0, sizeof(flow_key_t));
+    memcpy(key->source_ip, descriptor->source_ip, IP_SECTION_SIZE);
+    memcpy(key->destination_ip, descriptor->destination_ip, IP_SECTION_SIZE);
+    key->source_port = descriptor->source_port;
+    key->destination_port = descriptor->destination_port;
+    key->protocol = descriptor->protocol;
+    mask_flow_key(key, schema);
+
+    return;
+}
+
+bool_t parse_key_schema(const char *text, key_schema_t *schema)
+{
+    uint32_t iteration = 0;
+
+    if (text == NULL)
+    {
+        return false;
+    }
+
+    for (iteration = 0; iteration < NUM_KEY_SCHEMAS; iteration++)
+    {
+        if (strcmp(text, key_schema_names[iteration]) == 0)
+        {
+            *schema = (key_schema_t)iteration;
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+const char *key_schema_name(key_schema_t schema)
+{
+    return key_schema_names[schema];
+}
+
+static bool_t has_source_ip(key_schema_t schema)
+{
+    return schema == KEY_SOURCE || schema == KEY_IP_PAIR || schema == KEY_FIVE_TUPLE;
+}
+
+static bool_t has_destination_ip(key_schema_t schema)
+{
+    return schema != KEY_SOURCE;
+}
+
+/* Characters taken by the key columns of a report row */
+uint32_t key_columns_width(key_schema_t schema)
+{
+    uint32_t width = 0;
+
+    width += has_source_ip(schema) ? KEY_IP_COLUMN_WIDTH : 0;
+    width += (schema == KEY_FIVE_TUPLE) ? KEY_PORT_COLUMN_WIDTH : 0;
+    width += has_destination_ip(schema) ? KEY_IP_COLUMN_WIDTH : 0;
+    width += (schema == KEY_DESTINATION_PORT || schema == KEY_FIVE_TUPLE) ? KEY_PORT_COLUMN_WIDTH : 0;
+    width += (schema == KEY_FIVE_TUPLE) ? KEY_PORT_COLUMN_WIDTH : 0;
+
+    return width;
+}
+
+void print_key_rule(key_schema_t schema)
+{
+    if (has_source_ip(schema))
+    {
+        fputs("+-------------------", stdout);
+    }
+
+    if (schema == KEY_FIVE_TUPLE)
+    {
+        fputs("+-------", stdout);
+    }
+
+    if (has_destination_ip(schema))
+    {
+        fputs("+-------------------", stdout);
+    }
+
+    if (schema == KEY_DESTINATION_PORT || schema == KEY_FIVE_TUPLE)
+    {
+        fputs("+-------", stdout);
+    }
+
+    if (schema == KEY_FIVE_TUPLE)
+    {
+        fputs("+-------", stdout);
+    }
+
+    return;
+}
+
+void print_key_heading(key_schema_t schema)
+{
+    if (has_source_ip(schema))
+    {
+        fputs("|     Source IP     ", stdout);
+    }
+
+    if (schema == KEY_FIVE_TUPLE)
+    {
+        fputs("| SPort ", stdout);
+    }
+
+    if (has_destination_ip(schema))
+    {
+        fputs("|   Destination IP  ", stdout);
+    }
+
+    if (schema == KEY_DESTINATION_PORT || schema == KEY_FIVE_TUPLE)
+    {
+        fputs("| DPort ", stdout);
+    }
+
+    if (schema == KEY_FIVE_TUPLE)
+    {
+        fputs("| Proto ", stdout);
+    }
+
+    return;
+}
+
+void print_key_cells(const flow_key_t *key, key_schema_t schema)
+{
+    if (has_source_ip(schema))
+    {
+        printf("|  %3hhu.%3hhu.%3hhu.%3hhu  ",
+               key->source_ip[0], key->source_ip[1], key->source_ip[2], key->source_ip[3]);
+    }
+
+    if (schema == KEY_FIVE_TUPLE)
+    {
+        printf("| %5u ", key->source_port);
+    }
+
+    if (has_destination_ip(schema))
+    {
+        printf("|  %3hhu.%3hhu.%3hhu.%3hhu  ",
+               key->destination_ip[0], key->destination_ip[1], key->destination_ip[2], key->destination_ip[3]);
+    }
+
+    if (schema == KEY_DESTINATION_PORT || schema == KEY_FIVE_TUPLE)
+    {
+        printf("| %5u ", key->destination_port);
+    }
+
+    if (schema == KEY_FIVE_TUPLE)
+    {
+        printf("| %5u ", key->protocol);
+    }
+
+    return;
+}
+
+/* A +---+ line, width counts both corners */
+void print_table_rule(uint32_t width)
+{
+    uint32_t iteration = 0;
+
+    putchar('+');
+
+    for (iteration = 2; iteration < width; iteration++)
+    {
+        putchar('-');
+    }
+
+    puts("+");
+
+    return;
+}
+
+/* One framed title line, width counts both borders */
+void print_table_title(const char *title, uint32_t left_pad, uint32_t width)
+{
+    printf("|%*s%s%*s|\n", (int)left_pad, "", title, (int)(width - 2 - left_pad - strlen(title)), "");
+
+    return;
+}
@@ -0,0 +1,98 @@
+#ifndef FLOW_KEY_H_INCLUDED
+#define FLOW_KEY_H_INCLUDED
+
+#include <stdint.h>
+#include <string.h>
+#include "packets.h"
+
+#define FLOW_KEY_SIZE 16
+#define KEY_IP_COLUMN_WIDTH 20
+#define KEY_PORT_COLUMN_WIDTH 8
+#define PAIR_KEY_WIDTH (2 * KEY_IP_COLUMN_WIDTH)
+#define COUNT_COLUMN_WIDTH 16
+
+/* What a flow is aggregated by; every schema gets its own hash, equality and
+ * insert path, generated from FOR_EACH_KEY_SCHEMA */
+typedef enum
+{
+    KEY_SOURCE = 0,
+    KEY_DESTINATION,
+    KEY_IP_PAIR,
+    KEY_DESTINATION_PORT,
+    KEY_FIVE_TUPLE,
+    NUM_KEY_SCHEMAS
+} key_schema_t;
+
+#define FOR_EACH_KEY_SCHEMA(X)                  \
+    X(KEY_SOURCE, source)                       \
+    X(KEY_DESTINATION, destination)             \
+    X(KEY_IP_PAIR, ip_pair)                     \
+    X(KEY_DESTINATION_PORT, destination_port)   \
+    X(KEY_FIVE_TUPLE, five_tuple)
+
+/* Packed 16 byte key, fields the schema does not use are zero. The layout
+ * keeps each schema's fields in at most two aligned 64 bit words: addresses
+ * in the first, destination IP + ports in bytes 4..11, protocol in the second. */
+typedef struct flow_key
+{
+    uint8_t source_ip[IP_SECTION_SIZE];
+    uint8_t destination_ip[IP_SECTION_SIZE];
+    uint16_t source_port;
+    uint16_t destination_port;
+    uint8_t protocol;
+    uint8_t reserved[3];
+} flow_key_t;
+
+_Static_assert(sizeof(flow_key_t) == FLOW_KEY_SIZE, "flow_key_t must stay two words");
+
+extern const flow_key_t key_schema_masks[NUM_KEY_SCHEMAS];
+
+static inline uint64_t flow_key_word(const flow_key_t *key, size_t offset)
+{
+    uint64_t word = 0;
+
+    memcpy(&word, (const uint8_t *)key + offset, sizeof(uint64_t));
+
+    return word;
+}
+
+static inline uint32_t flow_key_half_word(const flow_key_t *key, size_t offset)
+{
+    uint32_t word = 0;
+
+    memcpy(&word, (const uint8_t *)key + offset, sizeof(uint32_t));
+
+    return word;
+}
+
+/* Clear the fields a schema does not aggregate by */
+static inline void mask_flow_key(flow_key_t *key, key_schema_t schema)
+{
+    uint64_t words[2] = {0};
+
+    memcpy(words, key, FLOW_KEY_SIZE);
+    words[0] &= flow_key_word(&key_schema_masks[schema], 0);
+    words[1] &= flow_key_word(&key_schema_masks[schema], sizeof(uint64_t));
+    memcpy(key, words, FLOW_KEY_SIZE);
+
+    return;
+}
+
+uint32_t key_columns_width(key_schema_t schema);
+
+/* Report titles are laid out for the IP pair columns and shift with the key width */
+static inline uint32_t key_title_pad(uint32_t pair_pad, key_schema_t schema)
+{
+    return pair_pad + key_columns_width(schema) / 2 - PAIR_KEY_WIDTH / 2;
+}
+
+void make_flow_key(const packet_descriptor_t *descriptor, key_schema_t schema, flow_key_t *key);
+bool_t parse_key_schema(const char *text, key_schema_t *schema);
+const char *key_schema_name(key_schema_t schema);
+void print_key_rule(key_schema_t schema);
+void print_key_heading(key_schema_t schema);
+void print_key_cells(const flow_key_t *key, key_schema_t schema);
+void print_table_rule(uint32_t width);
+void print_table_title(const char *title, uint32_t left_pad, uint32_t width);
+
+#endif // FLOW_KEY_H_INCLUDED
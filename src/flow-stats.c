@@ -0,0 +1,369 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flow-stats.h"
+
+#define STATS_TITLE "Flow Statistics"
+#define PERCENT 100
+
+static void *grow_column(void *column, size_t element_size, uint32_t old_capacity, uint32_t new_capacity);
+static uint32_t top_bucket(const uint32_t *histogram, uint32_t num_buckets, uint32_t *share);
+
+static const char *const ttl_bucket_labels[TTL_BUCKETS] = {"32", "64", "128", "255"};
+
+void init_flow_stats(flow_stats_t *stats, uint32_t enabled)
+{
+    memset(stats, 0, sizeof(flow_stats_t));
+    stats->enabled = enabled & STATS_ALL;
+
+    return;
+}
+
+/* Resize one column and zero its new tail */
+static void *grow_column(void *column, size_t element_size, uint32_t old_capacity, uint32_t new_capacity)
+{
+    uint8_t *resized = (uint8_t *)realloc(column, (size_t)new_capacity * element_size);
+
+    if (resized == NULL)
+    {
+        perror("Memory allocation failed for flow statistics");
+        exit(EXIT_FAILURE);
+    }
+
+    memset(resized + (size_t)old_capacity * element_size, 0, (size_t)(new_capacity - old_capacity) * element_size);
+
+    return resized;
+}
+
+/* Make room for num_flows flows in every enabled column */
+void reserve_flow_stats(flow_stats_t *stats, uint32_t num_flows)
+{
+    uint32_t new_capacity = (stats->capacity == 0) ? STATS_INITIAL_CAPACITY : stats->capacity;
+    uint32_t flow_id = 0;
+
+    while (new_capacity < num_flows)
+    {
+        new_capacity *= 2;
+    }
+
+    if (new_capacity == stats->capacity || stats->enabled == 0)
+    {
+        return;
+    }
+
+    if (stats->enabled & STATS_BYTES)
+    {
+        stats->ip_bytes = grow_column(stats->ip_bytes, sizeof(uint64_t), stats->capacity, new_capacity);
+        stats->payload_bytes = grow_column(stats->payload_bytes, sizeof(uint64_t), stats->capacity, new_capacity);
+    }
+
+    if (stats->enabled & STATS_SIZE)
+    {
+        stats->min_size = grow_column(stats->min_size, sizeof(uint16_t), stats->capacity, new_capacity);
+        stats->max_size = grow_column(stats->max_size, sizeof(uint16_t), stats->capacity, new_capacity);
+
+        for (flow_id = stats->capacity; flow_id < new_capacity; flow_id++)
+        {
+            stats->min_size[flow_id] = UINT16_MAX;
+        }
+    }
+
+    if (stats->enabled & STATS_TTL)
+    {
+        stats->ttl_histogram = grow_column(stats->ttl_histogram, sizeof(stats->ttl_histogram[0]), stats->capacity, new_capacity);
+    }
+
+    if (stats->enabled & STATS_TOS)
+    {
+        stats->tos_histogram = grow_column(stats->tos_histogram, sizeof(stats->tos_histogram[0]), stats->capacity, new_capacity);
+    }
+
+    stats->capacity = new_capacity;
+
+    return;
+}
+
+/* Fold one flow of source into a flow of target, both tables track the same columns */
+void merge_flow_stats(flow_stats_t *target, uint32_t target_id, const flow_stats_t *source, uint32_t source_id)
+{
+    uint32_t bucket = 0;
+
+    if (target->enabled == 0 || source_id >= source->capacity)
+    {
+        return;
+    }
+
+    if (target_id >= target->capacity)
+    {
+        reserve_flow_stats(target, target_id + 1);
+    }
+
+    if (target->enabled & STATS_BYTES)
+    {
+        target->ip_bytes[target_id] += source->ip_bytes[source_id];
+        target->payload_bytes[target_id] += source->payload_bytes[source_id];
+    }
+
+    if (target->enabled & STATS_SIZE)
+    {
+        if (source->min_size[source_id] < target->min_size[target_id])
+        {
+            target->min_size[target_id] = source->min_size[source_id];
+        }
+
+        if (source->max_size[source_id] > target->max_size[target_id])
+        {
+            target->max_size[target_id] = source->max_size[source_id];
+        }
+    }
+
+    for (bucket = 0; (target->enabled & STATS_TTL) && bucket < TTL_BUCKETS; bucket++)
+    {
+        target->ttl_histogram[target_id][bucket] += source->ttl_histogram[source_id][bucket];
+    }
+
+    for (bucket = 0; (target->enabled & STATS_TOS) && bucket < TOS_BUCKETS; bucket++)
+    {
+        target->tos_histogram[target_id][bucket] += source->tos_histogram[source_id][bucket];
+    }
+
+    return;
+}
+
+/* Parse a comma separated list of bytes, size, ttl, tos or all */
+bool_t parse_stats_columns(const char *text, uint32_t *enabled)
+{
+    const char *end = NULL;
+    size_t len = 0;
+
+    if (text == NULL || *text == '\0')
+    {
+        return false;
+    }
+
+    *enabled = 0;
+
+    while (*text != '\0')
+    {
+        end = strchr(text, ',');
+        len = (end != NULL) ? (size_t)(end - text) : strlen(text);
+
+        if (len == 5 && strncmp(text, "bytes", len) == 0)
+        {
+            *enabled |= STATS_BYTES;
+        }
+        else if (len == 4 && strncmp(text, "size", len) == 0)
+        {
+            *enabled |= STATS_SIZE;
+        }
+        else if (len == 3 && strncmp(text, "ttl", len) == 0)
+        {
+            *enabled |= STATS_TTL;
+        }
+        else if (len == 3 && strncmp(text, "tos", len) == 0)
+        {
+            *enabled |= STATS_TOS;
+        }
+        else if (len == 3 && strncmp(text, "all", len) == 0)
+        {
+            *enabled |= STATS_ALL;
+        }
+        else
+        {
+            return false;
+        }
+
+        text += len + (end != NULL);
+    }
+
+    return *enabled != 0;
+}
+
+/* Most frequent bucket and its share of the flow's packets in percent */
+static uint32_t top_bucket(const uint32_t *histogram, uint32_t num_buckets, uint32_t *share)
+{
+    uint64_t total = 0;
+    uint32_t top = 0;
+    uint32_t bucket = 0;
+
+    for (bucket = 0; bucket < num_buckets; bucket++)
+    {
+        total += histogram[bucket];
+        top = (histogram[bucket] > histogram[top]) ? bucket : top;
+    }
+
+    *share = (total == 0) ? 0 : (uint32_t)((uint64_t)histogram[top] * PERCENT / total);
+
+    return top;
+}
+
+static void print_stats_rule(const flow_stats_t *stats, key_schema_t schema)
+{
+    fputs("+-----", stdout);
+    print_key_rule(schema);
+    fputs("+--------------", stdout);
+
+    if (stats->enabled & STATS_BYTES)
+    {
+        fputs("+----------------+----------------", stdout);
+    }
+
+    if (stats->enabled & STATS_SIZE)
+    {
+        fputs("+-------+-------", stdout);
+    }
+
+    if (stats->enabled & STATS_TTL)
+    {
+        fputs("+----------", stdout);
+    }
+
+    if (stats->enabled & STATS_TOS)
+    {
+        fputs("+----------", stdout);
+    }
+
+    puts("+");
+
+    return;
+}
+
+/* One row per flow in first-seen order, then the totals over every flow */
+void print_flow_stats(const flow_stats_t *stats, const data_list_t *list, key_schema_t schema)
+{
+    const data_list_node_t *node = NULL;
+    uint64_t total_ip_bytes = 0;
+    uint64_t total_payload_bytes = 0;
+    uint64_t ttl_totals[TTL_BUCKETS] = {0};
+    uint64_t tos_totals[TOS_BUCKETS] = {0};
+    uint32_t width = LIST_NUMBER_WIDTH + key_columns_width(schema) + COUNT_COLUMN_WIDTH;
+    uint32_t flow_id = 0;
+    uint32_t bucket = 0;
+    uint32_t share = 0;
+
+    if (stats->enabled == 0)
+    {
+        return;
+    }
+
+    width += (stats->enabled & STATS_BYTES) ? 34 : 0;
+    width += (stats->enabled & STATS_SIZE) ? 16 : 0;
+    width += (stats->enabled & STATS_TTL) ? 11 : 0;
+    width += (stats->enabled & STATS_TOS) ? 11 : 0;
+
+    print_table_rule(width);
+    print_table_title(STATS_TITLE, (width - 2 - (uint32_t)strlen(STATS_TITLE)) / 2, width);
+    print_stats_rule(stats, schema);
+    fputs("|  No ", stdout);
+    print_key_heading(schema);
+    fputs("|    Packets   ", stdout);
+
+    if (stats->enabled & STATS_BYTES)
+    {
+        fputs("|    IP Bytes    |  UDP Payload   ", stdout);
+    }
+
+    if (stats->enabled & STATS_SIZE)
+    {
+        fputs("|  Min  |  Max  ", stdout);
+    }
+
+    if (stats->enabled & STATS_TTL)
+    {
+        fputs("| TTL <=  %", stdout);
+    }
+
+    if (stats->enabled & STATS_TOS)
+    {
+        fputs("| Prec    %", stdout);
+    }
+
+    puts("|");
+    print_stats_rule(stats, schema);
+
+    for (flow_id = 0; flow_id < list->count; flow_id++)
+    {
+        node = list_node(list, flow_id);
+        printf("| %3u ", flow_id + 1);
+        print_key_cells(&node->key, schema);
+        printf("| %12u ", node->ref_count);
+
+        if (stats->enabled & STATS_BYTES)
+        {
+            printf("| %14llu | %14llu ", (unsigned long long)stats->ip_bytes[flow_id],
+                   (unsigned long long)stats->payload_bytes[flow_id]);
+            total_ip_bytes += stats->ip_bytes[flow_id];
+            total_payload_bytes += stats->payload_bytes[flow_id];
+        }
+
+        if (stats->enabled & STATS_SIZE)
+        {
+            printf("| %5u | %5u ", stats->min_size[flow_id], stats->max_size[flow_id]);
+        }
+
+        if (stats->enabled & STATS_TTL)
+        {
+            bucket = top_bucket(stats->ttl_histogram[flow_id], TTL_BUCKETS, &share);
+            printf("| %3s %3u%% ", ttl_bucket_labels[bucket], share);
+
+            for (bucket = 0; bucket < TTL_BUCKETS; bucket++)
+            {
+                ttl_totals[bucket] += stats->ttl_histogram[flow_id][bucket];
+            }
+        }
+
+        if (stats->enabled & STATS_TOS)
+        {
+            bucket = top_bucket(stats->tos_histogram[flow_id], TOS_BUCKETS, &share);
+            printf("| %3u %3u%% ", bucket, share);
+
+            for (bucket = 0; bucket < TOS_BUCKETS; bucket++)
+            {
+                tos_totals[bucket] += stats->tos_histogram[flow_id][bucket];
+            }
+        }
+
+        puts("|");
+        print_stats_rule(stats, schema);
+    }
+
+    if (stats->enabled & STATS_BYTES)
+    {
+        printf("IP bytes: %llu, UDP payload bytes: %llu\n",
+               (unsigned long long)total_ip_bytes, (unsigned long long)total_payload_bytes);
+    }
+
+    if (stats->enabled & STATS_TTL)
+    {
+        printf("TTL <=32: %llu, <=64: %llu, <=128: %llu, <=255: %llu\n",
+               (unsigned long long)ttl_totals[0], (unsigned long long)ttl_totals[1],
+               (unsigned long long)ttl_totals[2], (unsigned long long)ttl_totals[3]);
+    }
+
+    if (stats->enabled & STATS_TOS)
+    {
+        fputs("IP precedence", stdout);
+
+        for (bucket = 0; bucket < TOS_BUCKETS; bucket++)
+        {
+            printf("%s %u: %llu", (bucket == 0) ? "" : ",", bucket, (unsigned long long)tos_totals[bucket]);
+        }
+
+        putchar('\n');
+    }
+
+    return;
+}
+
+void free_flow_stats(flow_stats_t *stats)
+{
+    free(stats->ip_bytes);
+    free(stats->payload_bytes);
+    free(stats->min_size);
+    free(stats->max_size);
+    free(stats->ttl_histogram);
+    free(stats->tos_histogram);
+    init_flow_stats(stats, stats->enabled);
+
+    return;
+}
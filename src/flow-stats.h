@@ -0,0 +1,99 @@
+#ifndef FLOW_STATS_H_INCLUDED
+#define FLOW_STATS_H_INCLUDED
+
+#include <stdint.h>
+#include "packets.h"
+#include "linked-list.h"
+
+#define STATS_BYTES 0x1
+#define STATS_SIZE 0x2
+#define STATS_TTL 0x4
+#define STATS_TOS 0x8
+#define STATS_ALL (STATS_BYTES | STATS_SIZE | STATS_TTL | STATS_TOS)
+#define STATS_INITIAL_CAPACITY 1024
+#define TTL_BUCKETS 4
+#define TOS_BUCKETS 8
+#define TOS_PRECEDENCE_SHIFT 5
+#define FLOW_ID_NONE UINT32_MAX
+
+/* What one packet contributes to its flow's statistics */
+typedef struct flow_sample
+{
+    uint16_t ip_len;
+    uint16_t udp_len;
+    uint8_t ttl;
+    uint8_t tos;
+} flow_sample_t;
+
+/* Per-flow statistics as one array per counter, indexed by flow id. Only the
+ * columns named in enabled are allocated or touched, so a packet costs one
+ * store per enabled counter and nothing for the rest. TTLs are bucketed by the
+ * usual initial values (<=32, <=64, <=128, more) and TOS by IP precedence. */
+typedef struct flow_stats
+{
+    uint32_t enabled;
+    uint32_t capacity;
+    uint64_t *ip_bytes;
+    uint64_t *payload_bytes;
+    uint16_t *min_size;
+    uint16_t *max_size;
+    uint32_t (*ttl_histogram)[TTL_BUCKETS];
+    uint32_t (*tos_histogram)[TOS_BUCKETS];
+} flow_stats_t;
+
+void init_flow_stats(flow_stats_t *stats, uint32_t enabled);
+void reserve_flow_stats(flow_stats_t *stats, uint32_t num_flows);
+void merge_flow_stats(flow_stats_t *target, uint32_t target_id, const flow_stats_t *source, uint32_t source_id);
+bool_t parse_stats_columns(const char *text, uint32_t *enabled);
+void print_flow_stats(const flow_stats_t *stats, const data_list_t *list, key_schema_t schema);
+void free_flow_stats(flow_stats_t *stats);
+
+static inline void make_flow_sample(const packet_descriptor_t *descriptor, flow_sample_t *sample)
+{
+    sample->ip_len = descriptor->ip_len;
+    sample->udp_len = descriptor->udp_len;
+    sample->ttl = descriptor->ttl;
+    sample->tos = descriptor->tos;
+
+    return;
+}
+
+static inline uint32_t ttl_bucket(uint8_t ttl)
+{
+    return (uint32_t)(ttl > 32) + (uint32_t)(ttl > 64) + (uint32_t)(ttl > 128);
+}
+
+/* Add one packet to its flow, growing the columns when the flow is new */
+static inline void record_flow_sample(flow_stats_t *stats, uint32_t flow_id, const flow_sample_t *sample)
+{
+    if (flow_id >= stats->capacity)
+    {
+        reserve_flow_stats(stats, flow_id + 1);
+    }
+
+    if (stats->enabled & STATS_BYTES)
+    {
+        stats->ip_bytes[flow_id] += sample->ip_len;
+        stats->payload_bytes[flow_id] += (sample->udp_len > UDP_HEADER_SIZE) ? sample->udp_len - UDP_HEADER_SIZE : 0;
+    }
+
+    if (stats->enabled & STATS_SIZE)
+    {
+        stats->min_size[flow_id] = (sample->ip_len < stats->min_size[flow_id]) ? sample->ip_len : stats->min_size[flow_id];
+        stats->max_size[flow_id] = (sample->ip_len > stats->max_size[flow_id]) ? sample->ip_len : stats->max_size[flow_id];
+    }
+
+    if (stats->enabled & STATS_TTL)
+    {
+        stats->ttl_histogram[flow_id][ttl_bucket(sample->ttl)]++;
+    }
+
+    if (stats->enabled & STATS_TOS)
+    {
+        stats->tos_histogram[flow_id][sample->tos >> TOS_PRECEDENCE_SHIFT]++;
+    }
+
+    return;
+}
+
+#endif // FLOW_STATS_H_INCLUDED
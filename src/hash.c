@@ -2,283 +2,1164 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <stddef.h>
+#include <time.h>
 #include "hash.h"
 #include "packets.h"
+#include "concurrent-hash.h"
+#include "heavy-hitters.h"
+#include "sampling.h"
+#include "host-index.h"
 
-static void jhash(uint32_t *a, uint32_t *b);
-static inline uint32_t ip_to_uint32(const uint8_t ip[IP_SECTION_SIZE]);
-static inline uint32_t ip_pair_hash(const key_ip_pair_t *ip_pair, uint32_t *table_size);
-static bool_t is_prime(uint32_t value);
-static void rehash(hash_table_entry_t ***hash_table, uint32_t *table_size);
+static inline uint8_t control_tag(uint32_t hash);
+static inline data_list_node_t *slot_node(const hash_table_t *hash_table, uint32_t flow_id);
+static void allocate_slots(hash_table_t *hash_table, uint32_t table_size);
+static void start_rehash(hash_table_t *hash_table);
+static void migrate_slots(hash_table_t *hash_table, uint32_t budget);
+static inline uint64_t monotonic_ns(void);
+static inline bool_t is_growth_idle(const hash_table_t *hash_table);
+static inline void grow_step(hash_table_t *hash_table);
+static void note_first_insert(hash_table_t *hash_table, uint32_t flow_id);
+static void replay_inserts(hash_table_t *hash_table, uint64_t num_inserts);
+static uint32_t index_digits(uint32_t table_size);
+static void print_hash_rule(uint32_t digits, key_schema_t schema);
+static uint64_t snapshot_checksum(const void *data, size_t len, uint64_t checksum);
+static inline bool_t is_snapshot_memory(const hash_table_t *hash_table, const void *memory);
 
-/* Rotate and hash utility */
-static void jhash(uint32_t *a, uint32_t *b)
+typedef bool_t (*flow_key_equal_fn)(const flow_key_t *first, const flow_key_t *second);
+
+/* The functions generated for one key schema */
+struct key_schema_ops
+{
+    uint32_t (*hash)(const flow_key_t *key);
+    void (*hash_keys)(const flow_key_t *keys, uint32_t *hashes, uint32_t count);
+    uint32_t (*add_hashed)(const flow_key_t *key, uint32_t hash, uint32_t count, hash_table_t *hash_table);
+    void (*insert_hashed_batch)(const flow_key_t *keys, const uint32_t *hashes, const flow_sample_t *samples,
+                                uint32_t count, hash_table_t *hash_table);
+};
+
+static const key_schema_ops_t key_schema_ops[NUM_KEY_SCHEMAS];
+
+#define SNAPSHOT_MAGIC "PKTFLOWS"
+#define SNAPSHOT_BYTE_ORDER 0x01020304U
+#define SNAPSHOT_CHECKSUM_SEED 0xCBF29CE484222325ULL
+#define SNAPSHOT_CHECKSUM_PRIME 0x100000001B3ULL
+#define SNAPSHOT_WRITE_SLOTS 4096
+#define snapshot_align(offset) (((offset) + SNAPSHOT_ALIGNMENT - 1) & ~(uint64_t)(SNAPSHOT_ALIGNMENT - 1))
+
+/* A snapshot is this header, then the control bytes, the slots and the
+ * first-seen list nodes exactly as they sit in memory, each section
+ * SNAPSHOT_ALIGNMENT aligned. The nodes are padded with zeros to whole
+ * LIST_BLOCK_NODES blocks, so a mapped file is used in place: the table's
+ * arrays point into it and only the list's block pointers are allocated.
+ * The header checksum covers every field before it, the payload checksum
+ * the three sections without their padding. source_offset is how far into
+ * the export an append-mode table has counted, SNAPSHOT_NO_SOURCE_OFFSET
+ * for a table saved with -w. */
+typedef struct snapshot_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t key_size;
+    uint32_t slot_size;
+    uint32_t node_size;
+    uint32_t schema;
+    uint32_t table_size;
+    uint32_t num_flows;
+    uint32_t num_rehashes;
+    uint32_t reserved;
+    uint64_t control_offset;
+    uint64_t slots_offset;
+    uint64_t nodes_offset;
+    uint64_t file_size;
+    uint64_t source_offset;
+    uint64_t payload_checksum;
+    uint64_t header_checksum;
+} snapshot_header_t;
+
+/* The top hash bits go in the control byte, the low bits pick the slot */
+static inline uint8_t control_tag(uint32_t hash)
+{
+    return (uint8_t)(CONTROL_FULL | (hash >> CONTROL_TAG_SHIFT));
+}
+
+/* The list node a slot points at. Slots of a loaded snapshot are used as
+ * they are on disk and only -C checksums them, so a flow id past the list
+ * means a damaged file: stop instead of reading outside the nodes. */
+static inline data_list_node_t *slot_node(const hash_table_t *hash_table, uint32_t flow_id)
+{
+    if (flow_id >= hash_table->list.count)
+    {
+        fputs("corrupt snapshot: a slot points past the flow list, check it with -C\n", stderr);
+        exit(EXIT_FAILURE);
+    }
+
+    return list_node(&hash_table->list, flow_id);
+}
+
+static void allocate_slots(hash_table_t *hash_table, uint32_t table_size)
+{
+    hash_table->control = (uint8_t *)calloc(table_size, sizeof(uint8_t));
+    hash_table->slots = (hash_table_slot_t *)malloc(table_size * sizeof(hash_table_slot_t));
+
+    if (hash_table->control == NULL || hash_table->slots == NULL)
+    {
+        perror("Memory Initialized Failed For Hash Table");
+        exit(EXIT_FAILURE);
+    }
+
+    hash_table->table_size = table_size;
+
+    return;
+}
+
+/* Initialize an empty table keyed by schema, table_size is rounded up to a power of two */
+void init_hash_table(hash_table_t *hash_table, uint32_t table_size, key_schema_t schema)
 {
-    *a ^= *b;
-    *a -= roll32(*b, ROTATE_1);
-    *b ^= *a;
-    *b -= roll32(*a, ROTATE_2);
-    *a ^= *b;
-    *a -= roll32(*b, ROTATE_3);
-    *b ^= *a;
-    *b -= roll32(*a, ROTATE_4);
+    uint32_t power_of_two = TABLE_SIZE;
+
+    while (power_of_two < table_size)
+    {
+        power_of_two *= NEXT_MULTIPLIER;
+    }
+
+    memset(hash_table, 0, sizeof(hash_table_t));
+    allocate_slots(hash_table, power_of_two);
+    init_arena(&hash_table->arena, ARENA_BLOCK_SIZE);
+    init_linked_list(&hash_table->list, &hash_table->arena);
+    hash_table->schema = schema;
+    hash_table->ops = &key_schema_ops[schema];
+    hash_table->packet_weight = INITIAL_VALUE;
 
     return;
 }
 
-/* Convert an IP address to uint32 */
-static inline uint32_t ip_to_uint32(const uint8_t ip[IP_SECTION_SIZE])
+/* Track the given STATS_* columns for every flow of a private table */
+void enable_flow_stats(hash_table_t *hash_table, uint32_t columns)
 {
-    return ((uint32_t)ip[0] << 24) |
-           ((uint32_t)ip[1] << 16) |
-           ((uint32_t)ip[2] << 8)  |
-           ((uint32_t)ip[3]);
+    free_flow_stats(&hash_table->stats);
+    init_flow_stats(&hash_table->stats, columns);
+
+    return;
+}
+
+/* Note which insert created every flow of a private table, for merge_hash_table */
+void enable_first_inserts(hash_table_t *hash_table)
+{
+    hash_table->first_inserts_capacity = LIST_INITIAL_CAPACITY;
+    hash_table->first_inserts = (uint64_t *)malloc(hash_table->first_inserts_capacity * sizeof(uint64_t));
+
+    if (hash_table->first_inserts == NULL)
+    {
+        perror("Memory allocation failed for first inserts");
+        exit(EXIT_FAILURE);
+    }
+
+    return;
 }
 
-/* Calculate the hash for a given IP pair */
-static inline uint32_t ip_pair_hash(const key_ip_pair_t *ip_pair, uint32_t *table_size)
+static void note_first_insert(hash_table_t *hash_table, uint32_t flow_id)
 {
-    uint32_t src_ip = 0;
-    uint32_t dest_ip = 0;
+    uint64_t *resized = NULL;
 
-    src_ip = ip_to_uint32(ip_pair->source_ip);
-    dest_ip = ip_to_uint32(ip_pair->destination_ip);
-    jhash(&src_ip, &dest_ip);
+    if (flow_id >= hash_table->first_inserts_capacity)
+    {
+        hash_table->first_inserts_capacity *= LIST_MULTIPLIER;
+        resized = (uint64_t *)realloc(hash_table->first_inserts, hash_table->first_inserts_capacity * sizeof(uint64_t));
+
+        if (resized == NULL)
+        {
+            perror("Memory allocation failed for first inserts");
+            exit(EXIT_FAILURE);
+        }
 
-    return dest_ip % (*table_size);
+        hash_table->first_inserts = resized;
+    }
+
+    /* grow_step has already counted the insert that is creating the flow */
+    hash_table->first_inserts[flow_id] = hash_table->num_inserts - 1;
+
+    return;
 }
 
-static void rehash(hash_table_entry_t ***hash_table, uint32_t *table_size)
+/* Drop packets of unsampled IP pairs early and weight the kept ones for the schema */
+void enable_sampling(hash_table_t *hash_table, const sampler_t *sampler)
 {
-    uint32_t new_table_size = 0;
-    hash_table_entry_t **new_table = NULL;
-    hash_table_entry_t *entry = NULL;
-    data_list_node_t *node = NULL;
+    hash_table->sampler = sampler;
+    hash_table->packet_weight = sampled_packet_weight(sampler, hash_table->schema);
+
+    return;
+}
+
+/* The packets counted so far, weights included */
+uint64_t hash_table_packet_count(const hash_table_t *hash_table)
+{
+    uint64_t packet_count = 0;
+    uint32_t flow_id = 0;
+
+    if (hash_table->approximate != NULL)
+    {
+        return hash_table->approximate->total;
+    }
+
+    for (flow_id = 0; flow_id < hash_table->list.count; flow_id++)
+    {
+        packet_count += list_node(&hash_table->list, flow_id)->ref_count;
+    }
+
+    return packet_count;
+}
+
+/* A handle through which several threads insert into one concurrent table */
+void init_shared_hash_table(hash_table_t *hash_table, concurrent_table_t *shared, key_schema_t schema)
+{
+    memset(hash_table, 0, sizeof(hash_table_t));
+    hash_table->shared = shared;
+    hash_table->schema = schema;
+    hash_table->ops = &key_schema_ops[schema];
+    hash_table->packet_weight = INITIAL_VALUE;
+
+    return;
+}
+
+/* A handle that counts into a heavy hitter set instead of exact flows */
+void init_approximate_hash_table(hash_table_t *hash_table, heavy_hitters_t *approximate, key_schema_t schema)
+{
+    memset(hash_table, 0, sizeof(hash_table_t));
+    hash_table->approximate = approximate;
+    hash_table->schema = schema;
+    hash_table->ops = &key_schema_ops[schema];
+    hash_table->packet_weight = INITIAL_VALUE;
+
+    return;
+}
+
+static inline uint64_t monotonic_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * NANOSECONDS_PER_SECOND + (uint64_t)now.tv_nsec;
+}
+
+/* Keep the full slot array as the old generation and switch inserts to one twice as big */
+static void start_rehash(hash_table_t *hash_table)
+{
+    /* Growth outpaced migration, which REHASH_STEP makes very unlikely: drain it first */
+    if (hash_table->old_control != NULL)
+    {
+        complete_rehash(hash_table);
+    }
+
+    hash_table->old_control = hash_table->control;
+    hash_table->old_slots = hash_table->slots;
+    hash_table->old_table_size = hash_table->table_size;
+    hash_table->migrate_index = 0;
+    hash_table->num_rehashes++;
+
+    allocate_slots(hash_table, hash_table->old_table_size * NEXT_MULTIPLIER);
+
+    return;
+}
+
+/* Arrays a loaded table started with belong to the snapshot mapping, not to the heap */
+static inline bool_t is_snapshot_memory(const hash_table_t *hash_table, const void *memory)
+{
+    uintptr_t address = (uintptr_t)memory;
+    uintptr_t start = (uintptr_t)hash_table->snapshot.data;
+
+    return memory != NULL && address >= start && address < start + hash_table->snapshot.size;
+}
+
+/* Move up to budget old slots into the current array, freeing the old one when drained */
+static void migrate_slots(hash_table_t *hash_table, uint32_t budget)
+{
+    uint32_t mask = hash_table->table_size - 1;
     uint32_t hash = 0;
+    uint32_t index = 0;
     uint32_t i = 0;
 
-    new_table_size = next_prime(*table_size * NEXT_MULTIPLIER);
-    new_table = (hash_table_entry_t **)calloc(new_table_size, sizeof(hash_table_entry_t *));
+    /* Old slots are never cleared, so probes through the old array stay intact;
+     * everything below migrate_index simply also exists in the new array */
+    for (i = hash_table->migrate_index; i < hash_table->old_table_size && budget > 0; i++, budget--)
+    {
+        if (hash_table->old_control[i] == CONTROL_EMPTY)
+        {
+            continue;
+        }
+
+        /* Keys are unique, so every old slot goes to the first free slot of its probe sequence */
+        hash = hash_table->ops->hash(&hash_table->old_slots[i].key);
+        index = hash & mask;
+
+        while (hash_table->control[index] != CONTROL_EMPTY)
+        {
+            index = (index + 1) & mask;
+        }
+
+        hash_table->control[index] = hash_table->old_control[i];
+        hash_table->slots[index] = hash_table->old_slots[i];
+    }
 
-    if (new_table == NULL)
+    hash_table->migrate_index = i;
+
+    if (hash_table->migrate_index == hash_table->old_table_size)
     {
-        perror("Memory allocation failed during rehashing");
-        exit(EXIT_FAILURE);
+        if (!is_snapshot_memory(hash_table, hash_table->old_control))
+        {
+            free(hash_table->old_control);
+            free(hash_table->old_slots);
+        }
+
+        hash_table->old_control = NULL;
+        hash_table->old_slots = NULL;
+        hash_table->old_table_size = 0;
+        hash_table->migrate_index = 0;
     }
 
-    /* Rehash all existing entries into the new table */
-    for (i = 0; i < (*table_size); i++)
+    return;
+}
+
+/* Finish any growth in progress, needed before walking the slot array */
+void complete_rehash(hash_table_t *hash_table)
+{
+    while (hash_table->old_control != NULL)
     {
-        entry = (*hash_table)[i];
+        migrate_slots(hash_table, hash_table->old_table_size);
+    }
+
+    return;
+}
 
-        while (entry != NULL)
+uint32_t hash_flow_key(const flow_key_t *key, const hash_table_t *hash_table)
+{
+    return hash_table->ops->hash(key);
+}
+
+/* Insert a flow key into the hash table, returning its flow id */
+uint32_t insert_into_hash_table(const flow_key_t *key, hash_table_t *hash_table)
+{
+    return add_to_hash_table(key, hash_table->packet_weight, hash_table);
+}
+
+/* Bring the insert count up to num_inserts as if that many packets of known
+ * flows had been counted: they change no count, only the growth they drive */
+static void replay_inserts(hash_table_t *hash_table, uint64_t num_inserts)
+{
+    while (hash_table->num_inserts < num_inserts)
+    {
+        /* Until the table has to grow again the skipped inserts do nothing */
+        if (is_growth_idle(hash_table))
         {
-            node = entry->node;
+            hash_table->num_inserts = num_inserts;
+            break;
+        }
 
-            /* Recalculate the hash for the new table size */
-            hash = ip_pair_hash(node->ip_pair, &new_table_size);
+        grow_step(hash_table);
+    }
 
-            /* Insert the entry into the new table */
-            hash_table_entry_t *temp = (hash_table_entry_t *)calloc(1, sizeof(hash_table_entry_t));
+    return;
+}
 
-            if (temp == NULL)
-            {
-                perror("Memory allocation failed for new hash table entry");
-                exit(EXIT_FAILURE);
-            }
+/* Fold every flow of source into target, in source's first-seen order. When
+ * source kept first_inserts and sources are merged in the order their
+ * packets came, each flow is added at the insert where one table counting
+ * every packet would have met it first, so target grows exactly as that
+ * table would and ends up with the same slot layout. */
+void merge_hash_table(hash_table_t *target, const hash_table_t *source)
+{
+    const data_list_node_t *node = NULL;
+    uint64_t base = target->num_inserts;
+    uint32_t flow_id = 0;
+    uint32_t target_id = 0;
 
-            temp->node = node;
-            temp->next = new_table[hash];
-            new_table[hash] = temp;
+    for (flow_id = 0; flow_id < source->list.count; flow_id++)
+    {
+        node = list_node(&source->list, flow_id);
 
-            entry = entry->next;
+        if (source->first_inserts != NULL)
+        {
+            replay_inserts(target, base + source->first_inserts[flow_id]);
         }
-    }
 
-    /* Free the old table */
-    free_hash_table(*hash_table, *table_size);
-    free(*hash_table);
-    *hash_table = NULL;
+        target_id = add_to_hash_table(&node->key, node->ref_count, target);
 
-    /* Update the hash table and size to the new values */
-    *hash_table = new_table;
-    *table_size = new_table_size;
+        if (target->stats.enabled != 0 && target_id != FLOW_ID_NONE)
+        {
+            merge_flow_stats(&target->stats, target_id, &source->stats, flow_id);
+        }
+    }
+
+    /* The packets after the last new flow still move growth along */
+    if (source->first_inserts != NULL)
+    {
+        replay_inserts(target, base + source->num_inserts);
+    }
 
     return;
 }
 
-/* Insert an IP pair into the hash table */
-void insert_into_hash_table(key_ip_pair_t *ip_pair, hash_table_entry_t ***hash_table, uint32_t *table_size)
+/* No migration under way and room for one more flow */
+static inline bool_t is_growth_idle(const hash_table_t *hash_table)
 {
-    uint32_t hash = 0;
-    hash_table_entry_t *entry = NULL;
-    data_list_node_t *current = NULL;
-    data_list_node_t *new_node = NULL;
-    hash_table_entry_t *new_entry = NULL;
-    static uint32_t num_elements = 0;
+    return hash_table->old_control == NULL &&
+           (uint64_t)(hash_table->num_elements + 1) * MAX_LOAD_DENOMINATOR <=
+           (uint64_t)hash_table->table_size * MAX_LOAD_NUMERATOR;
+}
 
-    if (ip_pair == NULL || *hash_table == NULL)
+/* Count the insert, then grow or migrate when needed; only inserts that do growth work are timed */
+static inline void grow_step(hash_table_t *hash_table)
+{
+    uint64_t pause_start = 0;
+    uint64_t pause = 0;
+
+    hash_table->num_inserts++;
+
+    if (is_growth_idle(hash_table))
     {
         return;
     }
 
-    /* Check load factor to determine if rehashing is necessary */
-    if (num_elements >= (MAX_LOAD_FACTOR * (*table_size)))
+    pause_start = monotonic_ns();
+
+    if ((uint64_t)(hash_table->num_elements + 1) * MAX_LOAD_DENOMINATOR >
+        (uint64_t)hash_table->table_size * MAX_LOAD_NUMERATOR)
     {
-        rehash(hash_table, table_size);
+        start_rehash(hash_table);
     }
 
-    /* Calculate the hash index for the given IP pair using the table size.*/
-    hash = ip_pair_hash(ip_pair, table_size);
-    entry = (*hash_table)[hash];
+    migrate_slots(hash_table, REHASH_STEP);
+    pause = monotonic_ns() - pause_start;
 
-    while (entry != NULL)
+    if (pause > hash_table->max_insert_pause_ns)
     {
-        current = entry->node;
+        hash_table->max_insert_pause_ns = pause;
+    }
+
+    return;
+}
+
+/* Count a key whose hash is already known and return its flow id. Always inlined
+ * into the per-schema variants below, so is_same_key is a direct, inlined comparison there. */
+static ALWAYS_INLINE uint32_t add_hashed_to_hash_table(const flow_key_t *key, uint32_t hash, uint32_t count,
+                                                       hash_table_t *hash_table, flow_key_equal_fn is_same_key)
+{
+    uint32_t index = 0;
+    uint32_t mask = 0;
+    uint32_t old_index = 0;
+    uint32_t old_mask = 0;
+    uint8_t tag = 0;
+
+    tag = control_tag(hash);
+    mask = hash_table->table_size - 1;
+    index = hash & mask;
 
-        if (memcmp(current->ip_pair->source_ip, ip_pair->source_ip, IP_SECTION_SIZE) == 0 &&
-            memcmp(current->ip_pair->destination_ip, ip_pair->destination_ip, IP_SECTION_SIZE) == 0)
+    /* Linear probe, the control byte filters out almost every non-matching slot */
+    while (hash_table->control[index] != CONTROL_EMPTY)
+    {
+        if (hash_table->control[index] == tag && is_same_key(&hash_table->slots[index].key, key))
         {
-            current->ref_count++;
+            slot_node(hash_table, hash_table->slots[index].flow_id)->ref_count += count;
 
-            /*Exit the function as the IP pair is already in the table.*/
-            return;
+            /*Exit the function as the key is already in the table.*/
+            return hash_table->slots[index].flow_id;
         }
 
-        entry = entry->next;
+        index = (index + 1) & mask;
     }
 
-    /* Create a new node for the IP pair and insert it into the linked list. */
-    insert_into_linked_list(&new_node, ip_pair);
-    new_entry = (hash_table_entry_t *)calloc(STRUCT_MULTIPLIER, sizeof(hash_table_entry_t));
-
-    if (new_entry == NULL)
+    /* A key that has not been migrated yet is still only in the old array */
+    if (hash_table->old_control != NULL)
     {
-        perror("Memory allocation failed for hash table entry");
-        exit(EXIT_FAILURE);
+        old_mask = hash_table->old_table_size - 1;
+        old_index = hash & old_mask;
+
+        while (hash_table->old_control[old_index] != CONTROL_EMPTY)
+        {
+            if (hash_table->old_control[old_index] == tag &&
+                is_same_key(&hash_table->old_slots[old_index].key, key))
+            {
+                slot_node(hash_table, hash_table->old_slots[old_index].flow_id)->ref_count += count;
+
+                return hash_table->old_slots[old_index].flow_id;
+            }
+
+            old_index = (old_index + 1) & old_mask;
+        }
     }
 
-    /*Set the new node (holding the IP pair) into the new hash table entry.*/
-    new_entry->node = new_node;
+    /* New key: append it to the first-seen list and claim the empty slot */
+    hash_table->control[index] = tag;
+    hash_table->slots[index].key = *key;
+    hash_table->slots[index].flow_id = insert_into_linked_list(&hash_table->list, key);
+    list_node(&hash_table->list, hash_table->slots[index].flow_id)->ref_count = count;
 
-    /*Link the new entry at the head of the list for this hash index.*/
-    new_entry->next = (*hash_table)[hash];
+    if (hash_table->host_index != NULL)
+    {
+        index_flow_hosts(hash_table->host_index, key, hash_table->slots[index].flow_id);
+    }
 
-    /*Set the new entry as the first one in the list.*/
-    (*hash_table)[hash] = new_entry;
+    if (hash_table->first_inserts != NULL)
+    {
+        note_first_insert(hash_table, hash_table->slots[index].flow_id);
+    }
 
     /* Increment the count of elements in the hash table */
-    num_elements++;
+    hash_table->num_elements++;
 
-    return;
+    return hash_table->slots[index].flow_id;
 }
 
-/* Print the hash table with index information */
-void print_hash_table(hash_table_entry_t **hash_table, uint32_t table_size)
+/* Prefetch the home slots of the whole batch, then the counters of the likely
+ * hits, and only then resolve the keys in order, so the cache misses of a
+ * batch overlap instead of stalling one by one */
+static ALWAYS_INLINE void insert_hashed_batch(const flow_key_t *keys, const uint32_t *hashes, const flow_sample_t *samples,
+                                              uint32_t count, hash_table_t *hash_table, flow_key_equal_fn is_same_key)
 {
-    hash_table_entry_t *entry = NULL;
-    data_list_node_t *node = NULL;
+    uint32_t flow_id = 0;
+    uint32_t batch_count = 0;
+    uint32_t mask = 0;
+    uint32_t index = 0;
     uint32_t iteration = 0;
 
-    puts("+--------------------------------------------------------------+");
-    puts("|                       Hash Table                             |");
-    puts("+-------+-------------------+-------------------+--------------+");
-    puts("| Index |     Source IP     |   Destination IP  | Packet Count |");
-    puts("+-------+-------------------+-------------------+--------------+");
-
-    for (iteration = 0; iteration < table_size; iteration++)
+    for (; count > 0; keys += batch_count, hashes += batch_count, count -= batch_count)
     {
-        entry = hash_table[iteration];
+        batch_count = (count < HASH_BATCH_SIZE) ? count : HASH_BATCH_SIZE;
+        mask = hash_table->table_size - 1;
 
-        if (entry == NULL)
+        for (iteration = 0; iteration < batch_count; iteration++)
         {
-            continue;
+            PREFETCH(&hash_table->control[hashes[iteration] & mask]);
+            PREFETCH(&hash_table->slots[hashes[iteration] & mask]);
         }
 
-        while (entry != NULL)
+        for (iteration = 0; iteration < batch_count; iteration++)
         {
-            node = entry->node;
-            printf("| %5u |  %3hhu.%3hhu.%3hhu.%3hhu  |  %3hhu.%3hhu.%3hhu.%3hhu  | %12u |\n",
-                   iteration,
-                   node->ip_pair->source_ip[0], node->ip_pair->source_ip[1],
-                   node->ip_pair->source_ip[2], node->ip_pair->source_ip[3],
-                   node->ip_pair->destination_ip[0], node->ip_pair->destination_ip[1],
-                   node->ip_pair->destination_ip[2], node->ip_pair->destination_ip[3],
-                   node->ref_count);
-            puts("+-------+-------------------+-------------------+--------------+");
-
-            entry = entry->next;
+            index = hashes[iteration] & mask;
+
+            if (hash_table->control[index] == control_tag(hashes[iteration]) &&
+                is_same_key(&hash_table->slots[index].key, &keys[iteration]) &&
+                hash_table->slots[index].flow_id < hash_table->list.count)
+            {
+                PREFETCH(list_node(&hash_table->list, hash_table->slots[index].flow_id));
+            }
         }
+
+        /* Growth may change the mask mid-batch, the prefetches are only hints */
+        for (iteration = 0; iteration < batch_count; iteration++)
+        {
+            grow_step(hash_table);
+            flow_id = add_hashed_to_hash_table(&keys[iteration], hashes[iteration], hash_table->packet_weight,
+                                               hash_table, is_same_key);
+
+            if (samples != NULL)
+            {
+                record_flow_sample(&hash_table->stats, flow_id, &samples[iteration]);
+            }
+        }
+
+        samples = (samples != NULL) ? samples + batch_count : NULL;
     }
 
     return;
 }
 
-/* Free the hash table */
-void free_hash_table(hash_table_entry_t **hash_table, uint32_t table_size)
+/* One copy of the hashing and insert paths per key schema */
+#define DEFINE_KEY_SCHEMA(schema, name)                                                                   \
+    static void hash_keys_##name(const flow_key_t *keys, uint32_t *hashes, uint32_t count)                 \
+    {                                                                                                     \
+        uint32_t iteration = 0;                                                                           \
+                                                                                                          \
+        for (iteration = 0; iteration < count; iteration++)                                               \
+        {                                                                                                 \
+            hashes[iteration] = flow_key_hash_##name(&keys[iteration]);                                   \
+        }                                                                                                 \
+    }                                                                                                     \
+                                                                                                          \
+    static uint32_t add_hashed_##name(const flow_key_t *key, uint32_t hash, uint32_t count,               \
+                                      hash_table_t *hash_table)                                           \
+    {                                                                                                     \
+        return add_hashed_to_hash_table(key, hash, count, hash_table, is_same_flow_key_##name);           \
+    }                                                                                                     \
+                                                                                                          \
+    static void insert_hashed_batch_##name(const flow_key_t *keys, const uint32_t *hashes,                \
+                                           const flow_sample_t *samples, uint32_t count,                  \
+                                           hash_table_t *hash_table)                                      \
+    {                                                                                                     \
+        insert_hashed_batch(keys, hashes, samples, count, hash_table, is_same_flow_key_##name);           \
+    }
+
+FOR_EACH_KEY_SCHEMA(DEFINE_KEY_SCHEMA)
+
+#define KEY_SCHEMA_OPS(schema, name) \
+    [schema] = {flow_key_hash_##name, hash_keys_##name, add_hashed_##name, insert_hashed_batch_##name},
+
+static const key_schema_ops_t key_schema_ops[NUM_KEY_SCHEMAS] =
+{
+    FOR_EACH_KEY_SCHEMA(KEY_SCHEMA_OPS)
+};
+
+/* Count a key count times, adding it to the first-seen list if it is new.
+ * Returns the flow id, or FLOW_ID_NONE when the table has no flows of its own. */
+uint32_t add_to_hash_table(const flow_key_t *key, uint32_t count, hash_table_t *hash_table)
+{
+    if (key == NULL || hash_table == NULL)
+    {
+        return FLOW_ID_NONE;
+    }
+
+    /* A handle has no slots of its own, the shared table does the work */
+    if (hash_table->shared != NULL)
+    {
+        insert_into_concurrent_table(key, count, hash_table->shared);
+
+        return FLOW_ID_NONE;
+    }
+
+    if (hash_table->approximate != NULL)
+    {
+        add_to_heavy_hitters(hash_table->approximate, key, count);
+
+        return FLOW_ID_NONE;
+    }
+
+    if (hash_table->control == NULL)
+    {
+        return FLOW_ID_NONE;
+    }
+
+    grow_step(hash_table);
+
+    return hash_table->ops->add_hashed(key, hash_table->ops->hash(key), count, hash_table);
+}
+
+/* Insert many keys at once, hashing them first; samples may be NULL */
+void insert_batch_into_hash_table(const flow_key_t *keys, const flow_sample_t *samples, uint32_t count, hash_table_t *hash_table)
+{
+    uint32_t hashes[HASH_BATCH_SIZE] = {0};
+    uint32_t batch_count = 0;
+
+    if (keys == NULL || hash_table == NULL)
+    {
+        return;
+    }
+
+    for (; count > 0; keys += batch_count, count -= batch_count)
+    {
+        batch_count = (count < HASH_BATCH_SIZE) ? count : HASH_BATCH_SIZE;
+        hash_table->ops->hash_keys(keys, hashes, batch_count);
+        insert_hashed_batch_into_hash_table(keys, hashes, samples, batch_count, hash_table);
+        samples = (samples != NULL) ? samples + batch_count : NULL;
+    }
+
+    return;
+}
+
+/* Insert keys whose hash_flow_key() values are already known. samples, one per
+ * key, feed the flow statistics and may be NULL when none are tracked */
+void insert_hashed_batch_into_hash_table(const flow_key_t *keys, const uint32_t *hashes, const flow_sample_t *samples,
+                                         uint32_t count, hash_table_t *hash_table)
 {
     uint32_t iteration = 0;
-    hash_table_entry_t *entry = NULL;
-    hash_table_entry_t *temp = NULL;
 
-    for (iteration = 0; iteration < table_size; iteration++)
+    if (keys == NULL || hashes == NULL || hash_table == NULL)
     {
-        entry = hash_table[iteration];
+        return;
+    }
 
-        while (entry != NULL)
+    if (hash_table->shared != NULL || hash_table->control == NULL)
+    {
+        for (iteration = 0; iteration < count; iteration++)
         {
-            temp = entry;
-            entry = entry->next;
-            free(temp);
-            temp = NULL;
+            add_to_hash_table(&keys[iteration], hash_table->packet_weight, hash_table);
         }
+
+        return;
     }
 
+    samples = (hash_table->stats.enabled != 0) ? samples : NULL;
+    hash_table->ops->insert_hashed_batch(keys, hashes, samples, count, hash_table);
+
     return;
 }
 
-/* Prime number utilities */
-static bool_t is_prime(uint32_t value)
+/* Queue a key, inserting the whole batch once it is full */
+void add_to_key_batch(key_batch_t *batch, const flow_key_t *key, const flow_sample_t *sample, hash_table_t *hash_table)
+{
+    batch->keys[batch->count] = *key;
+    batch->samples[batch->count++] = *sample;
+
+    if (batch->count == HASH_BATCH_SIZE)
+    {
+        flush_key_batch(batch, hash_table);
+    }
+
+    return;
+}
+
+/* Insert whatever is still queued */
+void flush_key_batch(key_batch_t *batch, hash_table_t *hash_table)
+{
+    insert_batch_into_hash_table(batch->keys, batch->samples, batch->count, hash_table);
+    batch->count = 0;
+
+    return;
+}
+
+/* Digits of the last slot index, at least as many as the Index heading takes */
+static uint32_t index_digits(uint32_t table_size)
+{
+    uint32_t last = (table_size > 0) ? table_size - 1 : 0;
+    uint32_t digits = 1;
+
+    while (last >= 10)
+    {
+        last /= 10;
+        digits++;
+    }
+
+    return (digits > HASH_INDEX_DIGITS) ? digits : HASH_INDEX_DIGITS;
+}
+
+static void print_hash_rule(uint32_t digits, key_schema_t schema)
 {
     uint32_t iteration = 0;
 
-    if (value <= 1)
+    putchar('+');
+
+    for (iteration = 0; iteration < digits + 2; iteration++)
+    {
+        putchar('-');
+    }
+
+    print_key_rule(schema);
+    puts("+--------------+");
+
+    return;
+}
+
+/* Print the hash table with index information, the Index column as wide as the biggest slot index */
+void print_hash_table(const hash_table_t *hash_table)
+{
+    const data_list_node_t *node = NULL;
+    uint32_t digits = index_digits(hash_table->table_size);
+    uint32_t width = digits + 3 + key_columns_width(hash_table->schema) + COUNT_COLUMN_WIDTH;
+    uint32_t iteration = 0;
+
+    print_table_rule(width);
+    print_table_title("Hash Table", key_title_pad(HASH_TITLE_PAD, hash_table->schema) + (digits - HASH_INDEX_DIGITS) / 2,
+                      width);
+    print_hash_rule(digits, hash_table->schema);
+    printf("| %*s ", (int)digits, "Index");
+    print_key_heading(hash_table->schema);
+    puts("| Packet Count |");
+    print_hash_rule(digits, hash_table->schema);
+
+    for (iteration = 0; iteration < hash_table->table_size; iteration++)
+    {
+        if (hash_table->control[iteration] == CONTROL_EMPTY)
+        {
+            continue;
+        }
+
+        node = slot_node(hash_table, hash_table->slots[iteration].flow_id);
+        printf("| %*u ", (int)digits, iteration);
+        print_key_cells(&node->key, hash_table->schema);
+        printf("| %12u |\n", node->ref_count);
+        print_hash_rule(digits, hash_table->schema);
+    }
+
+    return;
+}
+
+/* Growth figures, the worst pause shows whether incremental rehashing keeps inserts flat */
+void print_hash_table_stats(const hash_table_t *hash_table)
+{
+    fprintf(stderr, "Flows: %u, Slots: %u, Rehashes: %u, Worst insert pause: %llu ns, Arena: %zu bytes\n",
+            hash_table->num_elements, hash_table->table_size, hash_table->num_rehashes,
+            (unsigned long long)hash_table->max_insert_pause_ns, hash_table->arena.total_bytes);
+
+    return;
+}
+
+/* 64 bit FNV-1a over 8 byte words, folded so the high bits reach the low ones */
+static uint64_t snapshot_checksum(const void *data, size_t len, uint64_t checksum)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+    uint64_t word = 0;
+
+    while (len >= sizeof(uint64_t))
+    {
+        memcpy(&word, bytes, sizeof(uint64_t));
+        checksum = (checksum ^ word) * SNAPSHOT_CHECKSUM_PRIME;
+        checksum ^= checksum >> 32;
+        bytes += sizeof(uint64_t);
+        len -= sizeof(uint64_t);
+    }
+
+    while (len > 0)
+    {
+        checksum = (checksum ^ *bytes++) * SNAPSHOT_CHECKSUM_PRIME;
+        len--;
+    }
+
+    return checksum;
+}
+
+/* Where every section of a snapshot of table_size slots and num_flows flows goes */
+static void layout_snapshot(snapshot_header_t *header, uint32_t table_size, uint32_t num_flows)
+{
+    uint64_t num_blocks = ((uint64_t)num_flows + LIST_BLOCK_MASK) >> LIST_BLOCK_SHIFT;
+
+    memset(header, 0, sizeof(snapshot_header_t));
+    memcpy(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic));
+    header->version = SNAPSHOT_VERSION;
+    header->byte_order = SNAPSHOT_BYTE_ORDER;
+    header->key_size = sizeof(flow_key_t);
+    header->slot_size = sizeof(hash_table_slot_t);
+    header->node_size = sizeof(data_list_node_t);
+    header->table_size = table_size;
+    header->num_flows = num_flows;
+    header->control_offset = snapshot_align(sizeof(snapshot_header_t));
+    header->slots_offset = snapshot_align(header->control_offset + table_size);
+    header->nodes_offset = snapshot_align(header->slots_offset + (uint64_t)table_size * sizeof(hash_table_slot_t));
+    header->file_size = header->nodes_offset + num_blocks * LIST_BLOCK_NODES * sizeof(data_list_node_t);
+
+    return;
+}
+
+static bool_t write_zeros(FILE *file, uint64_t len)
+{
+    static const uint8_t zeros[SNAPSHOT_ALIGNMENT] = {0};
+    size_t chunk = 0;
+
+    while (len > 0)
+    {
+        chunk = (len < sizeof(zeros)) ? (size_t)len : sizeof(zeros);
+
+        if (fwrite(zeros, 1, chunk, file) != chunk)
+        {
+            return false;
+        }
+
+        len -= chunk;
+    }
+
+    return true;
+}
+
+/* Write every section after the header, returns the payload checksum through checksum */
+static bool_t write_snapshot_payload(FILE *file, const hash_table_t *hash_table, const snapshot_header_t *header,
+                                     uint64_t *checksum)
+{
+    hash_table_slot_t slots[SNAPSHOT_WRITE_SLOTS];
+    const data_list_node_t *nodes = NULL;
+    uint64_t position = header->control_offset;
+    uint32_t first = 0;
+    uint32_t count = 0;
+    uint32_t slot = 0;
+    uint32_t block = 0;
+
+    *checksum = SNAPSHOT_CHECKSUM_SEED;
+
+    if (fwrite(hash_table->control, 1, hash_table->table_size, file) != hash_table->table_size)
     {
         return false;
     }
 
-    if (value <= 3)
+    *checksum = snapshot_checksum(hash_table->control, hash_table->table_size, *checksum);
+    position += hash_table->table_size;
+
+    if (!write_zeros(file, header->slots_offset - position))
+    {
+        return false;
+    }
+
+    /* Empty slots were never written in memory, they go out as zeros */
+    for (first = 0; first < hash_table->table_size; first += count)
     {
-        return true;
+        count = hash_table->table_size - first;
+        count = (count < SNAPSHOT_WRITE_SLOTS) ? count : SNAPSHOT_WRITE_SLOTS;
+
+        for (slot = 0; slot < count; slot++)
+        {
+            if (hash_table->control[first + slot] == CONTROL_EMPTY)
+            {
+                memset(&slots[slot], 0, sizeof(hash_table_slot_t));
+            }
+            else
+            {
+                slots[slot] = hash_table->slots[first + slot];
+            }
+        }
+
+        if (fwrite(slots, sizeof(hash_table_slot_t), count, file) != count)
+        {
+            return false;
+        }
+
+        *checksum = snapshot_checksum(slots, count * sizeof(hash_table_slot_t), *checksum);
     }
 
-    if (value % 2 == 0 || value % 3 == 0)
+    position = header->slots_offset + (uint64_t)hash_table->table_size * sizeof(hash_table_slot_t);
+
+    if (!write_zeros(file, header->nodes_offset - position))
     {
         return false;
     }
 
-    for (iteration = 5; iteration * iteration <= value; iteration += 6)
+    for (block = 0; block < hash_table->list.num_blocks; block++)
     {
-        if (value % iteration == 0 || value % (iteration + 2) == 0)
+        nodes = hash_table->list.blocks[block];
+        count = hash_table->list.count - (block << LIST_BLOCK_SHIFT);
+        count = (count < LIST_BLOCK_NODES) ? count : LIST_BLOCK_NODES;
+
+        if (fwrite(nodes, sizeof(data_list_node_t), count, file) != count ||
+            !write_zeros(file, (uint64_t)(LIST_BLOCK_NODES - count) * sizeof(data_list_node_t)))
         {
             return false;
         }
+
+        *checksum = snapshot_checksum(nodes, count * sizeof(data_list_node_t), *checksum);
+    }
+
+    return true;
+}
+
+/* Save the table as a snapshot load_hash_table can map back. It is written
+ * to file_name.tmp and renamed over file_name, so a reader never sees half
+ * a snapshot. False, with a message, on any I/O error. */
+bool_t save_hash_table(hash_table_t *hash_table, const char *file_name, uint64_t source_offset)
+{
+    snapshot_header_t header;
+    char *temporary_name = NULL;
+    FILE *file = NULL;
+    bool_t is_written = false;
+
+    complete_rehash(hash_table);
+    layout_snapshot(&header, hash_table->table_size, hash_table->list.count);
+    header.schema = (uint32_t)hash_table->schema;
+    header.num_rehashes = hash_table->num_rehashes;
+    header.source_offset = source_offset;
+
+    temporary_name = (char *)malloc(strlen(file_name) + sizeof(".tmp"));
+
+    if (temporary_name == NULL)
+    {
+        perror("Memory allocation failed for snapshot name");
+        exit(EXIT_FAILURE);
+    }
+
+    strcpy(temporary_name, file_name);
+    strcat(temporary_name, ".tmp");
+    file = fopen(temporary_name, "wb");
+
+    if (file == NULL)
+    {
+        fprintf(stderr, "Error opening file: %s\n", temporary_name);
+        free(temporary_name);
+
+        return false;
+    }
+
+    /* The header goes first with its checksums still zero and is rewritten at the end */
+    is_written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                 write_zeros(file, header.control_offset - sizeof(header)) &&
+                 write_snapshot_payload(file, hash_table, &header, &header.payload_checksum);
+
+    header.header_checksum = snapshot_checksum(&header, offsetof(snapshot_header_t, header_checksum),
+                                               SNAPSHOT_CHECKSUM_SEED);
+    is_written = is_written && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+    is_written = (fclose(file) == 0) && is_written;
+    is_written = is_written && rename(temporary_name, file_name) == 0;
+
+    if (!is_written)
+    {
+        fprintf(stderr, "Error writing file: %s\n", file_name);
+        remove(temporary_name);
+    }
+
+    free(temporary_name);
+
+    return is_written;
+}
+
+/* What is wrong with a snapshot's header, NULL when it can be used */
+static const char *check_snapshot_header(const mapped_file_t *snapshot)
+{
+    const snapshot_header_t *header = (const snapshot_header_t *)snapshot->data;
+    snapshot_header_t expected;
+
+    if (snapshot->size < sizeof(snapshot_header_t) || memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0)
+    {
+        return "not a flow table snapshot";
+    }
+
+    if (header->version != SNAPSHOT_VERSION)
+    {
+        return "snapshot version not supported by this build";
+    }
+
+    if (header->byte_order != SNAPSHOT_BYTE_ORDER)
+    {
+        return "snapshot written on a machine of the other byte order";
+    }
+
+    if (header->header_checksum !=
+        snapshot_checksum(header, offsetof(snapshot_header_t, header_checksum), SNAPSHOT_CHECKSUM_SEED))
+    {
+        return "snapshot header checksum mismatch";
+    }
+
+    if (header->key_size != sizeof(flow_key_t) || header->slot_size != sizeof(hash_table_slot_t) ||
+        header->node_size != sizeof(data_list_node_t) || header->schema >= NUM_KEY_SCHEMAS ||
+        header->table_size < TABLE_SIZE || (header->table_size & (header->table_size - 1)) != 0 ||
+        (uint64_t)header->num_flows * MAX_LOAD_DENOMINATOR > (uint64_t)header->table_size * MAX_LOAD_NUMERATOR)
+    {
+        return "snapshot layout does not match this build";
+    }
+
+    layout_snapshot(&expected, header->table_size, header->num_flows);
+
+    if (header->control_offset != expected.control_offset || header->slots_offset != expected.slots_offset ||
+        header->nodes_offset != expected.nodes_offset || header->file_size != expected.file_size ||
+        header->file_size != snapshot->size)
+    {
+        return "snapshot is truncated or damaged";
+    }
+
+    return NULL;
+}
+
+/* Recompute the payload checksum, which reads every page of the file */
+static bool_t is_snapshot_payload_intact(const mapped_file_t *snapshot)
+{
+    const snapshot_header_t *header = (const snapshot_header_t *)snapshot->data;
+    uint64_t checksum = SNAPSHOT_CHECKSUM_SEED;
+
+    checksum = snapshot_checksum(snapshot->data + header->control_offset, header->table_size, checksum);
+    checksum = snapshot_checksum(snapshot->data + header->slots_offset,
+                                 (size_t)header->table_size * sizeof(hash_table_slot_t), checksum);
+    checksum = snapshot_checksum(snapshot->data + header->nodes_offset,
+                                 (size_t)header->num_flows * sizeof(data_list_node_t), checksum);
+
+    return checksum == header->payload_checksum;
+}
+
+/* Map a snapshot saved by save_hash_table and use it as the table keyed by
+ * schema, source_offset (when not NULL) gets the offset it was saved with.
+ * Only the header is checked unless is_checked, so opening costs the same
+ * for any number of flows; is_checked also verifies the payload checksum.
+ * Unchecked slots are bounds checked as they are used, see slot_node().
+ * The mapping is private: counting on only copies the pages it touches.
+ * False, with a message, when the file cannot be used. */
+bool_t load_hash_table(hash_table_t *hash_table, const char *file_name, key_schema_t schema, bool_t is_checked,
+                       uint64_t *source_offset)
+{
+    const snapshot_header_t *header = NULL;
+    const char *problem = NULL;
+    data_list_node_t *nodes = NULL;
+    uint32_t block = 0;
+
+    memset(hash_table, 0, sizeof(hash_table_t));
+
+    if (!map_file_private(file_name, &hash_table->snapshot))
+    {
+        return false;
+    }
+
+    header = (const snapshot_header_t *)hash_table->snapshot.data;
+    problem = check_snapshot_header(&hash_table->snapshot);
+
+    if (problem == NULL && is_checked && !is_snapshot_payload_intact(&hash_table->snapshot))
+    {
+        problem = "snapshot payload checksum mismatch";
+    }
+
+    if (problem != NULL)
+    {
+        fprintf(stderr, "%s: %s\n", file_name, problem);
+        unmap_file(&hash_table->snapshot);
+
+        return false;
+    }
+
+    /* Flows are keyed when they are counted, a table cannot be read by another key */
+    if (header->schema != (uint32_t)schema)
+    {
+        fprintf(stderr, "%s: flows are keyed by %s, run with -k %s\n", file_name,
+                key_schema_name((key_schema_t)header->schema), key_schema_name((key_schema_t)header->schema));
+        unmap_file(&hash_table->snapshot);
+
+        return false;
+    }
+
+    hash_table->control = (uint8_t *)hash_table->snapshot.data + header->control_offset;
+    hash_table->slots = (hash_table_slot_t *)(hash_table->snapshot.data + header->slots_offset);
+    hash_table->table_size = header->table_size;
+    hash_table->num_elements = header->num_flows;
+    hash_table->num_rehashes = header->num_rehashes;
+    init_arena(&hash_table->arena, ARENA_BLOCK_SIZE);
+    init_linked_list(&hash_table->list, &hash_table->arena);
+    hash_table->schema = schema;
+    hash_table->ops = &key_schema_ops[schema];
+    hash_table->packet_weight = INITIAL_VALUE;
+
+    /* The list's blocks are the node section cut every LIST_BLOCK_NODES */
+    nodes = (data_list_node_t *)(hash_table->snapshot.data + header->nodes_offset);
+    hash_table->list.num_blocks = (header->num_flows + LIST_BLOCK_MASK) >> LIST_BLOCK_SHIFT;
+    hash_table->list.blocks_capacity = hash_table->list.num_blocks;
+    hash_table->list.count = header->num_flows;
+    hash_table->list.blocks = (data_list_node_t **)malloc((hash_table->list.num_blocks + 1) * sizeof(data_list_node_t *));
+
+    if (hash_table->list.blocks == NULL)
+    {
+        perror("Memory allocation failed for snapshot list");
+        exit(EXIT_FAILURE);
+    }
+
+    for (block = 0; block < hash_table->list.num_blocks; block++)
+    {
+        hash_table->list.blocks[block] = nodes + (size_t)block * LIST_BLOCK_NODES;
+    }
+
+    if (source_offset != NULL)
+    {
+        *source_offset = header->source_offset;
     }
 
     return true;
 }
 
-uint32_t next_prime(uint32_t value)
+/* Free the hash table together with its first-seen list */
+void free_hash_table(hash_table_t *hash_table)
 {
-    if (value <= 1)
+    if (!is_snapshot_memory(hash_table, hash_table->control))
     {
-        return 2;
+        free(hash_table->control);
+        free(hash_table->slots);
     }
 
-    while (!is_prime(value))
+    if (!is_snapshot_memory(hash_table, hash_table->old_control))
     {
-        value++;
+        free(hash_table->old_control);
+        free(hash_table->old_slots);
     }
 
-    return value;
+    unmap_file(&hash_table->snapshot);
+    hash_table->old_control = NULL;
+    hash_table->old_slots = NULL;
+    free_linked_list(&hash_table->list);
+    free_flow_stats(&hash_table->stats);
+    free_arena(&hash_table->arena);
+    free(hash_table->first_inserts);
+    hash_table->first_inserts = NULL;
+    hash_table->control = NULL;
+    hash_table->slots = NULL;
+    hash_table->table_size = 0;
+    hash_table->num_elements = 0;
+
+    return;
 }
@@ -2,27 +2,270 @@
 #define HASH_H_INCLUDED
 
 #include <limits.h>
+#include <string.h>
 #include "linked-list.h"
+#include "flow-stats.h"
+#include "mapped-file.h"
 
 #define ROTATE_1 4
 #define ROTATE_2 23
 #define ROTATE_3 15
 #define ROTATE_4 7
-#define TABLE_SIZE 2
+#define TABLE_SIZE 16
 #define NEXT_MULTIPLIER 2
-#define MAX_LOAD_FACTOR 0.75
+#define MAX_LOAD_NUMERATOR 3
+#define MAX_LOAD_DENOMINATOR 4
+#define CONTROL_EMPTY 0x00
+#define CONTROL_FULL 0x80
+#define CONTROL_TAG_SHIFT 25
+#define REHASH_STEP 64
+#define NANOSECONDS_PER_SECOND 1000000000ULL
+#define HASH_BATCH_SIZE 32
+#define HASH_INDEX_DIGITS 5
+#define HASH_TITLE_PAD 23
+#define SNAPSHOT_VERSION 2
+#define SNAPSHOT_NO_SOURCE_OFFSET UINT64_MAX
+#define SNAPSHOT_ALIGNMENT 64
 #define UINT_BITS (sizeof(uint32_t) * CHAR_BIT)
 #define roll32(x, n) (((x) << (n)) | ((x) >> (UINT_BITS - (n))))
 
-typedef struct hash_table_entry
+#if defined(__GNUC__)
+    #define PREFETCH(address) __builtin_prefetch(address)
+    #define ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+    #define PREFETCH(address) ((void)0)
+    #define ALWAYS_INLINE inline
+#endif
+
+typedef struct concurrent_table concurrent_table_t;
+typedef struct key_schema_ops key_schema_ops_t;
+typedef struct heavy_hitters heavy_hitters_t;
+typedef struct cardinality cardinality_t;
+typedef struct sampler sampler_t;
+typedef struct packet_filter packet_filter_t;
+typedef struct host_index host_index_t;
+
+/* Rotate and hash utility */
+static inline void jhash(uint32_t *a, uint32_t *b)
+{
+    *a ^= *b;
+    *a -= roll32(*b, ROTATE_1);
+    *b ^= *a;
+    *b -= roll32(*a, ROTATE_2);
+    *a ^= *b;
+    *a -= roll32(*b, ROTATE_3);
+    *b ^= *a;
+    *b -= roll32(*a, ROTATE_4);
+
+    return;
+}
+
+/* Convert an IP address to uint32 */
+static inline uint32_t ip_to_uint32(const uint8_t ip[IP_SECTION_SIZE])
+{
+    return ((uint32_t)ip[0] << 24) |
+           ((uint32_t)ip[1] << 16) |
+           ((uint32_t)ip[2] << 8)  |
+           ((uint32_t)ip[3]);
+}
+
+/* Convert a uint32 back to the IP address it came from */
+static inline void uint32_to_ip(uint32_t value, uint8_t ip[IP_SECTION_SIZE])
+{
+    ip[0] = (uint8_t)(value >> 24);
+    ip[1] = (uint8_t)(value >> 16);
+    ip[2] = (uint8_t)(value >> 8);
+    ip[3] = (uint8_t)value;
+
+    return;
+}
+
+/* Full 32 bit hash of a key per schema, callers mask it. Each one mixes only
+ * the fields its schema keeps; the IP pair hash is the original jhash mix. */
+static inline uint32_t flow_key_hash_source(const flow_key_t *key)
+{
+    uint32_t a = ip_to_uint32(key->source_ip);
+    uint32_t b = 0;
+
+    jhash(&a, &b);
+
+    return b;
+}
+
+static inline uint32_t flow_key_hash_destination(const flow_key_t *key)
+{
+    uint32_t a = ip_to_uint32(key->destination_ip);
+    uint32_t b = 0;
+
+    jhash(&a, &b);
+
+    return b;
+}
+
+static inline uint32_t flow_key_hash_ip_pair(const flow_key_t *key)
+{
+    uint32_t src_ip = 0;
+    uint32_t dest_ip = 0;
+
+    src_ip = ip_to_uint32(key->source_ip);
+    dest_ip = ip_to_uint32(key->destination_ip);
+    jhash(&src_ip, &dest_ip);
+
+    return dest_ip;
+}
+
+static inline uint32_t flow_key_hash_destination_port(const flow_key_t *key)
+{
+    uint32_t a = ip_to_uint32(key->destination_ip);
+    uint32_t b = key->destination_port;
+
+    jhash(&a, &b);
+
+    return b;
+}
+
+static inline uint32_t flow_key_hash_five_tuple(const flow_key_t *key)
+{
+    uint32_t a = ip_to_uint32(key->source_ip);
+    uint32_t b = ip_to_uint32(key->destination_ip);
+
+    jhash(&a, &b);
+    a ^= ((uint32_t)key->source_port << 16) | key->destination_port;
+    b ^= key->protocol;
+    jhash(&a, &b);
+
+    return b;
+}
+
+/* Key equality per schema, one load per word the schema can set */
+static inline bool_t is_same_flow_key_source(const flow_key_t *first, const flow_key_t *second)
+{
+    return flow_key_half_word(first, 0) == flow_key_half_word(second, 0);
+}
+
+static inline bool_t is_same_flow_key_destination(const flow_key_t *first, const flow_key_t *second)
+{
+    return flow_key_half_word(first, IP_SECTION_SIZE) == flow_key_half_word(second, IP_SECTION_SIZE);
+}
+
+static inline bool_t is_same_flow_key_ip_pair(const flow_key_t *first, const flow_key_t *second)
+{
+    return flow_key_word(first, 0) == flow_key_word(second, 0);
+}
+
+static inline bool_t is_same_flow_key_destination_port(const flow_key_t *first, const flow_key_t *second)
+{
+    return flow_key_word(first, IP_SECTION_SIZE) == flow_key_word(second, IP_SECTION_SIZE);
+}
+
+static inline bool_t is_same_flow_key_five_tuple(const flow_key_t *first, const flow_key_t *second)
+{
+    return flow_key_word(first, 0) == flow_key_word(second, 0) &&
+           flow_key_word(first, sizeof(uint64_t)) == flow_key_word(second, sizeof(uint64_t));
+}
+
+/* Schema independent versions, correct for any schema since unused fields are zero */
+static inline uint32_t flow_key_hash(const flow_key_t *key)
+{
+    return flow_key_hash_five_tuple(key);
+}
+
+static inline bool_t is_same_flow_key(const flow_key_t *first, const flow_key_t *second)
+{
+    return is_same_flow_key_five_tuple(first, second);
+}
+
+/* Open-addressing slot, the key is inline so a probe never leaves the slot array */
+typedef struct hash_table_slot
+{
+    flow_key_t key;
+    uint32_t flow_id;
+} hash_table_slot_t;
+
+/* Flat flow table: one control byte per slot (empty, or full + 7 hash bits)
+ * and linear probing over a power-of-two slot array. Counters live in the
+ * first-seen order list, indexed by the flow id stored in the slot. The
+ * schema picks the key fields; ops points at that schema's specialised
+ * hash and insert functions, so the probe loops never test the schema.
+ * Optional per-flow statistics sit beside the list, indexed the same way;
+ * when cardinality is set, the ingestion paths also feed every packet's IP
+ * pair to those fan-out/fan-in sketches, whatever the key schema. With a
+ * sampler, packets of unsampled IP pairs are dropped before they are decoded
+ * and every kept packet counts packet_weight times. Packets a filter rejects
+ * are dropped after their headers are read and before anything is counted.
+ * A host index, when set, is handed every new flow id as it is created.
+ * While growing, the previous slot array stays live and is drained
+ * REHASH_STEP slots per insert, lookups check both arrays. num_inserts
+ * counts the inserts so far, which is what decides when growth happens and
+ * where it leaves every slot; a table that keeps first_inserts also notes,
+ * per flow id, the insert that created the flow, so merge_hash_table can
+ * replay the same growth in the target. Per-flow
+ * memory comes from the table's arena. A table whose shared pointer is set
+ * is only a handle that forwards inserts to a concurrent table, one whose
+ * approximate pointer is set forwards them to a fixed size heavy hitter set.
+ * A table loaded from a snapshot starts out with its arrays in a private
+ * mapping of the file and keeps counting there; arrays it outgrows are left
+ * to the mapping. */
+typedef struct hash_table
+{
+    uint8_t *control;
+    hash_table_slot_t *slots;
+    uint32_t table_size;
+    uint32_t num_elements;
+    uint8_t *old_control;
+    hash_table_slot_t *old_slots;
+    uint32_t old_table_size;
+    uint32_t migrate_index;
+    uint32_t num_rehashes;
+    uint64_t max_insert_pause_ns;
+    uint64_t num_inserts;
+    uint64_t *first_inserts;
+    uint32_t first_inserts_capacity;
+    arena_t arena;
+    data_list_t list;
+    concurrent_table_t *shared;
+    heavy_hitters_t *approximate;
+    cardinality_t *cardinality;
+    const sampler_t *sampler;
+    const packet_filter_t *filter;
+    host_index_t *host_index;
+    uint32_t packet_weight;
+    key_schema_t schema;
+    const key_schema_ops_t *ops;
+    flow_stats_t stats;
+    mapped_file_t snapshot;
+} hash_table_t;
+
+/* Keys waiting to go into insert_batch_into_hash_table */
+typedef struct key_batch
 {
-    data_list_node_t *node;
-    struct hash_table_entry *next;
-} hash_table_entry_t;
+    flow_key_t keys[HASH_BATCH_SIZE];
+    flow_sample_t samples[HASH_BATCH_SIZE];
+    uint32_t count;
+} key_batch_t;
 
-void insert_into_hash_table(key_ip_pair_t *ip_pair, hash_table_entry_t ***hash_table, uint32_t *table_size);
-void print_hash_table(hash_table_entry_t **hash_table, uint32_t table_size);
-void free_hash_table(hash_table_entry_t **hash_table, uint32_t table_size);
-uint32_t next_prime(uint32_t value);
+void init_hash_table(hash_table_t *hash_table, uint32_t table_size, key_schema_t schema);
+void init_shared_hash_table(hash_table_t *hash_table, concurrent_table_t *shared, key_schema_t schema);
+void init_approximate_hash_table(hash_table_t *hash_table, heavy_hitters_t *approximate, key_schema_t schema);
+void enable_flow_stats(hash_table_t *hash_table, uint32_t columns);
+void enable_sampling(hash_table_t *hash_table, const sampler_t *sampler);
+void enable_first_inserts(hash_table_t *hash_table);
+uint64_t hash_table_packet_count(const hash_table_t *hash_table);
+uint32_t hash_flow_key(const flow_key_t *key, const hash_table_t *hash_table);
+uint32_t insert_into_hash_table(const flow_key_t *key, hash_table_t *hash_table);
+uint32_t add_to_hash_table(const flow_key_t *key, uint32_t count, hash_table_t *hash_table);
+void insert_batch_into_hash_table(const flow_key_t *keys, const flow_sample_t *samples, uint32_t count, hash_table_t *hash_table);
+void insert_hashed_batch_into_hash_table(const flow_key_t *keys, const uint32_t *hashes, const flow_sample_t *samples,
+                                         uint32_t count, hash_table_t *hash_table);
+void add_to_key_batch(key_batch_t *batch, const flow_key_t *key, const flow_sample_t *sample, hash_table_t *hash_table);
+void flush_key_batch(key_batch_t *batch, hash_table_t *hash_table);
+void merge_hash_table(hash_table_t *target, const hash_table_t *source);
+void complete_rehash(hash_table_t *hash_table);
+void print_hash_table(const hash_table_t *hash_table);
+void print_hash_table_stats(const hash_table_t *hash_table);
+bool_t save_hash_table(hash_table_t *hash_table, const char *file_name, uint64_t source_offset);
+bool_t load_hash_table(hash_table_t *hash_table, const char *file_name, key_schema_t schema, bool_t is_checked,
+                       uint64_t *source_offset);
+void free_hash_table(hash_table_t *hash_table);
 
 #endif // HASH_H_INCLUDED
\ No newline at end of file
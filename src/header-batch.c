@@ -0,0 +1,337 @@
+#include <string.h>
+#include "header-batch.h"
+#include "cardinality.h"
+#include "sampling.h"
+#include "packet-filter.h"
+#include "file-handler.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #define HAVE_X86_SIMD 1
+    #include <immintrin.h>
+#else
+    #define HAVE_X86_SIMD 0
+#endif
+
+#define ETHER_TYPE_OFFSET (2 * MAC_SECTION_SIZE)
+#define IS_VLAN(ether_type) ((uint32_t)((ether_type) == VLAN_PROTOCOL) | (uint32_t)((ether_type) == QINQ_PROTOCOL))
+
+typedef void (*jhash_lanes_fn)(const uint32_t *source_ip, const uint32_t *destination_ip, uint32_t *hash, uint32_t count);
+
+static void jhash_lanes_dispatch(const uint32_t *source_ip, const uint32_t *destination_ip, uint32_t *hash, uint32_t count);
+
+static jhash_lanes_fn jhash_lanes_impl = jhash_lanes_dispatch;
+static const char *jhash_lanes_impl_name = "scalar";
+
+void jhash_lanes_scalar(const uint32_t *source_ip, const uint32_t *destination_ip, uint32_t *hash, uint32_t count)
+{
+    uint32_t lane = 0;
+    uint32_t a = 0;
+    uint32_t b = 0;
+
+    for (lane = 0; lane < count; lane++)
+    {
+        a = source_ip[lane];
+        b = destination_ip[lane];
+        jhash(&a, &b);
+        hash[lane] = b;
+    }
+
+    return;
+}
+
+#if HAVE_X86_SIMD
+/* The shift counts are immediates, so these stay macros rather than functions */
+#define SSE2_ROLL32(x, n) _mm_or_si128(_mm_slli_epi32((x), (n)), _mm_srli_epi32((x), UINT_BITS - (n)))
+#define AVX2_ROLL32(x, n) _mm256_or_si256(_mm256_slli_epi32((x), (n)), _mm256_srli_epi32((x), UINT_BITS - (n)))
+
+/* jhash() with every step applied to four pairs at once */
+static void jhash_lanes_sse2(const uint32_t *source_ip, const uint32_t *destination_ip, uint32_t *hash, uint32_t count)
+{
+    uint32_t lane = 0;
+    __m128i a;
+    __m128i b;
+
+    for (lane = 0; lane + SSE2_HASH_LANES <= count; lane += SSE2_HASH_LANES)
+    {
+        a = _mm_loadu_si128((const __m128i *)(source_ip + lane));
+        b = _mm_loadu_si128((const __m128i *)(destination_ip + lane));
+
+        a = _mm_xor_si128(a, b);
+        a = _mm_sub_epi32(a, SSE2_ROLL32(b, ROTATE_1));
+        b = _mm_xor_si128(b, a);
+        b = _mm_sub_epi32(b, SSE2_ROLL32(a, ROTATE_2));
+        a = _mm_xor_si128(a, b);
+        a = _mm_sub_epi32(a, SSE2_ROLL32(b, ROTATE_3));
+        b = _mm_xor_si128(b, a);
+        b = _mm_sub_epi32(b, SSE2_ROLL32(a, ROTATE_4));
+
+        _mm_storeu_si128((__m128i *)(hash + lane), b);
+    }
+
+    jhash_lanes_scalar(source_ip + lane, destination_ip + lane, hash + lane, count - lane);
+
+    return;
+}
+
+/* Same as the SSE2 kernel with eight pairs per step */
+__attribute__((target("avx2")))
+static void jhash_lanes_avx2(const uint32_t *source_ip, const uint32_t *destination_ip, uint32_t *hash, uint32_t count)
+{
+    uint32_t lane = 0;
+    __m256i a;
+    __m256i b;
+
+    for (lane = 0; lane + AVX2_HASH_LANES <= count; lane += AVX2_HASH_LANES)
+    {
+        a = _mm256_loadu_si256((const __m256i *)(source_ip + lane));
+        b = _mm256_loadu_si256((const __m256i *)(destination_ip + lane));
+
+        a = _mm256_xor_si256(a, b);
+        a = _mm256_sub_epi32(a, AVX2_ROLL32(b, ROTATE_1));
+        b = _mm256_xor_si256(b, a);
+        b = _mm256_sub_epi32(b, AVX2_ROLL32(a, ROTATE_2));
+        a = _mm256_xor_si256(a, b);
+        a = _mm256_sub_epi32(a, AVX2_ROLL32(b, ROTATE_3));
+        b = _mm256_xor_si256(b, a);
+        b = _mm256_sub_epi32(b, AVX2_ROLL32(a, ROTATE_4));
+
+        _mm256_storeu_si256((__m256i *)(hash + lane), b);
+    }
+
+    /* Leave the upper halves clean before the scalar tail */
+    _mm256_zeroupper();
+    jhash_lanes_scalar(source_ip + lane, destination_ip + lane, hash + lane, count - lane);
+
+    return;
+}
+#endif
+
+/* Pick the widest kernel the CPU supports; call before starting worker threads */
+void init_jhash_lanes(void)
+{
+    jhash_lanes_impl = jhash_lanes_scalar;
+    jhash_lanes_impl_name = "scalar";
+
+#if HAVE_X86_SIMD
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+    {
+        jhash_lanes_impl = jhash_lanes_avx2;
+        jhash_lanes_impl_name = "avx2";
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+        jhash_lanes_impl = jhash_lanes_sse2;
+        jhash_lanes_impl_name = "sse2";
+    }
+#endif
+
+    return;
+}
+
+/* First call selects the kernel, later calls go straight to it */
+static void jhash_lanes_dispatch(const uint32_t *source_ip, const uint32_t *destination_ip, uint32_t *hash, uint32_t count)
+{
+    init_jhash_lanes();
+    jhash_lanes_impl(source_ip, destination_ip, hash, count);
+
+    return;
+}
+
+void jhash_lanes(const uint32_t *source_ip, const uint32_t *destination_ip, uint32_t *hash, uint32_t count)
+{
+    jhash_lanes_impl(source_ip, destination_ip, hash, count);
+
+    return;
+}
+
+const char *jhash_lanes_name(void)
+{
+    return jhash_lanes_impl_name;
+}
+
+/* Parse a frame into the next lane, inserting the batch once it is full.
+ * Without HEADER_BATCH_LANES the frame is counted straight away. */
+void add_to_header_batch(header_batch_t *batch, const uint8_t *frame, size_t frame_len, hash_table_t *hash_table)
+{
+    if (hash_table->sampler != NULL && !is_frame_sampled(hash_table->sampler, frame, frame_len))
+    {
+        return;
+    }
+
+#ifdef HEADER_BATCH_LANES
+    add_header_lane(batch, frame, frame_len);
+
+    if (batch->count == HEADER_BATCH_SIZE)
+    {
+        flush_header_batch(batch, hash_table);
+    }
+#else
+    (void)batch;
+    process_frame(frame, frame_len, hash_table);
+#endif
+
+    return;
+}
+
+/* Fill the field columns and valid_mask bit of the next lane. A frame that
+ * is not IPv4/UDP is parsed like any other and only its bit in the mask tells
+ * it apart. The checks match decode_layers() and describe_frame(). */
+void add_header_lane(header_batch_t *batch, const uint8_t *frame, size_t frame_len)
+{
+    uint8_t padded[HEADER_PEEK_SIZE];
+    const uint8_t *header = frame;
+    const uint8_t *network = NULL;
+    uint32_t lane = batch->count;
+    uint32_t num_vlan_tags = 0;
+    uint32_t network_offset = 0;
+    uint32_t ip_header_size = 0;
+    uint32_t is_valid = 0;
+
+    /* Only a short frame is copied, the fixed offsets below may reach past its end */
+    if (frame_len < HEADER_PEEK_SIZE)
+    {
+        memset(padded, 0, sizeof(padded));
+        memcpy(padded, frame, frame_len);
+        header = padded;
+    }
+
+#ifdef DEBUG
+    memcpy(batch->headers[lane], header, HEADER_PEEK_SIZE);
+#endif
+
+    batch->frame_len[lane] = (frame_len > UINT32_MAX) ? UINT32_MAX : (uint32_t)frame_len;
+    network_offset = ETHERNET_HEADER_SIZE;
+    ip_header_size = IPV4_HEADER_SIZE;
+
+    /* Tags and IP options are rare, so these branches are predicted and the
+     * loads below start at the usual offsets without waiting for the header
+     * bytes that would move them. Worked out as data, every load of a frame
+     * waited for the previous one and cache misses stopped overlapping. */
+    if (__builtin_expect(IS_VLAN(read_be16(header + ETHER_TYPE_OFFSET)), 0))
+    {
+        num_vlan_tags = 1 + IS_VLAN(read_be16(header + ETHER_TYPE_OFFSET + VLAN_TAG_SIZE));
+        network_offset += num_vlan_tags * VLAN_TAG_SIZE;
+    }
+
+    network = header + network_offset;
+
+    if (__builtin_expect((network[0] & 0xF) * 4 != IPV4_HEADER_SIZE, 0))
+    {
+        ip_header_size = (uint32_t)(network[0] & 0xF) * 4;
+    }
+
+    batch->ether_type[lane] = read_be16(header + network_offset - UINT16_T_SIZE);
+    batch->header_len[lane] = network[0] & 0xF;
+    batch->protocol[lane] = network[9];
+    batch->source_ip[lane] = ip_to_uint32(network + 12);
+    batch->destination_ip[lane] = ip_to_uint32(network + 16);
+    batch->source_port[lane] = read_be16(network + ip_header_size);
+    batch->destination_port[lane] = read_be16(network + ip_header_size + UINT16_T_SIZE);
+    batch->ip_len[lane] = read_be16(network + 2);
+    batch->udp_len[lane] = read_be16(network + ip_header_size + 4);
+    batch->ttl[lane] = network[8];
+    batch->tos[lane] = network[1];
+
+    is_valid = (uint32_t)(batch->ether_type[lane] == IPV4_PROTOCOL) &
+               (uint32_t)(ip_header_size >= IPV4_HEADER_SIZE) &
+               (uint32_t)(batch->protocol[lane] == UDP_PROTOCOL) &
+               (uint32_t)(batch->frame_len[lane] >= network_offset + IPV4_HEADER_SIZE) &
+               (uint32_t)(batch->frame_len[lane] >= network_offset + ip_header_size + UDP_HEADER_SIZE);
+    batch->valid_mask = (batch->valid_mask & ~(1U << lane)) | (is_valid << lane);
+    batch->count++;
+
+    return;
+}
+
+/* Hash the IP pairs of every lane at once */
+void hash_header_batch(header_batch_t *batch)
+{
+    jhash_lanes(batch->source_ip, batch->destination_ip, batch->hash, batch->count);
+
+    return;
+}
+
+/* Hash what is queued and insert the IPv4/UDP lanes the filter keeps in arrival order */
+void flush_header_batch(header_batch_t *batch, hash_table_t *hash_table)
+{
+    flow_key_t keys[HEADER_BATCH_SIZE];
+    flow_sample_t samples[HEADER_BATCH_SIZE];
+    uint32_t hashes[HEADER_BATCH_SIZE];
+    uint32_t count = 0;
+    uint32_t lane = 0;
+    uint32_t filter_mask = UINT32_MAX;
+#ifdef DEBUG
+    packet_descriptor_t descriptor = {0};
+#endif
+
+    if (batch->count == 0)
+    {
+        return;
+    }
+
+    hash_header_batch(batch);
+
+    if (hash_table->filter != NULL)
+    {
+        filter_mask = filter_header_batch(hash_table->filter, batch);
+        batch->valid_mask &= filter_mask;
+    }
+
+    /* Compact without branching: every lane is written, only valid ones advance */
+    for (lane = 0; lane < batch->count; lane++)
+    {
+        uint32_to_ip(batch->source_ip[lane], keys[count].source_ip);
+        uint32_to_ip(batch->destination_ip[lane], keys[count].destination_ip);
+        keys[count].source_port = batch->source_port[lane];
+        keys[count].destination_port = batch->destination_port[lane];
+        keys[count].protocol = batch->protocol[lane];
+        memset(keys[count].reserved, 0, sizeof(keys[count].reserved));
+        mask_flow_key(&keys[count], hash_table->schema);
+        samples[count].ip_len = batch->ip_len[lane];
+        samples[count].udp_len = batch->udp_len[lane];
+        samples[count].ttl = batch->ttl[lane];
+        samples[count].tos = batch->tos[lane];
+        hashes[count] = batch->hash[lane];
+        count += (batch->valid_mask >> lane) & 1;
+    }
+
+#ifdef DEBUG
+    /* Header printing still goes through the per-packet parser, for the frames the filter keeps */
+    for (lane = 0; lane < batch->count; lane++)
+    {
+        if (((filter_mask >> lane) & 1) == 0)
+        {
+            continue;
+        }
+
+        describe_frame(batch->headers[lane],
+                       (batch->frame_len[lane] < HEADER_PEEK_SIZE) ? batch->frame_len[lane] : HEADER_PEEK_SIZE,
+                       &descriptor);
+    }
+#endif
+
+    /* The lane hashes are already the IP pair hashes the sketches take */
+    for (lane = 0; hash_table->cardinality != NULL && lane < batch->count; lane++)
+    {
+        if ((batch->valid_mask >> lane) & 1)
+        {
+            add_host_pair(hash_table->cardinality, batch->source_ip[lane], batch->destination_ip[lane], batch->hash[lane]);
+        }
+    }
+
+    /* The lane hashes are IP pair hashes, other schemas hash their own keys */
+    if (hash_table->schema == KEY_IP_PAIR)
+    {
+        insert_hashed_batch_into_hash_table(keys, hashes, samples, count, hash_table);
+    }
+    else
+    {
+        insert_batch_into_hash_table(keys, samples, count, hash_table);
+    }
+    batch->count = 0;
+    batch->valid_mask = 0;
+
+    return;
+}
@@ -0,0 +1,58 @@
+#ifndef HEADER_BATCH_H_INCLUDED
+#define HEADER_BATCH_H_INCLUDED
+
+#include "packets.h"
+#include "hash.h"
+
+#define HEADER_BATCH_SIZE HASH_BATCH_SIZE
+#define IPV4_MAX_HEADER_SIZE 60
+#define HEADER_PEEK_SIZE 96
+#define SSE2_HASH_LANES 4
+#define AVX2_HASH_LANES 8
+
+_Static_assert(HEADER_BATCH_SIZE <= 32, "valid_mask has one bit per lane");
+_Static_assert(HEADER_PEEK_SIZE >= ETHERNET_HEADER_SIZE + MAX_VLAN_TAGS * VLAN_TAG_SIZE + IPV4_MAX_HEADER_SIZE + UDP_HEADER_SIZE,
+               "a lane must hold the longest tagged Ethernet/IPv4/UDP header");
+
+/* Frames parsed HEADER_BATCH_SIZE at a time when built with
+ * HEADER_BATCH_LANES; by default add_to_header_batch() counts each frame
+ * with process_frame() and the batch stays empty, as bench/header-batch-bench
+ * measures the lanes slower. The fields of a frame are read into one column
+ * per field as it is added, straight from the frame, or from a zero padded
+ * copy when it is shorter than HEADER_PEEK_SIZE, so they sit at fixed offsets
+ * without bounds checks; non IPv4/UDP frames are dropped through valid_mask
+ * and the IP pairs are hashed for the whole batch at once. DEBUG builds also
+ * keep the headers, to print them with describe_frame(). */
+typedef struct header_batch
+{
+#ifdef DEBUG
+    uint8_t headers[HEADER_BATCH_SIZE][HEADER_PEEK_SIZE];
+#endif
+    uint32_t frame_len[HEADER_BATCH_SIZE];
+    uint16_t ether_type[HEADER_BATCH_SIZE];
+    uint8_t header_len[HEADER_BATCH_SIZE];
+    uint8_t protocol[HEADER_BATCH_SIZE];
+    uint32_t source_ip[HEADER_BATCH_SIZE];
+    uint32_t destination_ip[HEADER_BATCH_SIZE];
+    uint16_t source_port[HEADER_BATCH_SIZE];
+    uint16_t destination_port[HEADER_BATCH_SIZE];
+    uint16_t ip_len[HEADER_BATCH_SIZE];
+    uint16_t udp_len[HEADER_BATCH_SIZE];
+    uint8_t ttl[HEADER_BATCH_SIZE];
+    uint8_t tos[HEADER_BATCH_SIZE];
+    uint32_t hash[HEADER_BATCH_SIZE];
+    uint32_t valid_mask;
+    uint32_t count;
+} header_batch_t;
+
+/* hash[i] is flow_key_hash_ip_pair() of the pair source_ip[i], destination_ip[i] */
+void init_jhash_lanes(void);
+void jhash_lanes(const uint32_t *source_ip, const uint32_t *destination_ip, uint32_t *hash, uint32_t count);
+void jhash_lanes_scalar(const uint32_t *source_ip, const uint32_t *destination_ip, uint32_t *hash, uint32_t count);
+const char *jhash_lanes_name(void);
+void add_to_header_batch(header_batch_t *batch, const uint8_t *frame, size_t frame_len, hash_table_t *hash_table);
+void add_header_lane(header_batch_t *batch, const uint8_t *frame, size_t frame_len);
+void hash_header_batch(header_batch_t *batch);
+void flush_header_batch(header_batch_t *batch, hash_table_t *hash_table);
+
+#endif // HEADER_BATCH_H_INCLUDED
@@ -0,0 +1,427 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "heavy-hitters.h"
+
+#define TOP_FLOWS_TITLE "Top Flows (approximate)"
+#define EULER 2.718281828459045
+#define PERCENT 100
+
+static void *allocate_zeroed(size_t count, size_t size);
+static inline void sketch_columns(uint32_t hash, uint32_t *columns);
+static uint32_t find_top_flow(const heavy_hitters_t *heavy_hitters, const flow_key_t *key, uint32_t hash);
+static void index_top_flow(heavy_hitters_t *heavy_hitters, uint32_t flow, uint32_t hash);
+static void unindex_top_flow(heavy_hitters_t *heavy_hitters, const flow_key_t *key);
+static void swap_heap_entries(heavy_hitters_t *heavy_hitters, uint32_t first, uint32_t second);
+static void sift_up(heavy_hitters_t *heavy_hitters, uint32_t position);
+static void sift_down(heavy_hitters_t *heavy_hitters, uint32_t position);
+static int compare_top_flows(const void *first, const void *second);
+
+static const top_flow_t *sorted_flows = NULL;
+
+static void *allocate_zeroed(size_t count, size_t size)
+{
+    void *memory = calloc(count, size);
+
+    if (memory == NULL)
+    {
+        perror("Memory allocation failed for heavy hitters");
+        exit(EXIT_FAILURE);
+    }
+
+    return memory;
+}
+
+/* Track the capacity biggest flows; all memory is taken here, up front */
+void init_heavy_hitters(heavy_hitters_t *heavy_hitters, uint32_t capacity)
+{
+    uint32_t index_size = 1;
+
+    /* At most half full, so probes stay short */
+    while (index_size < capacity * 2)
+    {
+        index_size *= 2;
+    }
+
+    memset(heavy_hitters, 0, sizeof(heavy_hitters_t));
+    heavy_hitters->sketch = allocate_zeroed(SKETCH_DEPTH, sizeof(heavy_hitters->sketch[0]));
+    heavy_hitters->flows = allocate_zeroed(capacity, sizeof(top_flow_t));
+    heavy_hitters->heap = allocate_zeroed(capacity, sizeof(uint32_t));
+    heavy_hitters->heap_position = allocate_zeroed(capacity, sizeof(uint32_t));
+    heavy_hitters->index = allocate_zeroed(index_size, sizeof(uint32_t));
+    heavy_hitters->index_size = index_size;
+    heavy_hitters->capacity = capacity;
+
+    return;
+}
+
+/* One column per sketch row from a single key hash (double hashing) */
+static inline void sketch_columns(uint32_t hash, uint32_t *columns)
+{
+    uint32_t a = hash;
+    uint32_t b = SKETCH_SEED;
+    uint32_t row = 0;
+
+    jhash(&a, &b);
+    b |= 1;
+
+    for (row = 0; row < SKETCH_DEPTH; row++)
+    {
+        columns[row] = (hash + row * b) & SKETCH_MASK;
+    }
+
+    return;
+}
+
+/* Index of the tracked flow with this key, or capacity when it is not tracked */
+static uint32_t find_top_flow(const heavy_hitters_t *heavy_hitters, const flow_key_t *key, uint32_t hash)
+{
+    uint32_t mask = heavy_hitters->index_size - 1;
+    uint32_t slot = hash & mask;
+    uint32_t flow = 0;
+
+    while (heavy_hitters->index[slot] != TOP_INDEX_EMPTY)
+    {
+        flow = heavy_hitters->index[slot] - 1;
+
+        if (is_same_flow_key(&heavy_hitters->flows[flow].key, key))
+        {
+            return flow;
+        }
+
+        slot = (slot + 1) & mask;
+    }
+
+    return heavy_hitters->capacity;
+}
+
+static void index_top_flow(heavy_hitters_t *heavy_hitters, uint32_t flow, uint32_t hash)
+{
+    uint32_t mask = heavy_hitters->index_size - 1;
+    uint32_t slot = hash & mask;
+
+    while (heavy_hitters->index[slot] != TOP_INDEX_EMPTY)
+    {
+        slot = (slot + 1) & mask;
+    }
+
+    heavy_hitters->index[slot] = flow + 1;
+
+    return;
+}
+
+/* Remove a key from the index, shifting later entries of the probe run back
+ * into the gap so lookups never need tombstones */
+static void unindex_top_flow(heavy_hitters_t *heavy_hitters, const flow_key_t *key)
+{
+    uint32_t mask = heavy_hitters->index_size - 1;
+    uint32_t slot = flow_key_hash(key) & mask;
+    uint32_t next = 0;
+    uint32_t home = 0;
+
+    while (!is_same_flow_key(&heavy_hitters->flows[heavy_hitters->index[slot] - 1].key, key))
+    {
+        slot = (slot + 1) & mask;
+    }
+
+    for (next = (slot + 1) & mask; heavy_hitters->index[next] != TOP_INDEX_EMPTY; next = (next + 1) & mask)
+    {
+        home = flow_key_hash(&heavy_hitters->flows[heavy_hitters->index[next] - 1].key) & mask;
+
+        /* The entry may move to the gap only if its home is not between the gap and itself */
+        if (((next - home) & mask) >= ((next - slot) & mask))
+        {
+            heavy_hitters->index[slot] = heavy_hitters->index[next];
+            slot = next;
+        }
+    }
+
+    heavy_hitters->index[slot] = TOP_INDEX_EMPTY;
+
+    return;
+}
+
+static void swap_heap_entries(heavy_hitters_t *heavy_hitters, uint32_t first, uint32_t second)
+{
+    uint32_t flow = heavy_hitters->heap[first];
+
+    heavy_hitters->heap[first] = heavy_hitters->heap[second];
+    heavy_hitters->heap[second] = flow;
+    heavy_hitters->heap_position[heavy_hitters->heap[first]] = first;
+    heavy_hitters->heap_position[heavy_hitters->heap[second]] = second;
+
+    return;
+}
+
+static void sift_up(heavy_hitters_t *heavy_hitters, uint32_t position)
+{
+    uint32_t parent = 0;
+
+    while (position > 0)
+    {
+        parent = (position - 1) / 2;
+
+        if (heavy_hitters->flows[heavy_hitters->heap[parent]].count <=
+            heavy_hitters->flows[heavy_hitters->heap[position]].count)
+        {
+            break;
+        }
+
+        swap_heap_entries(heavy_hitters, parent, position);
+        position = parent;
+    }
+
+    return;
+}
+
+static void sift_down(heavy_hitters_t *heavy_hitters, uint32_t position)
+{
+    uint32_t smallest = position;
+    uint32_t child = 0;
+
+    for (;;)
+    {
+        for (child = 2 * position + 1; child <= 2 * position + 2 && child < heavy_hitters->num_flows; child++)
+        {
+            if (heavy_hitters->flows[heavy_hitters->heap[child]].count <
+                heavy_hitters->flows[heavy_hitters->heap[smallest]].count)
+            {
+                smallest = child;
+            }
+        }
+
+        if (smallest == position)
+        {
+            break;
+        }
+
+        swap_heap_entries(heavy_hitters, smallest, position);
+        position = smallest;
+    }
+
+    return;
+}
+
+/* Count a key count times */
+void add_to_heavy_hitters(heavy_hitters_t *heavy_hitters, const flow_key_t *key, uint32_t count)
+{
+    uint32_t columns[SKETCH_DEPTH] = {0};
+    uint32_t hash = flow_key_hash(key);
+    uint32_t estimate = UINT32_MAX;
+    uint32_t flow = 0;
+    uint32_t row = 0;
+
+    sketch_columns(hash, columns);
+
+    /* Conservative update: raise each counter only as far as the new estimate */
+    for (row = 0; row < SKETCH_DEPTH; row++)
+    {
+        estimate = (heavy_hitters->sketch[row][columns[row]] < estimate) ? heavy_hitters->sketch[row][columns[row]] : estimate;
+    }
+
+    estimate += count;
+
+    for (row = 0; row < SKETCH_DEPTH; row++)
+    {
+        if (heavy_hitters->sketch[row][columns[row]] < estimate)
+        {
+            heavy_hitters->sketch[row][columns[row]] = estimate;
+        }
+    }
+
+    heavy_hitters->total += count;
+    flow = find_top_flow(heavy_hitters, key, hash);
+
+    if (flow < heavy_hitters->capacity)
+    {
+        heavy_hitters->flows[flow].count += count;
+        sift_down(heavy_hitters, heavy_hitters->heap_position[flow]);
+
+        return;
+    }
+
+    /* Until the set is full every key seen is tracked, and counted exactly */
+    if (heavy_hitters->num_flows < heavy_hitters->capacity)
+    {
+        flow = heavy_hitters->num_flows++;
+        heavy_hitters->flows[flow].key = *key;
+        heavy_hitters->flows[flow].count = count;
+        heavy_hitters->flows[flow].error = 0;
+        heavy_hitters->heap[flow] = flow;
+        heavy_hitters->heap_position[flow] = flow;
+        index_top_flow(heavy_hitters, flow, hash);
+        sift_up(heavy_hitters, flow);
+
+        return;
+    }
+
+    /* The sketch estimate never undercounts, so a key at or below the
+     * smallest tracked count cannot belong in the set yet */
+    flow = heavy_hitters->heap[0];
+
+    if (estimate <= heavy_hitters->flows[flow].count)
+    {
+        return;
+    }
+
+    unindex_top_flow(heavy_hitters, &heavy_hitters->flows[flow].key);
+    heavy_hitters->flows[flow].key = *key;
+    heavy_hitters->flows[flow].count = estimate;
+    heavy_hitters->flows[flow].error = estimate - count;
+    heavy_hitters->num_evictions++;
+    index_top_flow(heavy_hitters, flow, hash);
+    sift_down(heavy_hitters, 0);
+
+    return;
+}
+
+/* Upper bound on the packets of any key, tracked or not */
+uint32_t estimate_flow_count(const heavy_hitters_t *heavy_hitters, const flow_key_t *key)
+{
+    uint32_t columns[SKETCH_DEPTH] = {0};
+    uint32_t hash = flow_key_hash(key);
+    uint32_t estimate = UINT32_MAX;
+    uint32_t flow = find_top_flow(heavy_hitters, key, hash);
+    uint32_t row = 0;
+
+    if (flow < heavy_hitters->capacity)
+    {
+        return heavy_hitters->flows[flow].count;
+    }
+
+    sketch_columns(hash, columns);
+
+    for (row = 0; row < SKETCH_DEPTH; row++)
+    {
+        estimate = (heavy_hitters->sketch[row][columns[row]] < estimate) ? heavy_hitters->sketch[row][columns[row]] : estimate;
+    }
+
+    return estimate;
+}
+
+/* Biggest count first; qsort is not stable, so ties fall back to the flow index */
+static int compare_top_flows(const void *first, const void *second)
+{
+    uint32_t first_flow = *(const uint32_t *)first;
+    uint32_t second_flow = *(const uint32_t *)second;
+
+    if (sorted_flows[first_flow].count != sorted_flows[second_flow].count)
+    {
+        return (sorted_flows[first_flow].count > sorted_flows[second_flow].count) ? -1 : 1;
+    }
+
+    return (first_flow > second_flow) - (first_flow < second_flow);
+}
+
+/* The linked list report for the tracked flows, biggest first, with the
+ * most each count may exceed the true one */
+void print_heavy_hitters(const heavy_hitters_t *heavy_hitters, key_schema_t schema)
+{
+    const top_flow_t *flow = NULL;
+    uint32_t *order = NULL;
+    uint32_t width = LIST_NUMBER_WIDTH + key_columns_width(schema) + 2 * COUNT_COLUMN_WIDTH;
+    uint32_t iteration = 0;
+    uint32_t total_pad = 0;
+    double epsilon = EULER / SKETCH_WIDTH;
+    double failure = 1.0;
+    double bound = 0.0;
+    uint32_t least = 0;
+
+    order = allocate_zeroed(heavy_hitters->num_flows + 1, sizeof(uint32_t));
+
+    for (iteration = 0; iteration < heavy_hitters->num_flows; iteration++)
+    {
+        order[iteration] = iteration;
+    }
+
+    sorted_flows = heavy_hitters->flows;
+    qsort(order, heavy_hitters->num_flows, sizeof(uint32_t), compare_top_flows);
+    sorted_flows = NULL;
+
+    print_table_rule(width);
+    print_table_title(TOP_FLOWS_TITLE, (width - 2 - (uint32_t)strlen(TOP_FLOWS_TITLE)) / 2, width);
+    fputs("+-----", stdout);
+    print_key_rule(schema);
+    puts("+--------------+--------------+");
+    fputs("|  No ", stdout);
+    print_key_heading(schema);
+    puts("| Packet Count |   Max Error  |");
+    fputs("+-----", stdout);
+    print_key_rule(schema);
+    puts("+--------------+--------------+");
+
+    for (iteration = 0; iteration < heavy_hitters->num_flows; iteration++)
+    {
+        flow = &heavy_hitters->flows[order[iteration]];
+        printf("| %3u ", iteration + 1);
+        print_key_cells(&flow->key, schema);
+        printf("| %12u | %12u |\n", flow->count, flow->error);
+        fputs("+-----", stdout);
+        print_key_rule(schema);
+        puts("+--------------+--------------+");
+    }
+
+    total_pad = key_title_pad(LIST_TOTAL_PAD, schema);
+    printf("|%*s%-*s| %12llu |              |\n", (int)total_pad, "",
+           (int)(width - 2 * COUNT_COLUMN_WIDTH - 1 - total_pad), "Total Packet Count",
+           (unsigned long long)heavy_hitters->total);
+    putchar('+');
+
+    for (iteration = 0; iteration < width - 2 * COUNT_COLUMN_WIDTH - 1; iteration++)
+    {
+        putchar('-');
+    }
+
+    puts("+--------------+--------------+");
+
+    for (iteration = 0; iteration < SKETCH_DEPTH; iteration++)
+    {
+        failure /= EULER;
+    }
+
+    /* Until the set fills nothing has been evicted, so every flow seen is listed */
+    if (heavy_hitters->num_flows < heavy_hitters->capacity)
+    {
+        puts("Counts may exceed the true ones by Max Error. Every flow is listed.");
+    }
+    else
+    {
+        least = heavy_hitters->flows[heavy_hitters->heap[0]].count;
+        printf("Counts may exceed the true ones by Max Error. Flows not listed have at most %u packet%s.\n", least,
+               (least == 1) ? "" : "s");
+    }
+
+    /* %.0f rounds half to even, so only (0.5, 1.5) prints as 1 */
+    bound = epsilon * (double)heavy_hitters->total + 0.5;
+    printf("Sketch estimates exceed the true count by at most %.0f packet%s with %.1f%% probability.\n", bound,
+           (bound > 0.5 && bound < 1.5) ? "" : "s", (1.0 - failure) * PERCENT);
+
+    free(order);
+
+    return;
+}
+
+void print_heavy_hitters_stats(const heavy_hitters_t *heavy_hitters)
+{
+    size_t bytes = SKETCH_DEPTH * sizeof(heavy_hitters->sketch[0]) +
+                   heavy_hitters->capacity * (sizeof(top_flow_t) + 2 * sizeof(uint32_t)) +
+                   heavy_hitters->index_size * sizeof(uint32_t);
+
+    fprintf(stderr, "Tracked flows: %u of %u, Evictions: %u, Sketch: %u x %u, Memory: %zu bytes\n",
+            heavy_hitters->num_flows, heavy_hitters->capacity, heavy_hitters->num_evictions,
+            SKETCH_DEPTH, SKETCH_WIDTH, bytes);
+
+    return;
+}
+
+void free_heavy_hitters(heavy_hitters_t *heavy_hitters)
+{
+    free(heavy_hitters->sketch);
+    free(heavy_hitters->flows);
+    free(heavy_hitters->heap);
+    free(heavy_hitters->heap_position);
+    free(heavy_hitters->index);
+    memset(heavy_hitters, 0, sizeof(heavy_hitters_t));
+
+    return;
+}
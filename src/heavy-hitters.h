@@ -0,0 +1,50 @@
+#ifndef HEAVY_HITTERS_H_INCLUDED
+#define HEAVY_HITTERS_H_INCLUDED
+
+#include "hash.h"
+
+#define SKETCH_DEPTH 4
+#define SKETCH_WIDTH_SHIFT 16
+#define SKETCH_WIDTH (1U << SKETCH_WIDTH_SHIFT)
+#define SKETCH_MASK (SKETCH_WIDTH - 1)
+#define SKETCH_SEED 0x9E3779B9U
+#define MAX_TOP_FLOWS 65536
+#define TOP_INDEX_EMPTY 0
+
+/* A tracked flow; count never underestimates and count - error never overestimates */
+typedef struct top_flow
+{
+    flow_key_t key;
+    uint32_t count;
+    uint32_t error;
+} top_flow_t;
+
+/* Fixed memory flow counting for captures too big for the exact table.
+ * A Count-Min sketch with conservative update estimates every key, and a
+ * Space-Saving set keeps the capacity flows with the largest counts: a new
+ * key replaces the smallest tracked flow once its sketch estimate is bigger,
+ * starting from that estimate. heap is a min-heap of flow indices by count,
+ * index maps keys to flow index + 1 by linear probing. Nothing is allocated
+ * after init_heavy_hitters(). */
+struct heavy_hitters
+{
+    uint32_t (*sketch)[SKETCH_WIDTH];
+    top_flow_t *flows;
+    uint32_t *heap;
+    uint32_t *heap_position;
+    uint32_t *index;
+    uint32_t index_size;
+    uint32_t capacity;
+    uint32_t num_flows;
+    uint32_t num_evictions;
+    uint64_t total;
+};
+
+void init_heavy_hitters(heavy_hitters_t *heavy_hitters, uint32_t capacity);
+void add_to_heavy_hitters(heavy_hitters_t *heavy_hitters, const flow_key_t *key, uint32_t count);
+uint32_t estimate_flow_count(const heavy_hitters_t *heavy_hitters, const flow_key_t *key);
+void print_heavy_hitters(const heavy_hitters_t *heavy_hitters, key_schema_t schema);
+void print_heavy_hitters_stats(const heavy_hitters_t *heavy_hitters);
+void free_heavy_hitters(heavy_hitters_t *heavy_hitters);
+
+#endif // HEAVY_HITTERS_H_INCLUDED
@@ -0,0 +1,209 @@
+#include <string.h>
+#include "hex-decoder.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #define HAVE_X86_SIMD 1
+    #include <immintrin.h>
+#else
+    #define HAVE_X86_SIMD 0
+#endif
+
+typedef size_t (*hex_decode_fn)(const char *hex, uint8_t *bytes, size_t len);
+
+static size_t hex_decode_dispatch(const char *hex, uint8_t *bytes, size_t len);
+
+/* Nibble value + 1 of every hex character, 0 marks anything that is not hex */
+static const uint8_t nibble_table[256] =
+{
+    ['0'] = 0x1, ['1'] = 0x2, ['2'] = 0x3, ['3'] = 0x4, ['4'] = 0x5,
+    ['5'] = 0x6, ['6'] = 0x7, ['7'] = 0x8, ['8'] = 0x9, ['9'] = 0xA,
+    ['a'] = 0xB, ['b'] = 0xC, ['c'] = 0xD, ['d'] = 0xE, ['e'] = 0xF, ['f'] = 0x10,
+    ['A'] = 0xB, ['B'] = 0xC, ['C'] = 0xD, ['D'] = 0xE, ['E'] = 0xF, ['F'] = 0x10
+};
+
+static hex_decode_fn hex_decode_impl = hex_decode_dispatch;
+static const char *hex_decode_impl_name = "scalar";
+
+size_t hex_decode_scalar(const char *hex, uint8_t *bytes, size_t len)
+{
+    size_t iteration = 0;
+    uint8_t high = 0;
+    uint8_t low = 0;
+
+    for (iteration = 0; iteration < len; iteration++)
+    {
+        high = nibble_table[(uint8_t)hex[iteration * 2]];
+        low = nibble_table[(uint8_t)hex[iteration * 2 + 1]];
+
+        if (high == 0 || low == 0)
+        {
+            return iteration;
+        }
+
+        bytes[iteration] = (uint8_t)(((high - 1) << 4) | (low - 1));
+    }
+
+    return iteration;
+}
+
+#if HAVE_X86_SIMD
+/* Turn 16 hex characters into nibbles, flagging every lane that is not hex */
+static inline __m128i sse2_nibbles(__m128i chars, __m128i *invalid)
+{
+    __m128i digit = _mm_sub_epi8(chars, _mm_set1_epi8('0'));
+    __m128i letter = _mm_sub_epi8(_mm_or_si128(chars, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    __m128i is_digit = _mm_and_si128(_mm_cmpgt_epi8(digit, _mm_set1_epi8(-1)), _mm_cmplt_epi8(digit, _mm_set1_epi8(10)));
+    __m128i is_letter = _mm_and_si128(_mm_cmpgt_epi8(letter, _mm_set1_epi8(-1)), _mm_cmplt_epi8(letter, _mm_set1_epi8(6)));
+
+    *invalid = _mm_andnot_si128(_mm_or_si128(is_digit, is_letter), _mm_set1_epi8(-1));
+
+    return _mm_or_si128(_mm_and_si128(is_digit, digit),
+                        _mm_and_si128(is_letter, _mm_add_epi8(letter, _mm_set1_epi8(10))));
+}
+
+static size_t hex_decode_sse2(const char *hex, uint8_t *bytes, size_t len)
+{
+    size_t iteration = 0;
+    __m128i nibbles;
+    __m128i invalid;
+    __m128i pairs;
+
+    for (iteration = 0; iteration + SSE2_HEX_BLOCK / 2 <= len; iteration += SSE2_HEX_BLOCK / 2)
+    {
+        nibbles = sse2_nibbles(_mm_loadu_si128((const __m128i *)(hex + iteration * 2)), &invalid);
+
+        if (_mm_movemask_epi8(invalid) != 0)
+        {
+            /* Let the scalar path pin down the exact failing byte */
+            return iteration + hex_decode_scalar(hex + iteration * 2, bytes + iteration, len - iteration);
+        }
+
+        /* Each 16 bit lane holds the high nibble in its low byte and the low nibble above it */
+        pairs = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(nibbles, _mm_set1_epi16(0x00FF)), 4),
+                             _mm_srli_epi16(nibbles, 8));
+        _mm_storel_epi64((__m128i *)(bytes + iteration), _mm_packus_epi16(pairs, _mm_setzero_si128()));
+    }
+
+    return iteration + hex_decode_scalar(hex + iteration * 2, bytes + iteration, len - iteration);
+}
+
+__attribute__((target("avx2")))
+static size_t hex_decode_avx2(const char *hex, uint8_t *bytes, size_t len)
+{
+    size_t iteration = 0;
+    __m256i chars;
+    __m256i digit;
+    __m256i letter;
+    __m256i is_digit;
+    __m256i is_letter;
+    __m256i nibbles;
+    __m256i pairs;
+
+    for (iteration = 0; iteration + AVX2_HEX_BLOCK / 2 <= len; iteration += AVX2_HEX_BLOCK / 2)
+    {
+        chars = _mm256_loadu_si256((const __m256i *)(hex + iteration * 2));
+        digit = _mm256_sub_epi8(chars, _mm256_set1_epi8('0'));
+        letter = _mm256_sub_epi8(_mm256_or_si256(chars, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+        is_digit = _mm256_andnot_si256(_mm256_cmpgt_epi8(_mm256_setzero_si256(), digit),
+                                       _mm256_cmpgt_epi8(_mm256_set1_epi8(10), digit));
+        is_letter = _mm256_andnot_si256(_mm256_cmpgt_epi8(_mm256_setzero_si256(), letter),
+                                        _mm256_cmpgt_epi8(_mm256_set1_epi8(6), letter));
+
+        if ((uint32_t)_mm256_movemask_epi8(_mm256_or_si256(is_digit, is_letter)) != 0xFFFFFFFFu)
+        {
+            return iteration + hex_decode_scalar(hex + iteration * 2, bytes + iteration, len - iteration);
+        }
+
+        nibbles = _mm256_or_si256(_mm256_and_si256(is_digit, digit),
+                                  _mm256_and_si256(is_letter, _mm256_add_epi8(letter, _mm256_set1_epi8(10))));
+        pairs = _mm256_or_si256(_mm256_slli_epi16(_mm256_and_si256(nibbles, _mm256_set1_epi16(0x00FF)), 4),
+                                _mm256_srli_epi16(nibbles, 8));
+
+        /* packus works per 128 bit lane, gather the two 8 byte halves back together */
+        pairs = _mm256_permute4x64_epi64(_mm256_packus_epi16(pairs, _mm256_setzero_si256()), 0xD8);
+        _mm_storeu_si128((__m128i *)(bytes + iteration), _mm256_castsi256_si128(pairs));
+    }
+
+    /* Clear the upper halves so the legacy SSE2 tail does not pay a transition penalty */
+    _mm256_zeroupper();
+
+    return iteration + hex_decode_sse2(hex + iteration * 2, bytes + iteration, len - iteration);
+}
+#endif
+
+/* Pick the widest kernel the CPU supports; call before starting worker threads */
+void init_hex_decoder(void)
+{
+    hex_decode_impl = hex_decode_scalar;
+    hex_decode_impl_name = "scalar";
+
+#if HAVE_X86_SIMD
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+    {
+        hex_decode_impl = hex_decode_avx2;
+        hex_decode_impl_name = "avx2";
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+        hex_decode_impl = hex_decode_sse2;
+        hex_decode_impl_name = "sse2";
+    }
+#endif
+
+    return;
+}
+
+/* Force one kernel by name (scalar, sse2, avx2), false when the CPU lacks it.
+ * Meant for comparing the kernels, normal runs use init_hex_decoder(). */
+bool_t use_hex_decoder(const char *name)
+{
+    if (strcmp(name, "scalar") == 0)
+    {
+        hex_decode_impl = hex_decode_scalar;
+        hex_decode_impl_name = "scalar";
+
+        return true;
+    }
+
+#if HAVE_X86_SIMD
+    __builtin_cpu_init();
+
+    if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2"))
+    {
+        hex_decode_impl = hex_decode_avx2;
+        hex_decode_impl_name = "avx2";
+
+        return true;
+    }
+
+    if (strcmp(name, "sse2") == 0 && __builtin_cpu_supports("sse2"))
+    {
+        hex_decode_impl = hex_decode_sse2;
+        hex_decode_impl_name = "sse2";
+
+        return true;
+    }
+#endif
+
+    return false;
+}
+
+/* First call selects the kernel, later calls go straight to it */
+static size_t hex_decode_dispatch(const char *hex, uint8_t *bytes, size_t len)
+{
+    init_hex_decoder();
+
+    return hex_decode_impl(hex, bytes, len);
+}
+
+size_t hex_decode(const char *hex, uint8_t *bytes, size_t len)
+{
+    return hex_decode_impl(hex, bytes, len);
+}
+
+const char *hex_decoder_name(void)
+{
+    return hex_decode_impl_name;
+}
\ No newline at end of file
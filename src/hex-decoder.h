@@ -0,0 +1,19 @@
+#ifndef HEX_DECODER_H_INCLUDED
+#define HEX_DECODER_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+#include "packets.h"
+
+#define SSE2_HEX_BLOCK 16
+#define AVX2_HEX_BLOCK 32
+
+/* Decodes len bytes from 2 * len hex characters and returns how many bytes were
+ * decoded, which is less than len if an invalid character was found. */
+void init_hex_decoder(void);
+size_t hex_decode(const char *hex, uint8_t *bytes, size_t len);
+size_t hex_decode_scalar(const char *hex, uint8_t *bytes, size_t len);
+bool_t use_hex_decoder(const char *name);
+const char *hex_decoder_name(void);
+
+#endif // HEX_DECODER_H_INCLUDED
\ No newline at end of file
@@ -0,0 +1,340 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host-index.h"
+#include "packet-filter.h"
+
+#define HOST_TITLE_SIZE 48
+
+static const char *const host_side_titles[NUM_HOST_SIDES] = {"Flows from", "Flows to"};
+
+/* realloc that gives up like every other allocation in the program */
+static void *allocate_index_memory(void *memory, size_t size)
+{
+    void *resized = realloc(memory, size);
+
+    if (resized == NULL)
+    {
+        perror("Memory allocation failed for host index");
+        exit(EXIT_FAILURE);
+    }
+
+    return resized;
+}
+
+static inline uint32_t host_index_hash(uint32_t ip)
+{
+    uint32_t b = 0;
+
+    jhash(&ip, &b);
+
+    return b;
+}
+
+static void init_host_adjacency(host_adjacency_t *adjacency)
+{
+    memset(adjacency, 0, sizeof(host_adjacency_t));
+    adjacency->num_slots = HOST_TABLE_INITIAL;
+    adjacency->slots = (uint32_t *)allocate_index_memory(NULL, adjacency->num_slots * sizeof(uint32_t));
+    memset(adjacency->slots, 0, adjacency->num_slots * sizeof(uint32_t));
+
+    return;
+}
+
+void init_host_index(host_index_t *host_index, key_schema_t schema)
+{
+    memset(host_index, 0, sizeof(host_index_t));
+    host_index->has_side[HOST_AS_SOURCE] = (schema == KEY_SOURCE || schema == KEY_IP_PAIR || schema == KEY_FIVE_TUPLE);
+    host_index->has_side[HOST_AS_DESTINATION] = (schema != KEY_SOURCE);
+    init_host_adjacency(&host_index->sides[HOST_AS_SOURCE]);
+    init_host_adjacency(&host_index->sides[HOST_AS_DESTINATION]);
+
+    return;
+}
+
+/* Double the index and put every host back */
+static void grow_host_slots(host_adjacency_t *adjacency)
+{
+    uint32_t mask = adjacency->num_slots * 2 - 1;
+    uint32_t slot = 0;
+    uint32_t host = 0;
+
+    adjacency->num_slots *= 2;
+    adjacency->slots = (uint32_t *)allocate_index_memory(adjacency->slots, adjacency->num_slots * sizeof(uint32_t));
+    memset(adjacency->slots, 0, adjacency->num_slots * sizeof(uint32_t));
+
+    for (host = 0; host < adjacency->num_hosts; host++)
+    {
+        slot = host_index_hash(adjacency->hosts[host].ip) & mask;
+
+        while (adjacency->slots[slot] != HOST_SLOT_EMPTY)
+        {
+            slot = (slot + 1) & mask;
+        }
+
+        adjacency->slots[slot] = host + 1;
+    }
+
+    return;
+}
+
+/* The slot of ip: the one holding it, or the empty one that ends its probe */
+static inline uint32_t find_host_slot(const host_adjacency_t *adjacency, uint32_t ip)
+{
+    uint32_t mask = adjacency->num_slots - 1;
+    uint32_t slot = host_index_hash(ip) & mask;
+
+    while (adjacency->slots[slot] != HOST_SLOT_EMPTY && adjacency->hosts[adjacency->slots[slot] - 1].ip != ip)
+    {
+        slot = (slot + 1) & mask;
+    }
+
+    return slot;
+}
+
+/* Room for size more ids at the end of the pool, returns where they start */
+static uint32_t reserve_pool(host_adjacency_t *adjacency, uint32_t size)
+{
+    uint32_t offset = adjacency->pool_used;
+
+    while (adjacency->pool_used + size > adjacency->pool_capacity)
+    {
+        adjacency->pool_capacity = (adjacency->pool_capacity == 0) ? HOST_POOL_INITIAL : adjacency->pool_capacity * 2;
+        adjacency->pool = (uint32_t *)allocate_index_memory(adjacency->pool, adjacency->pool_capacity * sizeof(uint32_t));
+    }
+
+    adjacency->pool_used += size;
+
+    return offset;
+}
+
+static void append_host_flow(host_adjacency_t *adjacency, uint32_t ip, uint32_t flow_id)
+{
+    host_flows_t *host = NULL;
+    uint32_t slot = find_host_slot(adjacency, ip);
+    uint32_t offset = 0;
+
+    if (adjacency->slots[slot] == HOST_SLOT_EMPTY)
+    {
+        if (adjacency->num_hosts == adjacency->capacity)
+        {
+            adjacency->capacity = (adjacency->capacity == 0) ? HOST_TABLE_INITIAL : adjacency->capacity * 2;
+            adjacency->hosts = (host_flows_t *)allocate_index_memory(adjacency->hosts,
+                                                                     adjacency->capacity * sizeof(host_flows_t));
+        }
+
+        host = &adjacency->hosts[adjacency->num_hosts++];
+        host->ip = ip;
+        host->count = 0;
+        host->capacity = HOST_FLOWS_INITIAL;
+        host->offset = reserve_pool(adjacency, HOST_FLOWS_INITIAL);
+        adjacency->slots[slot] = adjacency->num_hosts;
+
+        /* Keep the index at most half full */
+        if (adjacency->num_hosts * 2 > adjacency->num_slots)
+        {
+            grow_host_slots(adjacency);
+        }
+    }
+    else
+    {
+        host = &adjacency->hosts[adjacency->slots[slot] - 1];
+    }
+
+    if (host->count == host->capacity)
+    {
+        if (host->offset + host->capacity == adjacency->pool_used)
+        {
+            reserve_pool(adjacency, host->capacity);
+        }
+        else
+        {
+            offset = reserve_pool(adjacency, host->capacity * 2);
+            memcpy(adjacency->pool + offset, adjacency->pool + host->offset, host->count * sizeof(uint32_t));
+            host->offset = offset;
+        }
+
+        host->capacity *= 2;
+    }
+
+    adjacency->pool[host->offset + host->count++] = flow_id;
+
+    return;
+}
+
+/* Called once per new flow, with the id the table just gave it */
+void index_flow_hosts(host_index_t *host_index, const flow_key_t *key, uint32_t flow_id)
+{
+    if (host_index->has_side[HOST_AS_SOURCE])
+    {
+        append_host_flow(&host_index->sides[HOST_AS_SOURCE], ip_to_uint32(key->source_ip), flow_id);
+    }
+
+    if (host_index->has_side[HOST_AS_DESTINATION])
+    {
+        append_host_flow(&host_index->sides[HOST_AS_DESTINATION], ip_to_uint32(key->destination_ip), flow_id);
+    }
+
+    return;
+}
+
+/* Index the flows of a table filled without the index, one loaded from a snapshot */
+void index_table_hosts(host_index_t *host_index, const hash_table_t *hash_table)
+{
+    uint32_t flow_id = 0;
+
+    for (flow_id = 0; flow_id < hash_table->list.count; flow_id++)
+    {
+        index_flow_hosts(host_index, &list_node(&hash_table->list, flow_id)->key, flow_id);
+    }
+
+    return;
+}
+
+/* The flow ids of ip on one side in first-seen order, NULL with count 0 when there are none */
+const uint32_t *lookup_host_flows(const host_index_t *host_index, host_side_t side, uint32_t ip, uint32_t *count)
+{
+    const host_adjacency_t *adjacency = &host_index->sides[side];
+    const host_flows_t *host = NULL;
+    uint32_t slot = find_host_slot(adjacency, ip);
+
+    *count = 0;
+
+    if (adjacency->slots[slot] == HOST_SLOT_EMPTY)
+    {
+        return NULL;
+    }
+
+    host = &adjacency->hosts[adjacency->slots[slot] - 1];
+    *count = host->count;
+
+    return adjacency->pool + host->offset;
+}
+
+/* Parse a comma separated list of IPv4 addresses */
+bool_t parse_host_queries(const char *text, uint32_t *hosts, uint32_t *num_hosts)
+{
+    const char *end = NULL;
+    size_t len = 0;
+    uint32_t prefix_len = 0;
+
+    if (text == NULL || *text == '\0')
+    {
+        return false;
+    }
+
+    *num_hosts = 0;
+
+    while (*text != '\0')
+    {
+        end = strchr(text, ',');
+        len = (end != NULL) ? (size_t)(end - text) : strlen(text);
+
+        if (*num_hosts == MAX_HOST_QUERIES || memchr(text, '/', len) != NULL ||
+            !parse_ipv4_prefix(text, len, &hosts[*num_hosts], &prefix_len))
+        {
+            return false;
+        }
+
+        (*num_hosts)++;
+        text += len + (end != NULL);
+    }
+
+    return end == NULL;
+}
+
+static void print_host_side(const hash_table_t *hash_table, const host_index_t *host_index, host_side_t side,
+                            uint32_t ip)
+{
+    const data_list_node_t *node = NULL;
+    const uint32_t *flow_ids = NULL;
+    char title[HOST_TITLE_SIZE];
+    uint32_t width = LIST_NUMBER_WIDTH + key_columns_width(hash_table->schema) + COUNT_COLUMN_WIDTH;
+    uint64_t total = 0;
+    uint32_t count = 0;
+    uint32_t flow = 0;
+
+    flow_ids = lookup_host_flows(host_index, side, ip, &count);
+    snprintf(title, sizeof(title), "%s %u.%u.%u.%u", host_side_titles[side], ip >> 24, (ip >> 16) & 0xFF,
+             (ip >> 8) & 0xFF, ip & 0xFF);
+
+    print_table_rule(width);
+    print_table_title(title, (width - 2 - (uint32_t)strlen(title)) / 2, width);
+    fputs("+-----", stdout);
+    print_key_rule(hash_table->schema);
+    puts("+--------------+");
+    fputs("|  No ", stdout);
+    print_key_heading(hash_table->schema);
+    puts("| Packet Count |");
+    fputs("+-----", stdout);
+    print_key_rule(hash_table->schema);
+    puts("+--------------+");
+
+    for (flow = 0; flow < count; flow++)
+    {
+        node = list_node(&hash_table->list, flow_ids[flow]);
+        printf("| %3u ", flow + 1);
+        print_key_cells(&node->key, hash_table->schema);
+        printf("| %12u |\n", node->ref_count);
+        fputs("+-----", stdout);
+        print_key_rule(hash_table->schema);
+        puts("+--------------+");
+        total += node->ref_count;
+    }
+
+    printf("Flows: %u, Packets: %llu\n", count, (unsigned long long)total);
+
+    return;
+}
+
+/* Every flow ip sent and received, each side in first-seen order */
+void print_host_flows(const hash_table_t *hash_table, const host_index_t *host_index, uint32_t ip)
+{
+    uint32_t side = 0;
+
+    for (side = 0; side < NUM_HOST_SIDES; side++)
+    {
+        if (host_index->has_side[side])
+        {
+            print_host_side(hash_table, host_index, (host_side_t)side, ip);
+        }
+    }
+
+    return;
+}
+
+/* Hosts per side and the memory of both sides */
+void print_host_index_stats(const host_index_t *host_index)
+{
+    const host_adjacency_t *adjacency = NULL;
+    size_t bytes = 0;
+    uint32_t side = 0;
+
+    for (side = 0; side < NUM_HOST_SIDES; side++)
+    {
+        adjacency = &host_index->sides[side];
+        bytes += adjacency->capacity * sizeof(host_flows_t) + adjacency->num_slots * sizeof(uint32_t) +
+                 adjacency->pool_capacity * sizeof(uint32_t);
+    }
+
+    fprintf(stderr, "Indexed sources: %u, Indexed destinations: %u, Host index: %zu bytes\n",
+            host_index->sides[HOST_AS_SOURCE].num_hosts, host_index->sides[HOST_AS_DESTINATION].num_hosts, bytes);
+
+    return;
+}
+
+void free_host_index(host_index_t *host_index)
+{
+    uint32_t side = 0;
+
+    for (side = 0; side < NUM_HOST_SIDES; side++)
+    {
+        free(host_index->sides[side].hosts);
+        free(host_index->sides[side].slots);
+        free(host_index->sides[side].pool);
+    }
+
+    memset(host_index, 0, sizeof(host_index_t));
+
+    return;
+}
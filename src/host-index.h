@@ -0,0 +1,64 @@
+#ifndef HOST_INDEX_H_INCLUDED
+#define HOST_INDEX_H_INCLUDED
+
+#include <stdint.h>
+#include "hash.h"
+
+#define MAX_HOST_QUERIES 16
+#define HOST_FLOWS_INITIAL 2
+#define HOST_POOL_INITIAL 4096
+#define HOST_TABLE_INITIAL 1024
+#define HOST_SLOT_EMPTY 0
+
+typedef enum
+{
+    HOST_AS_SOURCE = 0,
+    HOST_AS_DESTINATION,
+    NUM_HOST_SIDES
+} host_side_t;
+
+/* The flow ids of one host are the count entries of the pool from offset */
+typedef struct host_flows
+{
+    uint32_t ip;
+    uint32_t offset;
+    uint32_t count;
+    uint32_t capacity;
+} host_flows_t;
+
+/* Adjacency of one side: an open-addressing index of host + 1 over hosts,
+ * and one shared pool of flow ids in which every host owns a contiguous run.
+ * A full run doubles in place when it is the last one in the pool and moves
+ * to the end otherwise, so appends stay amortised O(1) with no per-host
+ * allocation, and a host's flows are read as one array. */
+typedef struct host_adjacency
+{
+    host_flows_t *hosts;
+    uint32_t num_hosts;
+    uint32_t capacity;
+    uint32_t *slots;
+    uint32_t num_slots;
+    uint32_t *pool;
+    uint32_t pool_used;
+    uint32_t pool_capacity;
+} host_adjacency_t;
+
+/* Flows by source and by destination address, appended as the table creates
+ * them, so a lookup costs one probe plus the flows it returns. A side the
+ * key schema does not keep is left empty. */
+struct host_index
+{
+    host_adjacency_t sides[NUM_HOST_SIDES];
+    bool_t has_side[NUM_HOST_SIDES];
+};
+
+void init_host_index(host_index_t *host_index, key_schema_t schema);
+void index_flow_hosts(host_index_t *host_index, const flow_key_t *key, uint32_t flow_id);
+void index_table_hosts(host_index_t *host_index, const hash_table_t *hash_table);
+const uint32_t *lookup_host_flows(const host_index_t *host_index, host_side_t side, uint32_t ip, uint32_t *count);
+bool_t parse_host_queries(const char *text, uint32_t *hosts, uint32_t *num_hosts);
+void print_host_flows(const hash_table_t *hash_table, const host_index_t *host_index, uint32_t ip);
+void print_host_index_stats(const host_index_t *host_index);
+void free_host_index(host_index_t *host_index);
+
+#endif // HOST_INDEX_H_INCLUDED
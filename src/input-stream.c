@@ -0,0 +1,493 @@
+/* fseeko() and off_t are hidden by a strict -std=c11 */
+#define _DEFAULT_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include "input-stream.h"
+
+/* Built with -DHAVE_ZLIB (link -lz) and/or -DHAVE_ZSTD (link -lzstd) */
+#ifndef HAVE_ZLIB
+    #define HAVE_ZLIB 0
+#endif
+
+#ifndef HAVE_ZSTD
+    #define HAVE_ZSTD 0
+#endif
+
+#if HAVE_ZLIB
+    #include <zlib.h>
+#endif
+
+#if HAVE_ZSTD
+    #include <zstd.h>
+#endif
+
+#define GZIP_WINDOW_BITS (15 + 16)
+
+typedef struct decompressor
+{
+    compression_t compression;
+#if HAVE_ZLIB
+    z_stream gzip;
+#endif
+#if HAVE_ZSTD
+    ZSTD_DStream *zstd;
+#endif
+} decompressor_t;
+
+static const char *const compression_names[] = {"plain", "gzip", "zstd"};
+static const char *const compression_flags[] = {"", "-DHAVE_ZLIB and -lz", "-DHAVE_ZSTD and -lzstd"};
+
+static bool_t is_compression_supported(compression_t compression);
+static bool_t init_decompressor(decompressor_t *decompressor, compression_t compression);
+static bool_t decompress_step(decompressor_t *decompressor, const uint8_t *input, size_t input_len, size_t *consumed,
+                              uint8_t *output, size_t output_len, size_t *produced, bool_t *is_frame_end);
+static void free_decompressor(decompressor_t *decompressor);
+static void *decompress_main(void *argument);
+static bool_t next_chunk(input_stream_t *stream);
+
+/* gzip starts with 1f 8b, a zstd frame with 28 b5 2f fd */
+compression_t detect_compression(const uint8_t *bytes, size_t len)
+{
+    if (len >= 2 && bytes[0] == 0x1F && bytes[1] == 0x8B)
+    {
+        return COMPRESSION_GZIP;
+    }
+
+    if (len >= 4 && bytes[0] == 0x28 && bytes[1] == 0xB5 && bytes[2] == 0x2F && bytes[3] == 0xFD)
+    {
+        return COMPRESSION_ZSTD;
+    }
+
+    return COMPRESSION_NONE;
+}
+
+static bool_t is_compression_supported(compression_t compression)
+{
+    switch (compression)
+    {
+    case COMPRESSION_GZIP:
+        return HAVE_ZLIB;
+
+    case COMPRESSION_ZSTD:
+        return HAVE_ZSTD;
+
+    case COMPRESSION_NONE:
+    default:
+        return true;
+    }
+}
+
+static bool_t init_decompressor(decompressor_t *decompressor, compression_t compression)
+{
+    memset(decompressor, 0, sizeof(decompressor_t));
+    decompressor->compression = compression;
+
+#if HAVE_ZLIB
+    if (compression == COMPRESSION_GZIP)
+    {
+        return inflateInit2(&decompressor->gzip, GZIP_WINDOW_BITS) == Z_OK;
+    }
+#endif
+#if HAVE_ZSTD
+    if (compression == COMPRESSION_ZSTD)
+    {
+        decompressor->zstd = ZSTD_createDStream();
+
+        return decompressor->zstd != NULL && !ZSTD_isError(ZSTD_initDStream(decompressor->zstd));
+    }
+#endif
+
+    return false;
+}
+
+/* Inflate as much of input into output as fits, false on corrupt data.
+ * is_frame_end is set when a gzip member or zstd frame has been fully
+ * written out; another one may follow, as in a concatenated .gz. */
+static bool_t decompress_step(decompressor_t *decompressor, const uint8_t *input, size_t input_len, size_t *consumed,
+                              uint8_t *output, size_t output_len, size_t *produced, bool_t *is_frame_end)
+{
+    *consumed = 0;
+    *produced = 0;
+    *is_frame_end = false;
+
+#if HAVE_ZLIB
+    if (decompressor->compression == COMPRESSION_GZIP)
+    {
+        z_stream *gzip = &decompressor->gzip;
+        int status = Z_OK;
+
+        gzip->next_in = (Bytef *)input;
+        gzip->avail_in = (uInt)input_len;
+        gzip->next_out = output;
+        gzip->avail_out = (uInt)output_len;
+        status = inflate(gzip, Z_NO_FLUSH);
+        *consumed = input_len - gzip->avail_in;
+        *produced = output_len - gzip->avail_out;
+
+        if (status == Z_STREAM_END)
+        {
+            *is_frame_end = true;
+
+            return inflateReset(gzip) == Z_OK;
+        }
+
+        /* No progress is only expected when there was no input to make it with */
+        return status == Z_OK || (status == Z_BUF_ERROR && input_len == 0);
+    }
+#endif
+#if HAVE_ZSTD
+    if (decompressor->compression == COMPRESSION_ZSTD)
+    {
+        ZSTD_inBuffer in = {input, input_len, 0};
+        ZSTD_outBuffer out = {output, output_len, 0};
+        size_t hint = ZSTD_decompressStream(decompressor->zstd, &out, &in);
+
+        *consumed = in.pos;
+        *produced = out.pos;
+        *is_frame_end = (hint == 0);
+
+        return !ZSTD_isError(hint);
+    }
+#endif
+
+    (void)decompressor;
+    (void)input;
+    (void)input_len;
+    (void)output;
+    (void)output_len;
+
+    return false;
+}
+
+static void free_decompressor(decompressor_t *decompressor)
+{
+#if HAVE_ZLIB
+    if (decompressor->compression == COMPRESSION_GZIP)
+    {
+        inflateEnd(&decompressor->gzip);
+    }
+#endif
+#if HAVE_ZSTD
+    if (decompressor->compression == COMPRESSION_ZSTD)
+    {
+        ZSTD_freeDStream(decompressor->zstd);
+    }
+#endif
+
+    (void)decompressor;
+
+    return;
+}
+
+/* Decompressor thread: take a free chunk, fill it completely, hand it to the
+ * reader and repeat. A NULL on the full ring ends the stream. */
+static void *decompress_main(void *argument)
+{
+    input_stream_t *stream = (input_stream_t *)argument;
+    decompressor_t decompressor;
+    input_chunk_t *chunk = NULL;
+    uint8_t *input = NULL;
+    size_t input_len = 0;
+    size_t input_position = 0;
+    size_t consumed = 0;
+    size_t produced = 0;
+    bool_t is_frame_end = false;
+    bool_t is_frame_open = false;
+    bool_t is_output_full = false;
+    bool_t is_ok = true;
+
+    input = (uint8_t *)malloc(INPUT_CHUNK_SIZE);
+
+    if (input == NULL)
+    {
+        perror("Memory allocation failed for decompression buffer");
+        exit(EXIT_FAILURE);
+    }
+
+    if (!init_decompressor(&decompressor, stream->compression))
+    {
+        perror("Failed to start decompression");
+        exit(EXIT_FAILURE);
+    }
+
+    /* The magic bytes were already read to pick the format */
+    memcpy(input, stream->magic, stream->magic_len);
+    input_len = stream->magic_len;
+    chunk = (input_chunk_t *)pop_spsc_ring(&stream->free_ring);
+    chunk->len = 0;
+
+    while (is_ok && !atomic_load_explicit(&stream->is_stopping, memory_order_relaxed))
+    {
+        /* A full chunk may have left output inside the decoder, drain it before reading on */
+        if (input_position == input_len && !is_output_full)
+        {
+            input_len = fread(input, 1, INPUT_CHUNK_SIZE, stream->file);
+            input_position = 0;
+
+            if (input_len == 0)
+            {
+                break;
+            }
+        }
+
+        is_ok = decompress_step(&decompressor, input + input_position, input_len - input_position, &consumed,
+                                chunk->data + chunk->len, INPUT_CHUNK_SIZE - chunk->len, &produced, &is_frame_end);
+        input_position += consumed;
+        chunk->len += produced;
+        is_frame_open = (is_frame_end == false) && (is_frame_open || consumed > 0 || produced > 0);
+        is_output_full = (chunk->len == INPUT_CHUNK_SIZE);
+
+        if (is_output_full)
+        {
+            push_spsc_ring(&stream->full_ring, chunk);
+            chunk = (input_chunk_t *)pop_spsc_ring(&stream->free_ring);
+            chunk->len = 0;
+        }
+    }
+
+    /* A reader that stopped early does not care how the stream ends */
+    if (!atomic_load_explicit(&stream->is_stopping, memory_order_relaxed) &&
+        (!is_ok || is_frame_open || ferror(stream->file)))
+    {
+        fprintf(stderr, "Error decompressing file: %s (%s)\n", stream->file_name,
+                is_ok ? "truncated" : "corrupt data");
+        stream->is_failed = true;
+    }
+
+    if (chunk->len > 0)
+    {
+        push_spsc_ring(&stream->full_ring, chunk);
+    }
+
+    push_spsc_ring(&stream->full_ring, NULL);
+    free_decompressor(&decompressor);
+    free(input);
+
+    return NULL;
+}
+
+/* Open a file for reading from the start, a compressed one behind a decompressor thread */
+bool_t open_input_stream(input_stream_t *stream, const char *file_name)
+{
+    uint32_t chunk = 0;
+
+    memset(stream, 0, sizeof(input_stream_t));
+    atomic_init(&stream->is_stopping, false);
+    stream->file_name = file_name;
+    stream->file = fopen(file_name, "rb");
+
+    if (stream->file == NULL)
+    {
+        fprintf(stderr, "Error opening file: %s\n", file_name);
+
+        return false;
+    }
+
+    stream->magic_len = fread(stream->magic, 1, COMPRESSION_MAGIC_SIZE, stream->file);
+    stream->compression = detect_compression(stream->magic, stream->magic_len);
+
+    if (!is_compression_supported(stream->compression))
+    {
+        fprintf(stderr, "%s is %s compressed, rebuild with %s to read it\n", file_name,
+                compression_names[stream->compression], compression_flags[stream->compression]);
+        fclose(stream->file);
+        stream->file = NULL;
+
+        return false;
+    }
+
+    /* A plain file is read through one buffer that starts with the bytes already looked at */
+    if (stream->compression == COMPRESSION_NONE)
+    {
+        stream->buffer = (uint8_t *)malloc(INPUT_CHUNK_SIZE);
+
+        if (stream->buffer == NULL)
+        {
+            perror("Memory allocation failed for input buffer");
+            exit(EXIT_FAILURE);
+        }
+
+        memcpy(stream->buffer, stream->magic, stream->magic_len);
+        stream->data = stream->buffer;
+        stream->len = stream->magic_len;
+
+        return true;
+    }
+
+    stream->chunks = (input_chunk_t *)malloc(INPUT_STREAM_CHUNKS * sizeof(input_chunk_t));
+
+    if (stream->chunks == NULL)
+    {
+        perror("Memory allocation failed for decompression chunks");
+        exit(EXIT_FAILURE);
+    }
+
+    /* Room for every chunk plus the closing NULL */
+    init_spsc_ring(&stream->free_ring, INPUT_STREAM_CHUNKS);
+    init_spsc_ring(&stream->full_ring, INPUT_STREAM_CHUNKS + 1);
+
+    for (chunk = 0; chunk < INPUT_STREAM_CHUNKS; chunk++)
+    {
+        push_spsc_ring(&stream->free_ring, &stream->chunks[chunk]);
+    }
+
+    if (pthread_create(&stream->thread, NULL, decompress_main, stream) != 0)
+    {
+        perror("Failed to start decompression thread");
+        exit(EXIT_FAILURE);
+    }
+
+    return true;
+}
+
+/* Move on to the next buffer of data, false at the end of the stream */
+static bool_t next_chunk(input_stream_t *stream)
+{
+    if (stream->is_eof)
+    {
+        return false;
+    }
+
+    stream->position = 0;
+
+    if (stream->compression == COMPRESSION_NONE)
+    {
+        stream->len = fread(stream->buffer, 1, INPUT_CHUNK_SIZE, stream->file);
+
+        if (stream->len == 0 && ferror(stream->file))
+        {
+            fprintf(stderr, "Error reading file: %s\n", stream->file_name);
+            stream->is_failed = true;
+        }
+
+        stream->is_eof = (stream->len == 0);
+
+        return !stream->is_eof;
+    }
+
+    /* The chunk just read goes back to the decompressor */
+    if (stream->chunk != NULL)
+    {
+        push_spsc_ring(&stream->free_ring, stream->chunk);
+    }
+
+    stream->chunk = (input_chunk_t *)pop_spsc_ring(&stream->full_ring);
+    stream->is_eof = (stream->chunk == NULL);
+    stream->data = (stream->chunk != NULL) ? stream->chunk->data : NULL;
+    stream->len = (stream->chunk != NULL) ? stream->chunk->len : 0;
+
+    return !stream->is_eof;
+}
+
+/* Go to offset of a plain file before anything was read from it, false when
+ * the file is compressed or shorter than offset */
+bool_t seek_input_stream(input_stream_t *stream, uint64_t offset)
+{
+    if (stream->compression != COMPRESSION_NONE)
+    {
+        return false;
+    }
+
+    if (fseeko(stream->file, 0, SEEK_END) != 0 || (uint64_t)ftello(stream->file) < offset ||
+        fseeko(stream->file, (off_t)offset, SEEK_SET) != 0)
+    {
+        return false;
+    }
+
+    /* The magic bytes kept in the buffer are before offset */
+    stream->position = 0;
+    stream->len = 0;
+    stream->is_eof = false;
+
+    return true;
+}
+
+/* Same contract as fread: fewer than size bytes only at the end of the stream */
+size_t read_input_stream(input_stream_t *stream, void *buffer, size_t size)
+{
+    size_t count = 0;
+    size_t take = 0;
+
+    while (count < size)
+    {
+        if (stream->position == stream->len && !next_chunk(stream))
+        {
+            break;
+        }
+
+        take = stream->len - stream->position;
+        take = (take < size - count) ? take : size - count;
+        memcpy((uint8_t *)buffer + count, stream->data + stream->position, take);
+        stream->position += take;
+        count += take;
+    }
+
+    return count;
+}
+
+/* Same contract as fgets: up to size - 1 characters, the newline included */
+bool_t read_input_line(input_stream_t *stream, char *line, size_t size)
+{
+    const uint8_t *newline = NULL;
+    size_t count = 0;
+    size_t take = 0;
+
+    while (count + 1 < size)
+    {
+        if (stream->position == stream->len && !next_chunk(stream))
+        {
+            break;
+        }
+
+        take = stream->len - stream->position;
+        take = (take < size - 1 - count) ? take : size - 1 - count;
+        newline = (const uint8_t *)memchr(stream->data + stream->position, '\n', take);
+
+        if (newline != NULL)
+        {
+            take = (size_t)(newline - (stream->data + stream->position)) + 1;
+        }
+
+        memcpy(line + count, stream->data + stream->position, take);
+        stream->position += take;
+        count += take;
+
+        if (newline != NULL)
+        {
+            break;
+        }
+    }
+
+    line[count] = '\0';
+
+    return count > 0;
+}
+
+void close_input_stream(input_stream_t *stream)
+{
+    if (stream->chunks != NULL)
+    {
+        /* Stop a decompressor that is still running and take back its chunks */
+        atomic_store_explicit(&stream->is_stopping, true, memory_order_relaxed);
+
+        while (next_chunk(stream))
+        {
+        }
+
+        pthread_join(stream->thread, NULL);
+        free_spsc_ring(&stream->free_ring);
+        free_spsc_ring(&stream->full_ring);
+        free(stream->chunks);
+    }
+
+    if (stream->file != NULL)
+    {
+        fclose(stream->file);
+    }
+
+    free(stream->buffer);
+    memset(stream, 0, sizeof(input_stream_t));
+
+    return;
+}
@@ -0,0 +1,60 @@
+#ifndef INPUT_STREAM_H_INCLUDED
+#define INPUT_STREAM_H_INCLUDED
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "packets.h"
+#include "spsc-ring.h"
+
+#define INPUT_CHUNK_SIZE (256 * 1024)
+#define INPUT_STREAM_CHUNKS 8
+#define COMPRESSION_MAGIC_SIZE 4
+
+typedef enum
+{
+    COMPRESSION_NONE = 0,
+    COMPRESSION_GZIP,
+    COMPRESSION_ZSTD
+} compression_t;
+
+typedef struct input_chunk
+{
+    uint8_t data[INPUT_CHUNK_SIZE];
+    size_t len;
+} input_chunk_t;
+
+/* A file read front to back, gzip and zstd files decompressed on the fly.
+ * The format is told by the first bytes, never by the name. A compressed
+ * file is inflated by its own thread into INPUT_STREAM_CHUNKS fixed chunks
+ * that go round two rings: filled ones to the reader, read ones back, so
+ * decompression runs ahead of parsing and nothing is written to disk. */
+typedef struct input_stream
+{
+    FILE *file;
+    const char *file_name;
+    compression_t compression;
+    uint8_t magic[COMPRESSION_MAGIC_SIZE];
+    size_t magic_len;
+    const uint8_t *data;
+    size_t position;
+    size_t len;
+    uint8_t *buffer;
+    input_chunk_t *chunks;
+    input_chunk_t *chunk;
+    spsc_ring_t full_ring;
+    spsc_ring_t free_ring;
+    pthread_t thread;
+    _Atomic bool_t is_stopping;
+    bool_t is_failed;
+    bool_t is_eof;
+} input_stream_t;
+
+compression_t detect_compression(const uint8_t *bytes, size_t len);
+bool_t open_input_stream(input_stream_t *stream, const char *file_name);
+bool_t seek_input_stream(input_stream_t *stream, uint64_t offset);
+size_t read_input_stream(input_stream_t *stream, void *buffer, size_t size);
+bool_t read_input_line(input_stream_t *stream, char *line, size_t size);
+void close_input_stream(input_stream_t *stream);
+
+#endif // INPUT_STREAM_H_INCLUDED
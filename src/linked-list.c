@@ -4,104 +4,111 @@
 #include "linked-list.h"
 #include "packets.h"
 
-data_list_node_t *data_list_node_root = NULL;
-data_list_node_t *data_list_node_tail = NULL;
-
-/* Insert a new node into the linked list */
-void insert_into_linked_list(data_list_node_t **list, const key_ip_pair_t *ip_pair)
+void init_linked_list(data_list_t *list, arena_t *arena)
 {
-    data_list_node_t *new_node = NULL;
+    list->blocks = NULL;
+    list->num_blocks = 0;
+    list->blocks_capacity = 0;
+    list->count = 0;
+    list->arena = arena;
 
-    new_node = (data_list_node_t *)calloc(STRUCT_MULTIPLIER, sizeof(data_list_node_t));
-
-    if (new_node == NULL)
-    {
-        perror("Memory allocation failed for new list node");
-        exit(EXIT_FAILURE);
-    }
+    return;
+}
 
-    new_node->ip_pair = (key_ip_pair_t *)calloc(STRUCT_MULTIPLIER, sizeof(key_ip_pair_t));
+/* Append a new flow to the list and return its flow id */
+uint32_t insert_into_linked_list(data_list_t *list, const flow_key_t *key)
+{
+    data_list_node_t **new_blocks = NULL;
+    data_list_node_t *new_node = NULL;
+    uint32_t new_capacity = 0;
 
-    if (new_node->ip_pair == NULL)
+    /* The current block is full, carve the next one out of the arena */
+    if ((list->count & LIST_BLOCK_MASK) == 0 && (list->count >> LIST_BLOCK_SHIFT) == list->num_blocks)
     {
-        perror("Memory allocation failed for IP pair");
-        free(new_node);
-        new_node = NULL;
-        exit(EXIT_FAILURE);
+        if (list->num_blocks == list->blocks_capacity)
+        {
+            new_capacity = (list->blocks_capacity == 0) ? LIST_INITIAL_CAPACITY : list->blocks_capacity * LIST_MULTIPLIER;
+            new_blocks = (data_list_node_t **)realloc(list->blocks, new_capacity * sizeof(data_list_node_t *));
+
+            if (new_blocks == NULL)
+            {
+                perror("Memory allocation failed for new list node");
+                exit(EXIT_FAILURE);
+            }
+
+            list->blocks = new_blocks;
+            list->blocks_capacity = new_capacity;
+        }
+
+        list->blocks[list->num_blocks++] =
+            (data_list_node_t *)arena_alloc(list->arena, LIST_BLOCK_NODES * sizeof(data_list_node_t));
     }
 
-    /* Copying the provided IP pair data into the new node */
-    memcpy(new_node->ip_pair, ip_pair, sizeof(key_ip_pair_t));
+    /* Copying the provided key into the new node */
+    new_node = list_node(list, list->count);
+    memcpy(&new_node->key, key, sizeof(flow_key_t));
     new_node->ref_count = INITIAL_VALUE;
-    new_node->next = NULL;
-
-    /* Setting the list pointer to the new node for hashing purpose*/
-    *list = new_node;
-
-    if (data_list_node_root == NULL)
-    {
-        data_list_node_root = new_node;
-    }
-    else
-    {
-        data_list_node_tail->next = new_node;
-    }
 
-    /* Updating the tail pointer to the new node */
-    data_list_node_tail = new_node;
-
-    return;
+    return list->count++;
 }
 
 /*Printing the Linked List*/
-void print_linked_list(void)
+void print_linked_list(const data_list_t *list, key_schema_t schema)
 {
-    data_list_node_t *current = data_list_node_root;
+    const data_list_node_t *current = NULL;
     uint32_t serial = 0;
     uint32_t total_counter = 0;
-
-    puts("+------------------------------------------------------------+");
-    puts("|                      Linked List                           |");
-    puts("+-----+-------------------+-------------------+--------------+");
-    puts("|  No |     Source IP     |   Destination IP  | Packet Count |");
-    puts("+-----+-------------------+-------------------+--------------+");
-
-    while (current != NULL)
+    uint32_t width = LIST_NUMBER_WIDTH + key_columns_width(schema) + COUNT_COLUMN_WIDTH;
+    uint32_t total_pad = 0;
+
+    print_table_rule(width);
+    print_table_title("Linked List", key_title_pad(LIST_TITLE_PAD, schema), width);
+    fputs("+-----", stdout);
+    print_key_rule(schema);
+    puts("+--------------+");
+    fputs("|  No ", stdout);
+    print_key_heading(schema);
+    puts("| Packet Count |");
+    fputs("+-----", stdout);
+    print_key_rule(schema);
+    puts("+--------------+");
+
+    for (serial = 0; serial < list->count; serial++)
     {
-        printf("| %3u |  %3hhu.%3hhu.%3hhu.%3hhu  |  %3hhu.%3hhu.%3hhu.%3hhu  | %12u |\n",
-               ++serial,
-               current->ip_pair->source_ip[0], current->ip_pair->source_ip[1],
-               current->ip_pair->source_ip[2], current->ip_pair->source_ip[3],
-               current->ip_pair->destination_ip[0], current->ip_pair->destination_ip[1],
-               current->ip_pair->destination_ip[2], current->ip_pair->destination_ip[3],
-               current->ref_count);
-        puts("+-----+-------------------+-------------------+--------------+");
+        current = list_node(list, serial);
+        printf("| %3u ", serial + 1);
+        print_key_cells(&current->key, schema);
+        printf("| %12u |\n", current->ref_count);
+        fputs("+-----", stdout);
+        print_key_rule(schema);
+        puts("+--------------+");
 
         total_counter += current->ref_count;
-        current = current->next;
     }
 
-    printf("|               Total Packet Count            | %12u |\n", total_counter);
-    puts("+---------------------------------------------+--------------+");
+    total_pad = key_title_pad(LIST_TOTAL_PAD, schema);
+    printf("|%*s%-*s| %12u |\n", (int)total_pad, "", (int)(width - COUNT_COLUMN_WIDTH - 1 - total_pad),
+           "Total Packet Count", total_counter);
+    putchar('+');
+
+    for (serial = 0; serial < width - COUNT_COLUMN_WIDTH - 1; serial++)
+    {
+        putchar('-');
+    }
+
+    puts("+--------------+");
 
     return;
 }
 
-/* Free the linked list */
-void free_linked_list(data_list_node_t *list)
+/* Free the linked list, the nodes themselves go with the arena */
+void free_linked_list(data_list_t *list)
 {
-    data_list_node_t *temp = NULL;
-
-    /* Begin traversing the list to free each node */
-    while (list != NULL)
-    {
-        temp = list;
-        free(list->ip_pair);
-        list->ip_pair = NULL;
-        list = list->next;
-        free(temp);
-        temp = NULL;
-    }
+    free(list->blocks);
+    list->blocks = NULL;
+    list->num_blocks = 0;
+    list->blocks_capacity = 0;
+    list->count = 0;
 
     return;
 }
@@ -3,27 +3,45 @@
 
 #include <stdint.h>
 #include "packets.h"
+#include "flow-key.h"
+#include "arena.h"
 
 #define INITIAL_VALUE 1
+#define LIST_INITIAL_CAPACITY 16
+#define LIST_MULTIPLIER 2
+#define LIST_BLOCK_SHIFT 12
+#define LIST_BLOCK_NODES (1U << LIST_BLOCK_SHIFT)
+#define LIST_BLOCK_MASK (LIST_BLOCK_NODES - 1)
+#define LIST_NUMBER_WIDTH 6
+#define LIST_TITLE_PAD 22
+#define LIST_TOTAL_PAD 15
 
-typedef struct key_ip_pair
-{
-    uint8_t source_ip[IP_SECTION_SIZE];
-    uint8_t destination_ip[IP_SECTION_SIZE];
-} key_ip_pair_t;
-
+/* One flow, stored inline; its position in the list is the flow id */
 typedef struct data_list_node
 {
-    key_ip_pair_t *ip_pair;
+    flow_key_t key;
     uint32_t ref_count;
-    struct data_list_node *next;
 } data_list_node_t;
 
-extern data_list_node_t *data_list_node_root;
-extern data_list_node_t *data_list_node_tail;
+/* Flows in first-seen order, carved LIST_BLOCK_NODES at a time out of the
+ * owning table's arena so nodes never move and teardown is a few frees */
+typedef struct data_list
+{
+    data_list_node_t **blocks;
+    uint32_t num_blocks;
+    uint32_t blocks_capacity;
+    uint32_t count;
+    arena_t *arena;
+} data_list_t;
+
+static inline data_list_node_t *list_node(const data_list_t *list, uint32_t flow_id)
+{
+    return &list->blocks[flow_id >> LIST_BLOCK_SHIFT][flow_id & LIST_BLOCK_MASK];
+}
 
-void insert_into_linked_list(data_list_node_t **list, const key_ip_pair_t *ip_pair);
-void print_linked_list(void);
-void free_linked_list(data_list_node_t *list);
+void init_linked_list(data_list_t *list, arena_t *arena);
+uint32_t insert_into_linked_list(data_list_t *list, const flow_key_t *key);
+void print_linked_list(const data_list_t *list, key_schema_t schema);
+void free_linked_list(data_list_t *list);
 
 #endif // LINKED_LIST_H_INCLUDED
\ No newline at end of file
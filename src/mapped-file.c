@@ -0,0 +1,185 @@
+/* madvise() and MADV_SEQUENTIAL are hidden by a strict -std=c11 */
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "mapped-file.h"
+
+#if defined(_WIN32)
+    #define HAVE_MMAP 0
+#else
+    #define HAVE_MMAP 1
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+static bool_t read_whole_file(const char *file_name, mapped_file_t *mapped_file);
+static bool_t map_regular_file(const char *file_name, mapped_file_t *mapped_file, bool_t is_writable);
+
+/* Fallback for platforms without mmap: read the file into one heap buffer */
+static bool_t read_whole_file(const char *file_name, mapped_file_t *mapped_file)
+{
+    FILE *file = NULL;
+    uint8_t *buffer = NULL;
+    long file_size = 0;
+
+    file = fopen(file_name, "rb");
+
+    if (file == NULL)
+    {
+        fprintf(stderr, "Error opening file: %s\n", file_name);
+
+        return false;
+    }
+
+    if (fseek(file, 0, SEEK_END) != 0 || (file_size = ftell(file)) < 0 || fseek(file, 0, SEEK_SET) != 0)
+    {
+        fprintf(stderr, "Error reading file: %s\n", file_name);
+        fclose(file);
+
+        return false;
+    }
+
+    buffer = (uint8_t *)malloc(file_size > 0 ? (size_t)file_size : 1);
+
+    if (buffer == NULL)
+    {
+        perror("Memory allocation failed for file buffer");
+        fclose(file);
+
+        return false;
+    }
+
+    if (fread(buffer, 1, (size_t)file_size, file) != (size_t)file_size)
+    {
+        fprintf(stderr, "Error reading file: %s\n", file_name);
+        free(buffer);
+        fclose(file);
+
+        return false;
+    }
+
+    fclose(file);
+    mapped_file->data = buffer;
+    mapped_file->size = (size_t)file_size;
+    mapped_file->is_mapped = false;
+
+    return true;
+}
+
+static bool_t map_regular_file(const char *file_name, mapped_file_t *mapped_file, bool_t is_writable)
+{
+#if HAVE_MMAP
+    int fd = -1;
+    struct stat file_stat;
+    void *address = NULL;
+
+    mapped_file->data = NULL;
+    mapped_file->size = 0;
+    mapped_file->is_mapped = false;
+
+    fd = open(file_name, O_RDONLY);
+
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    if (fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode))
+    {
+        close(fd);
+
+        return false;
+    }
+
+    if (file_stat.st_size == 0)
+    {
+        close(fd);
+
+        return true;
+    }
+
+    /* Writes to a private mapping go to copies of the pages, never to the file */
+    address = mmap(NULL, (size_t)file_stat.st_size, is_writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_PRIVATE,
+                   fd, 0);
+    close(fd);
+
+    if (address == MAP_FAILED)
+    {
+        return false;
+    }
+
+    /* A read-only mapping is an input scanned front to back exactly once */
+    if (!is_writable)
+    {
+        madvise(address, (size_t)file_stat.st_size, MADV_SEQUENTIAL);
+    }
+
+    mapped_file->data = (const uint8_t *)address;
+    mapped_file->size = (size_t)file_stat.st_size;
+    mapped_file->is_mapped = true;
+
+    return true;
+#else
+    (void)file_name;
+    (void)is_writable;
+    mapped_file->data = NULL;
+    mapped_file->size = 0;
+    mapped_file->is_mapped = false;
+
+    return false;
+#endif
+}
+
+/* Map a regular file read-only, false without a message when it cannot be
+ * mapped (a pipe, a special file, a platform without mmap) */
+bool_t try_map_file(const char *file_name, mapped_file_t *mapped_file)
+{
+    return map_regular_file(file_name, mapped_file, false);
+}
+
+/* Map a whole file read-only into memory, or read it into one buffer when it cannot be mapped */
+bool_t map_file(const char *file_name, mapped_file_t *mapped_file)
+{
+    if (try_map_file(file_name, mapped_file))
+    {
+        return true;
+    }
+
+    return read_whole_file(file_name, mapped_file);
+}
+
+/* Like map_file, but the memory may be written; the file itself never changes */
+bool_t map_file_private(const char *file_name, mapped_file_t *mapped_file)
+{
+    if (map_regular_file(file_name, mapped_file, true))
+    {
+        return true;
+    }
+
+    return read_whole_file(file_name, mapped_file);
+}
+
+void unmap_file(mapped_file_t *mapped_file)
+{
+#if HAVE_MMAP
+    if (mapped_file->is_mapped)
+    {
+        munmap((void *)mapped_file->data, mapped_file->size);
+    }
+    else
+    {
+        free((void *)mapped_file->data);
+    }
+#else
+    free((void *)mapped_file->data);
+#endif
+
+    mapped_file->data = NULL;
+    mapped_file->size = 0;
+    mapped_file->is_mapped = false;
+
+    return;
+}
\ No newline at end of file
@@ -0,0 +1,20 @@
+#ifndef MAPPED_FILE_H_INCLUDED
+#define MAPPED_FILE_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+#include "packets.h"
+
+typedef struct mapped_file
+{
+    const uint8_t *data;
+    size_t size;
+    bool_t is_mapped;
+} mapped_file_t;
+
+bool_t try_map_file(const char *file_name, mapped_file_t *mapped_file);
+bool_t map_file(const char *file_name, mapped_file_t *mapped_file);
+bool_t map_file_private(const char *file_name, mapped_file_t *mapped_file);
+void unmap_file(mapped_file_t *mapped_file);
+
+#endif // MAPPED_FILE_H_INCLUDED
\ No newline at end of file
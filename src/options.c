@@ -0,0 +1,408 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "options.h"
+#include "file-handler.h"
+#include "pcap-reader.h"
+#include "capture-stream.h"
+#include "parallel-ingest.h"
+#include "pipeline.h"
+#include "flow-stats.h"
+#include "heavy-hitters.h"
+#include "sampling.h"
+
+static bool_t parse_count(const char *text, uint32_t min, uint32_t max, uint32_t *value);
+static bool_t is_capture_source(const char *source);
+
+/* Parse a decimal count within [min, max] */
+static bool_t parse_count(const char *text, uint32_t min, uint32_t max, uint32_t *value)
+{
+    char *end = NULL;
+    unsigned long parsed = 0;
+
+    if (text == NULL)
+    {
+        return false;
+    }
+
+    parsed = strtoul(text, &end, 10);
+
+    if (*text == '\0' || *end != '\0' || parsed < min || parsed > max)
+    {
+        return false;
+    }
+
+    *value = (uint32_t)parsed;
+
+    return true;
+}
+
+/* Standard input is always read as a capture, it cannot be looked at first */
+static bool_t is_capture_source(const char *source)
+{
+    return strcmp(source, CAPTURE_STDIN) == 0 || is_capture_file(source);
+}
+
+void print_usage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [options] [capture.pcap|capture.pcapng|-|exported-packets.txt[.gz|.zst]]\n", program);
+    fputs("    -     Read a pcap or pcapng capture from standard input, e.g. tcpdump -w - | ...\n", stderr);
+    fputs("    -t    Two-pass mode: convert the export to " INPUT_FILE " and parse that file\n", stderr);
+    fputs("    -v    Print flow table statistics to stderr\n", stderr);
+    fputs("    -j N  Split " INPUT_FILE " across N threads with private tables (implies -t)\n", stderr);
+    fputs("    -S    With -j, share one CAS-based table between the threads instead of merging\n", stderr);
+    fputs("    -p N  Pipeline " INPUT_FILE ": reader thread, N decoder threads, aggregator (implies -t)\n", stderr);
+    fputs("    -k K  Aggregate flows by K: src, dst, pair (default), dport (destination IP + port), 5tuple\n", stderr);
+    fputs("    -s L  Per-flow statistics, comma separated: bytes, size (min/max), ttl, tos, all\n", stderr);
+    fputs("    -H N  Approximate mode in fixed memory: report the top N flows with error bounds\n", stderr);
+    fputs("    -c N  Estimate distinct peers per host, report the N biggest fan-outs and fan-ins\n", stderr);
+    fputs("    -r N  Keep only 1 in N IP pairs, chosen by hash before decoding; counts become estimates\n", stderr);
+    fputs("    -R S  Seed of the -r sampling hash (default 0), the same seed keeps the same pairs\n", stderr);
+    fputs("    -u V  Subnet roll-ups, comma separated: src/N, dst/N, pair/N, src/N@A.B.C.D/M\n", stderr);
+    fputs("    -q H  After the tables, list the flows from and to each comma separated address in H\n", stderr);
+    fputs("    -f F  Count only packets matching F, e.g. \"not port 53,137-138 and src net 10.0.0.0/8\"\n", stderr);
+    fputs("    -w F  Save the counted flow table to F as a snapshot\n", stderr);
+    fputs("    -l F  Report from the snapshot F instead of reading packets (-k must match the saved key)\n", stderr);
+    fputs("    -C    With -l, verify the checksum of the whole snapshot, not only its header\n", stderr);
+    fputs("    -a F  Append mode: count only what was added to the export since the checkpoint F, then update F\n", stderr);
+    fputs("    -F    With -a, keep following the export as it grows until interrupted\n", stderr);
+    fputs("    -P N  With a capture or -, print a partial report every N packets (SIGUSR1 prints one any time)\n", stderr);
+
+    return;
+}
+
+/* Fill the run options from the command line, defaults stream PACKET_FILE */
+bool_t parse_options(int argc, char *argv[], options_t *options)
+{
+    int iteration = 0;
+
+    options->mode = INGEST_STREAM;
+    options->source_file = PACKET_FILE;
+    options->verbose = false;
+    options->num_threads = 1;
+    options->is_shared_table = false;
+    options->num_decoders = 0;
+    options->key_schema = KEY_IP_PAIR;
+    options->stats_columns = 0;
+    options->num_top_flows = 0;
+    options->num_fan_hosts = 0;
+    options->sample_rate = 0;
+    options->sample_seed = DEFAULT_SAMPLE_SEED;
+    options->filter_text = NULL;
+    options->num_subnet_views = 0;
+    options->num_host_queries = 0;
+    options->snapshot_file = NULL;
+    options->save_file = NULL;
+    options->is_snapshot_checked = false;
+    options->checkpoint_file = NULL;
+    options->is_following = false;
+    options->report_interval = 0;
+
+    for (iteration = 1; iteration < argc; iteration++)
+    {
+        if (strcmp(argv[iteration], "-t") == 0)
+        {
+            options->mode = INGEST_TWO_PASS;
+        }
+        else if (strcmp(argv[iteration], "-v") == 0)
+        {
+            options->verbose = true;
+        }
+        else if (strcmp(argv[iteration], "-j") == 0)
+        {
+            if (!parse_count(argv[++iteration], 1, MAX_THREADS, &options->num_threads))
+            {
+                fprintf(stderr, "-j expects a thread count from 1 to %d\n", MAX_THREADS);
+
+                return false;
+            }
+
+            options->mode = INGEST_TWO_PASS;
+        }
+        else if (strcmp(argv[iteration], "-p") == 0)
+        {
+            if (!parse_count(argv[++iteration], 1, MAX_DECODERS, &options->num_decoders))
+            {
+                fprintf(stderr, "-p expects a decoder count from 1 to %d\n", MAX_DECODERS);
+
+                return false;
+            }
+
+            options->mode = INGEST_TWO_PASS;
+        }
+        else if (strcmp(argv[iteration], "-k") == 0)
+        {
+            if (!parse_key_schema(argv[++iteration], &options->key_schema))
+            {
+                fputs("-k expects one of src, dst, pair, dport, 5tuple\n", stderr);
+
+                return false;
+            }
+        }
+        else if (strcmp(argv[iteration], "-s") == 0)
+        {
+            if (!parse_stats_columns(argv[++iteration], &options->stats_columns))
+            {
+                fputs("-s expects a comma separated list of bytes, size, ttl, tos or all\n", stderr);
+
+                return false;
+            }
+        }
+        else if (strcmp(argv[iteration], "-H") == 0)
+        {
+            if (!parse_count(argv[++iteration], 1, MAX_TOP_FLOWS, &options->num_top_flows))
+            {
+                fprintf(stderr, "-H expects a flow count from 1 to %d\n", MAX_TOP_FLOWS);
+
+                return false;
+            }
+        }
+        else if (strcmp(argv[iteration], "-c") == 0)
+        {
+            if (!parse_count(argv[++iteration], 1, UINT32_MAX, &options->num_fan_hosts))
+            {
+                fputs("-c expects a host count of at least 1\n", stderr);
+
+                return false;
+            }
+        }
+        else if (strcmp(argv[iteration], "-r") == 0)
+        {
+            if (!parse_count(argv[++iteration], 1, MAX_SAMPLE_RATE, &options->sample_rate))
+            {
+                fprintf(stderr, "-r expects a sampling rate from 1 to %d\n", MAX_SAMPLE_RATE);
+
+                return false;
+            }
+        }
+        else if (strcmp(argv[iteration], "-R") == 0)
+        {
+            if (!parse_count(argv[++iteration], 0, UINT32_MAX, &options->sample_seed))
+            {
+                fputs("-R expects a seed from 0 to 4294967295\n", stderr);
+
+                return false;
+            }
+        }
+        else if (strcmp(argv[iteration], "-u") == 0)
+        {
+            if (!parse_subnet_views(argv[++iteration], options->subnet_views, &options->num_subnet_views))
+            {
+                fprintf(stderr, "-u expects up to %d of src/N, dst/N or pair/N (N up to 32), src and dst "
+                                "optionally @A.B.C.D/M with M at most N\n", MAX_SUBNET_VIEWS);
+
+                return false;
+            }
+        }
+        else if (strcmp(argv[iteration], "-q") == 0)
+        {
+            if (!parse_host_queries(argv[++iteration], options->host_queries, &options->num_host_queries))
+            {
+                fprintf(stderr, "-q expects up to %d comma separated IPv4 addresses\n", MAX_HOST_QUERIES);
+
+                return false;
+            }
+        }
+        else if (strcmp(argv[iteration], "-f") == 0)
+        {
+            options->filter_text = argv[++iteration];
+
+            if (options->filter_text == NULL)
+            {
+                fputs("-f expects a filter expression\n", stderr);
+
+                return false;
+            }
+        }
+        else if (strcmp(argv[iteration], "-w") == 0)
+        {
+            options->save_file = argv[++iteration];
+
+            if (options->save_file == NULL)
+            {
+                fputs("-w expects a snapshot file\n", stderr);
+
+                return false;
+            }
+        }
+        else if (strcmp(argv[iteration], "-l") == 0)
+        {
+            options->snapshot_file = argv[++iteration];
+
+            if (options->snapshot_file == NULL)
+            {
+                fputs("-l expects a snapshot file\n", stderr);
+
+                return false;
+            }
+        }
+        else if (strcmp(argv[iteration], "-C") == 0)
+        {
+            options->is_snapshot_checked = true;
+        }
+        else if (strcmp(argv[iteration], "-a") == 0)
+        {
+            options->checkpoint_file = argv[++iteration];
+
+            if (options->checkpoint_file == NULL)
+            {
+                fputs("-a expects a checkpoint file\n", stderr);
+
+                return false;
+            }
+        }
+        else if (strcmp(argv[iteration], "-F") == 0)
+        {
+            options->is_following = true;
+        }
+        else if (strcmp(argv[iteration], "-P") == 0)
+        {
+            if (!parse_count(argv[++iteration], 1, UINT32_MAX, &options->report_interval))
+            {
+                fputs("-P expects a packet count of at least 1\n", stderr);
+
+                return false;
+            }
+        }
+        else if (strcmp(argv[iteration], "-S") == 0)
+        {
+            options->is_shared_table = true;
+        }
+        else if (argv[iteration][0] == '-' && strcmp(argv[iteration], CAPTURE_STDIN) != 0)
+        {
+            fprintf(stderr, "Unknown option: %s\n", argv[iteration]);
+
+            return false;
+        }
+        else
+        {
+            options->source_file = argv[iteration];
+        }
+    }
+
+    /* The table is only shared between -j threads, one thread has nothing to share it with */
+    if (options->is_shared_table && options->num_threads < 2)
+    {
+        fputs("-S needs -j with 2 or more threads\n", stderr);
+
+        return false;
+    }
+
+    /* The shared table only keeps counts */
+    if (options->is_shared_table && options->stats_columns != 0)
+    {
+        fputs("-s cannot be combined with -S\n", stderr);
+
+        return false;
+    }
+
+    /* The heavy hitter set has no flow ids for statistics and is not merged across threads */
+    if (options->num_top_flows != 0 && (options->stats_columns != 0 || options->num_threads > 1))
+    {
+        fputs("-H cannot be combined with -s or -j\n", stderr);
+
+        return false;
+    }
+
+    /* The index is filled with the exact table's flow ids */
+    if (options->num_top_flows != 0 && options->num_host_queries != 0)
+    {
+        fputs("-q cannot be combined with -H\n", stderr);
+
+        return false;
+    }
+
+    /* Roll-ups are built from the exact table's flows and need the addresses they group by */
+    for (iteration = 0; iteration < (int)options->num_subnet_views; iteration++)
+    {
+        if (options->num_top_flows != 0 || !is_subnet_view_supported(&options->subnet_views[iteration], options->key_schema))
+        {
+            fputs("-u cannot be combined with -H, and needs -k to keep the addresses it groups by\n", stderr);
+
+            return false;
+        }
+    }
+
+    /* A snapshot holds finished counts of the exact table, nothing is ingested */
+    if (options->snapshot_file != NULL &&
+        (options->mode != INGEST_STREAM || options->is_shared_table || options->num_top_flows != 0 ||
+         options->stats_columns != 0 || options->num_fan_hosts != 0 || options->sample_rate != 0 ||
+         options->filter_text != NULL))
+    {
+        fputs("-l cannot be combined with -t, -j, -p, -S, -H, -s, -c, -r or -f\n", stderr);
+
+        return false;
+    }
+
+    if (options->save_file != NULL && options->num_top_flows != 0)
+    {
+        fputs("-w cannot be combined with -H\n", stderr);
+
+        return false;
+    }
+
+    if (options->is_snapshot_checked && options->snapshot_file == NULL)
+    {
+        fputs("-C needs -l\n", stderr);
+
+        return false;
+    }
+
+    /* Only the streamed text export can be read from an offset, and only the
+     * exact table's counts are kept in the checkpoint. The checkpoint does not
+     * record a sampling rate or filter, so a later run could not be held to them. */
+    if (options->checkpoint_file != NULL &&
+        (options->mode != INGEST_STREAM || options->is_shared_table || options->num_top_flows != 0 ||
+         options->stats_columns != 0 || options->num_fan_hosts != 0 || options->sample_rate != 0 ||
+         options->filter_text != NULL || options->snapshot_file != NULL || options->save_file != NULL ||
+         is_capture_source(options->source_file)))
+    {
+        fputs("-a cannot be combined with -t, -j, -p, -S, -H, -s, -c, -r, -f, -l, -w or a capture file\n", stderr);
+
+        return false;
+    }
+
+    if (options->is_following && options->checkpoint_file == NULL)
+    {
+        fputs("-F needs -a\n", stderr);
+
+        return false;
+    }
+
+    /* Partial reports are taken between reads of a capture */
+    if (options->report_interval != 0 && (options->snapshot_file != NULL || !is_capture_source(options->source_file)))
+    {
+        fputs("-P needs a capture file or - and cannot be combined with -l\n", stderr);
+
+        return false;
+    }
+
+    /* A capture is read as it is, there is no input.txt for these to split */
+    if (options->mode == INGEST_TWO_PASS && options->snapshot_file == NULL && is_capture_source(options->source_file))
+    {
+        fputs("-t, -j and -p cannot be combined with a capture file or -\n", stderr);
+
+        return false;
+    }
+
+    if (options->snapshot_file != NULL)
+    {
+        options->mode = INGEST_SNAPSHOT;
+    }
+    else if (options->checkpoint_file != NULL)
+    {
+        options->mode = INGEST_APPEND;
+    }
+    else if (strcmp(options->source_file, CAPTURE_STDIN) == 0 || options->report_interval != 0)
+    {
+        /* A pipe cannot be mapped, it is read as it comes */
+        options->mode = INGEST_CAPTURE_STREAM;
+    }
+    else if (is_capture_file(options->source_file))
+    {
+        /* A binary capture is read directly, without the text export */
+        options->mode = INGEST_CAPTURE;
+    }
+
+    return true;
+}
\ No newline at end of file
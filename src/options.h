@@ -0,0 +1,49 @@
+#ifndef OPTIONS_H_INCLUDED
+#define OPTIONS_H_INCLUDED
+
+#include "packets.h"
+#include "flow-key.h"
+#include "subnet-trie.h"
+#include "host-index.h"
+
+typedef enum
+{
+    INGEST_STREAM = 0,
+    INGEST_TWO_PASS,
+    INGEST_CAPTURE,
+    INGEST_SNAPSHOT,
+    INGEST_APPEND,
+    INGEST_CAPTURE_STREAM
+} ingest_mode_t;
+
+typedef struct options
+{
+    ingest_mode_t mode;
+    const char *source_file;
+    bool_t verbose;
+    uint32_t num_threads;
+    bool_t is_shared_table;
+    uint32_t num_decoders;
+    key_schema_t key_schema;
+    uint32_t stats_columns;
+    uint32_t num_top_flows;
+    uint32_t num_fan_hosts;
+    uint32_t sample_rate;
+    uint32_t sample_seed;
+    const char *filter_text;
+    subnet_view_t subnet_views[MAX_SUBNET_VIEWS];
+    uint32_t num_subnet_views;
+    uint32_t host_queries[MAX_HOST_QUERIES];
+    uint32_t num_host_queries;
+    const char *snapshot_file;
+    const char *save_file;
+    bool_t is_snapshot_checked;
+    const char *checkpoint_file;
+    bool_t is_following;
+    uint32_t report_interval;
+} options_t;
+
+bool_t parse_options(int argc, char *argv[], options_t *options);
+void print_usage(const char *program);
+
+#endif // OPTIONS_H_INCLUDED
\ No newline at end of file
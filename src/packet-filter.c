@@ -0,0 +1,478 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "packet-filter.h"
+
+#define FILTER_DELIMITERS " \t\r\n"
+#define MAX_PREFIX_LEN 32
+
+static void *allocate_zeroed(size_t count, size_t size)
+{
+    void *memory = calloc(count, size);
+
+    if (memory == NULL)
+    {
+        perror("Failed to allocate packet filter");
+        exit(EXIT_FAILURE);
+    }
+
+    return memory;
+}
+
+static void set_bit_range(uint64_t *bitmap, uint32_t first, uint32_t last)
+{
+    uint32_t bit = 0;
+
+    for (bit = first; bit <= last; bit++)
+    {
+        bitmap[bit >> 6] |= 1ULL << (bit & 63);
+    }
+
+    return;
+}
+
+/* Parse N or N-M, both at most max */
+static bool_t parse_range(const char *text, size_t len, uint32_t max, uint32_t *first, uint32_t *last)
+{
+    char buffer[32];
+    char *end = NULL;
+    unsigned long low = 0;
+    unsigned long high = 0;
+
+    if (len == 0 || len >= sizeof(buffer) || text[0] < '0' || text[0] > '9')
+    {
+        return false;
+    }
+
+    memcpy(buffer, text, len);
+    buffer[len] = '\0';
+    low = strtoul(buffer, &end, 10);
+    high = low;
+
+    if (*end == '-' && end[1] >= '0' && end[1] <= '9')
+    {
+        high = strtoul(end + 1, &end, 10);
+    }
+
+    if (*end != '\0' || low > high || high > max)
+    {
+        return false;
+    }
+
+    *first = (uint32_t)low;
+    *last = (uint32_t)high;
+
+    return true;
+}
+
+/* Parse A.B.C.D or A.B.C.D/len into an address with its host bits cleared */
+bool_t parse_ipv4_prefix(const char *text, size_t len, uint32_t *address, uint32_t *prefix_len)
+{
+    char buffer[32];
+    char *cursor = buffer;
+    char *end = NULL;
+    unsigned long octet = 0;
+    unsigned long bits = MAX_PREFIX_LEN;
+    uint32_t iteration = 0;
+
+    if (len == 0 || len >= sizeof(buffer))
+    {
+        return false;
+    }
+
+    memcpy(buffer, text, len);
+    buffer[len] = '\0';
+    *address = 0;
+
+    for (iteration = 0; iteration < IP_SECTION_SIZE; iteration++)
+    {
+        if (iteration > 0 && *cursor++ != '.')
+        {
+            return false;
+        }
+
+        if (*cursor < '0' || *cursor > '9')
+        {
+            return false;
+        }
+
+        octet = strtoul(cursor, &end, 10);
+
+        if (octet > UINT8_MAX)
+        {
+            return false;
+        }
+
+        *address = (*address << 8) | (uint32_t)octet;
+        cursor = end;
+    }
+
+    if (*cursor == '/')
+    {
+        if (cursor[1] < '0' || cursor[1] > '9')
+        {
+            return false;
+        }
+
+        bits = strtoul(cursor + 1, &end, 10);
+        cursor = end;
+    }
+
+    if (*cursor != '\0' || bits > MAX_PREFIX_LEN)
+    {
+        return false;
+    }
+
+    *prefix_len = (uint32_t)bits;
+    *address &= (bits == 0) ? 0 : (uint32_t)(UINT32_MAX << (MAX_PREFIX_LEN - bits));
+
+    return true;
+}
+
+static bool_t is_token(const char *token, size_t len, const char *word)
+{
+    return len == strlen(word) && strncmp(token, word, len) == 0;
+}
+
+static bool_t parse_protocol(const char *text, size_t len, uint32_t *protocol)
+{
+    uint32_t last = 0;
+
+    if (is_token(text, len, "udp"))
+    {
+        *protocol = UDP_PROTOCOL;
+    }
+    else if (is_token(text, len, "tcp"))
+    {
+        *protocol = TCP_PROTOCOL;
+    }
+    else if (is_token(text, len, "icmp"))
+    {
+        *protocol = ICMP_PROTOCOL;
+    }
+    else
+    {
+        return parse_range(text, len, UINT8_MAX, protocol, &last) && last == *protocol;
+    }
+
+    return true;
+}
+
+/* Add one prefix to the set. Up to /24 it marks whole tbl24 entries, which
+ * also absorbs any tbl8 group under them; a longer one moves its /24 to a
+ * tbl8 group, if the /24 is not already fully in the set, and marks bytes. */
+static bool_t add_prefix(prefix_table_t *prefixes, uint32_t address, uint32_t prefix_len)
+{
+    uint32_t first = address >> TBL24_SHIFT;
+    uint32_t entry = 0;
+    uint8_t *group = NULL;
+
+    if (prefix_len <= MAX_PREFIX_LEN - TBL24_SHIFT)
+    {
+        for (entry = first; entry < first + (1U << (MAX_PREFIX_LEN - TBL24_SHIFT - prefix_len)); entry++)
+        {
+            prefixes->tbl24[entry] = 1;
+        }
+
+        return true;
+    }
+
+    if (prefixes->tbl24[first] == 1)
+    {
+        return true;
+    }
+
+    if (prefixes->tbl24[first] == 0)
+    {
+        if (prefixes->num_tbl8 == MAX_TBL8_GROUPS)
+        {
+            fprintf(stderr, "Filter has more than %d /24s with longer prefixes\n", MAX_TBL8_GROUPS);
+
+            return false;
+        }
+
+        prefixes->tbl8 = realloc(prefixes->tbl8, (size_t)(prefixes->num_tbl8 + 1) * TBL8_GROUP_SIZE);
+
+        if (prefixes->tbl8 == NULL)
+        {
+            perror("Failed to allocate packet filter");
+            exit(EXIT_FAILURE);
+        }
+
+        memset(prefixes->tbl8 + (size_t)prefixes->num_tbl8 * TBL8_GROUP_SIZE, 0, TBL8_GROUP_SIZE);
+        prefixes->tbl24[first] = (uint16_t)(prefixes->num_tbl8 + TBL8_GROUP_BASE);
+        prefixes->num_tbl8++;
+    }
+
+    group = prefixes->tbl8 + (size_t)(prefixes->tbl24[first] - TBL8_GROUP_BASE) * TBL8_GROUP_SIZE;
+    memset(group + (address & (TBL8_GROUP_SIZE - 1)), 1, 1U << (MAX_PREFIX_LEN - prefix_len));
+
+    return true;
+}
+
+/* Compile one comma separated list of text_len bytes into the clause's set */
+static bool_t compile_clause_list(filter_clause_t *clause, const char *text, size_t text_len)
+{
+    const char *limit = text + text_len;
+    const char *end = NULL;
+    size_t len = 0;
+    uint32_t first = 0;
+    uint32_t last = 0;
+
+    while (text < limit)
+    {
+        end = memchr(text, ',', (size_t)(limit - text));
+        len = (end != NULL) ? (size_t)(end - text) : (size_t)(limit - text);
+
+        switch (clause->field)
+        {
+        case FILTER_NET:
+        case FILTER_SOURCE_NET:
+        case FILTER_DESTINATION_NET:
+            if (!parse_ipv4_prefix(text, len, &first, &last) || !add_prefix(&clause->prefixes, first, last))
+            {
+                return false;
+            }
+            break;
+
+        case FILTER_PROTOCOL:
+            if (!parse_protocol(text, len, &first))
+            {
+                return false;
+            }
+            set_bit_range(clause->bitmap, first, first);
+            break;
+
+        case FILTER_PORT:
+        case FILTER_SOURCE_PORT:
+        case FILTER_DESTINATION_PORT:
+        case FILTER_LENGTH:
+        default:
+            if (!parse_range(text, len, UINT16_MAX, &first, &last))
+            {
+                return false;
+            }
+            set_bit_range(clause->bitmap, first, last);
+            break;
+        }
+
+        text += len + (end != NULL);
+    }
+
+    return end == NULL;
+}
+
+/* Next word of the expression, len is 0 at the end */
+static const char *next_token(const char **cursor, size_t *len)
+{
+    const char *token = *cursor + strspn(*cursor, FILTER_DELIMITERS);
+
+    *len = strcspn(token, FILTER_DELIMITERS);
+    *cursor = token + *len;
+
+    return token;
+}
+
+/* Field of a keyword, direction is 0, 1 (src) or 2 (dst) */
+static bool_t parse_field(const char *keyword, size_t len, uint32_t direction, filter_field_t *field)
+{
+    if (is_token(keyword, len, "port"))
+    {
+        *field = (filter_field_t)(FILTER_PORT + direction);
+    }
+    else if (is_token(keyword, len, "net") || is_token(keyword, len, "host"))
+    {
+        *field = (filter_field_t)(FILTER_NET + direction);
+    }
+    else if (is_token(keyword, len, "proto") && direction == 0)
+    {
+        *field = FILTER_PROTOCOL;
+    }
+    else if (is_token(keyword, len, "len") && direction == 0)
+    {
+        *field = FILTER_LENGTH;
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+static void init_clause(filter_clause_t *clause, filter_field_t field, bool_t is_negated)
+{
+    clause->field = field;
+    clause->is_negated = is_negated;
+
+    if (field == FILTER_NET || field == FILTER_SOURCE_NET || field == FILTER_DESTINATION_NET)
+    {
+        clause->prefixes.tbl24 = allocate_zeroed(TBL24_SIZE, sizeof(uint16_t));
+    }
+    else
+    {
+        clause->bitmap = allocate_zeroed((field == FILTER_PROTOCOL) ? PROTOCOL_BITMAP_WORDS : PORT_BITMAP_WORDS,
+                                         sizeof(uint64_t));
+    }
+
+    return;
+}
+
+/* Compile "CLAUSE [and CLAUSE]..." where CLAUSE is [not] [src|dst] port LIST,
+ * [not] [src|dst] net LIST (host is the same), [not] proto LIST or
+ * [not] len LIST. Errors are reported on stderr and leave nothing allocated. */
+bool_t compile_packet_filter(const char *text, packet_filter_t *filter)
+{
+    const char *cursor = text;
+    const char *token = NULL;
+    size_t len = 0;
+    bool_t is_negated = false;
+    uint32_t direction = 0;
+    filter_field_t field = FILTER_PORT;
+    filter_clause_t *clause = NULL;
+
+    memset(filter, 0, sizeof(packet_filter_t));
+
+    if (text == NULL)
+    {
+        return false;
+    }
+
+    do
+    {
+        token = next_token(&cursor, &len);
+        is_negated = (is_token(token, len, "not") || is_token(token, len, "!"));
+        token = is_negated ? next_token(&cursor, &len) : token;
+        direction = is_token(token, len, "src") ? 1 : (is_token(token, len, "dst") ? 2 : 0);
+        token = (direction != 0) ? next_token(&cursor, &len) : token;
+
+        if (!parse_field(token, len, direction, &field))
+        {
+            fprintf(stderr, "Filter expects port, net, host, proto or len, not \"%.*s\"\n", (int)len, token);
+            free_packet_filter(filter);
+
+            return false;
+        }
+
+        if (filter->num_clauses == MAX_FILTER_CLAUSES)
+        {
+            fprintf(stderr, "Filter has more than %d clauses\n", MAX_FILTER_CLAUSES);
+            free_packet_filter(filter);
+
+            return false;
+        }
+
+        clause = &filter->clauses[filter->num_clauses++];
+        init_clause(clause, field, is_negated);
+        token = next_token(&cursor, &len);
+
+        if (len == 0 || !compile_clause_list(clause, token, len))
+        {
+            fprintf(stderr, "Filter has an invalid list \"%.*s\"\n", (int)len, token);
+            free_packet_filter(filter);
+
+            return false;
+        }
+
+        token = next_token(&cursor, &len);
+
+        if (len != 0 && !is_token(token, len, "and") && !is_token(token, len, "&&"))
+        {
+            fprintf(stderr, "Filter expects \"and\" between clauses, not \"%.*s\"\n", (int)len, token);
+            free_packet_filter(filter);
+
+            return false;
+        }
+    } while (len != 0);
+
+    return true;
+}
+
+static bool_t is_clause_true(const filter_clause_t *clause, uint32_t source_ip, uint32_t destination_ip,
+                             uint16_t source_port, uint16_t destination_port, uint8_t protocol, uint16_t ip_len)
+{
+    switch (clause->field)
+    {
+    case FILTER_PORT:
+        return is_bit_set(clause->bitmap, source_port) || is_bit_set(clause->bitmap, destination_port);
+
+    case FILTER_SOURCE_PORT:
+        return is_bit_set(clause->bitmap, source_port);
+
+    case FILTER_DESTINATION_PORT:
+        return is_bit_set(clause->bitmap, destination_port);
+
+    case FILTER_NET:
+        return is_in_prefix_table(&clause->prefixes, source_ip) || is_in_prefix_table(&clause->prefixes, destination_ip);
+
+    case FILTER_SOURCE_NET:
+        return is_in_prefix_table(&clause->prefixes, source_ip);
+
+    case FILTER_DESTINATION_NET:
+        return is_in_prefix_table(&clause->prefixes, destination_ip);
+
+    case FILTER_PROTOCOL:
+        return is_bit_set(clause->bitmap, protocol);
+
+    case FILTER_LENGTH:
+    default:
+        return is_bit_set(clause->bitmap, ip_len);
+    }
+}
+
+/* A NULL filter accepts everything */
+bool_t is_packet_accepted(const packet_filter_t *filter, uint32_t source_ip, uint32_t destination_ip,
+                          uint16_t source_port, uint16_t destination_port, uint8_t protocol, uint16_t ip_len)
+{
+    uint32_t iteration = 0;
+
+    for (iteration = 0; filter != NULL && iteration < filter->num_clauses; iteration++)
+    {
+        if (is_clause_true(&filter->clauses[iteration], source_ip, destination_ip, source_port, destination_port,
+                           protocol, ip_len) == filter->clauses[iteration].is_negated)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool_t is_descriptor_accepted(const packet_filter_t *filter, const packet_descriptor_t *descriptor)
+{
+    return is_packet_accepted(filter, ip_to_uint32(descriptor->source_ip), ip_to_uint32(descriptor->destination_ip),
+                              descriptor->source_port, descriptor->destination_port, descriptor->protocol,
+                              descriptor->ip_len);
+}
+
+/* One bit per lane of a parsed batch, set when the filter keeps it */
+uint32_t filter_header_batch(const packet_filter_t *filter, const header_batch_t *batch)
+{
+    uint32_t accepted_mask = 0;
+    uint32_t lane = 0;
+
+    for (lane = 0; lane < batch->count; lane++)
+    {
+        accepted_mask |= (uint32_t)is_packet_accepted(filter, batch->source_ip[lane], batch->destination_ip[lane],
+                                                      batch->source_port[lane], batch->destination_port[lane],
+                                                      batch->protocol[lane], batch->ip_len[lane]) << lane;
+    }
+
+    return accepted_mask;
+}
+
+void free_packet_filter(packet_filter_t *filter)
+{
+    uint32_t iteration = 0;
+
+    for (iteration = 0; iteration < filter->num_clauses; iteration++)
+    {
+        free(filter->clauses[iteration].bitmap);
+        free(filter->clauses[iteration].prefixes.tbl24);
+        free(filter->clauses[iteration].prefixes.tbl8);
+    }
+
+    memset(filter, 0, sizeof(packet_filter_t));
+
+    return;
+}
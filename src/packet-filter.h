@@ -0,0 +1,84 @@
+#ifndef PACKET_FILTER_H_INCLUDED
+#define PACKET_FILTER_H_INCLUDED
+
+#include <stdint.h>
+#include "packets.h"
+#include "header-batch.h"
+
+#define MAX_FILTER_CLAUSES 16
+#define PORT_BITMAP_WORDS ((UINT16_MAX + 1) / 64)
+#define PROTOCOL_BITMAP_WORDS ((UINT8_MAX + 1) / 64)
+#define TBL24_SHIFT 8
+#define TBL24_SIZE (1U << 24)
+#define TBL8_GROUP_SIZE 256
+#define TBL8_GROUP_BASE 2
+#define MAX_TBL8_GROUPS (UINT16_MAX + 1 - TBL8_GROUP_BASE)
+
+typedef enum
+{
+    FILTER_PORT = 0,
+    FILTER_SOURCE_PORT,
+    FILTER_DESTINATION_PORT,
+    FILTER_NET,
+    FILTER_SOURCE_NET,
+    FILTER_DESTINATION_NET,
+    FILTER_PROTOCOL,
+    FILTER_LENGTH
+} filter_field_t;
+
+/* Membership of one address in a set of prefixes, DIR-24-8 style: tbl24 has
+ * one entry per /24, 0 (not in the set), 1 (whole /24 in the set) or
+ * TBL8_GROUP_BASE + g when prefixes longer than /24 need tbl8 group g, one
+ * byte per address. A lookup is one or two loads. tbl24 is 32 MiB of zeroed
+ * virtual memory of which only the /24s named in the filter are touched. */
+typedef struct prefix_table
+{
+    uint16_t *tbl24;
+    uint8_t *tbl8;
+    uint32_t num_tbl8;
+} prefix_table_t;
+
+/* One field tested against one set: ports and lengths in a 64K bit bitmap,
+ * protocols in a 256 bit one, addresses in a prefix table */
+typedef struct filter_clause
+{
+    filter_field_t field;
+    bool_t is_negated;
+    uint64_t *bitmap;
+    prefix_table_t prefixes;
+} filter_clause_t;
+
+/* A packet is kept when every clause holds, so a filter is a flat list of
+ * lookups with no expression tree to walk */
+struct packet_filter
+{
+    filter_clause_t clauses[MAX_FILTER_CLAUSES];
+    uint32_t num_clauses;
+};
+
+bool_t parse_ipv4_prefix(const char *text, size_t len, uint32_t *address, uint32_t *prefix_len);
+bool_t compile_packet_filter(const char *text, packet_filter_t *filter);
+bool_t is_packet_accepted(const packet_filter_t *filter, uint32_t source_ip, uint32_t destination_ip,
+                          uint16_t source_port, uint16_t destination_port, uint8_t protocol, uint16_t ip_len);
+bool_t is_descriptor_accepted(const packet_filter_t *filter, const packet_descriptor_t *descriptor);
+uint32_t filter_header_batch(const packet_filter_t *filter, const header_batch_t *batch);
+void free_packet_filter(packet_filter_t *filter);
+
+static inline bool_t is_bit_set(const uint64_t *bitmap, uint32_t bit)
+{
+    return (bitmap[bit >> 6] >> (bit & 63)) & 1;
+}
+
+static inline bool_t is_in_prefix_table(const prefix_table_t *prefixes, uint32_t ip)
+{
+    uint16_t entry = prefixes->tbl24[ip >> TBL24_SHIFT];
+
+    if (entry < TBL8_GROUP_BASE)
+    {
+        return entry;
+    }
+
+    return prefixes->tbl8[(size_t)(entry - TBL8_GROUP_BASE) * TBL8_GROUP_SIZE + (ip & (TBL8_GROUP_SIZE - 1))];
+}
+
+#endif // PACKET_FILTER_H_INCLUDED
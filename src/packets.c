@@ -3,7 +3,6 @@
 #include "packets.h"
 #include "byte-order.h"
 
-static void hex_to_byte_array(const char *hex_strm, uint8_t byte_array[], uint8_t len);
 static void parse_eth_header(ethernet_header_t *ethernet_header, const uint8_t *ethernet_byte_array);
 static void parse_ipv4_header(ipv4_header_t *ipv4_header, const uint8_t *ipv4_byte_array);
 static void parse_udp_header(udp_header_t *udp_header, const uint8_t *udp_byte_array);
@@ -18,19 +17,6 @@ bool_t is_udp(ipv4_header_t *ipv4_header)
     return ipv4_header->protocol == UDP_PROTOCOL;
 }
 
-static void hex_to_byte_array(const char *hex_strm, uint8_t byte_array[], uint8_t len)
-{
-    uint8_t iteration = 0;
-
-    for (iteration = 0; iteration < len; iteration++)
-    {
-        /* sscanf reads 2 hex digits from hex_strm and stores the result in byte_array[iteration] */
-        sscanf(&hex_strm[iteration * 2], "%2hhx", &byte_array[iteration]);
-    }
-
-    return;
-}
-
 static void parse_eth_header(ethernet_header_t *ethernet_header, const uint8_t *ethernet_byte_array)
 {
     memcpy(&ethernet_header->destination_mac, ethernet_byte_array, MAC_SECTION_SIZE);
@@ -89,54 +75,163 @@ static void parse_udp_header(udp_header_t *udp_header, const uint8_t *udp_byte_a
     return;
 }
 
-void process_ethernet_header(const char *input_buffer, ethernet_header_t *ethernet_header)
+/* Find every layer of a frame in one pass: up to two 802.1Q/QinQ tags, then an
+ * IPv4 header with its options or an IPv6 header with its extension headers.
+ * True once the network layer is found and fits in the frame. */
+bool_t decode_layers(const uint8_t *frame, size_t frame_len, packet_layers_t *layers)
 {
-    uint8_t ethernet_byte_array[ETHERNET_HEADER_SIZE] = {0};
+    size_t offset = 2 * MAC_SECTION_SIZE;
+    size_t header_size = 0;
+    uint8_t next_header = 0;
 
-    hex_to_byte_array(input_buffer, ethernet_byte_array, ETHERNET_HEADER_SIZE);
-    parse_eth_header(ethernet_header, ethernet_byte_array);
+    memset(layers, 0, sizeof(packet_layers_t));
+    layers->frame = frame;
+    layers->frame_len = frame_len;
 
-    return;
-}
+    if (frame_len < ETHERNET_HEADER_SIZE)
+    {
+        return false;
+    }
 
-void process_ipv4_header(const char *input_buffer, ipv4_header_t *ipv4_header)
-{
-    uint8_t ipv4_byte_array[IPV4_HEADER_SIZE] = {0};
-    uint8_t *options_byte_array = NULL;
-    uint8_t offset = 0;
+    layers->ether_type = read_be16(frame + offset);
+
+    while ((layers->ether_type == VLAN_PROTOCOL || layers->ether_type == QINQ_PROTOCOL) &&
+           layers->num_vlan_tags < MAX_VLAN_TAGS)
+    {
+        if (frame_len < offset + VLAN_TAG_SIZE + UINT16_T_SIZE)
+        {
+            return false;
+        }
+
+        layers->vlan_ids[layers->num_vlan_tags++] = read_be16(frame + offset + UINT16_T_SIZE) & VLAN_ID_MASK;
+        offset += VLAN_TAG_SIZE;
+        layers->ether_type = read_be16(frame + offset);
+    }
 
-    hex_to_byte_array(input_buffer + ETHERNET_HEADER_SIZE * 2, ipv4_byte_array, IPV4_HEADER_SIZE);
-    parse_ipv4_header(ipv4_header, ipv4_byte_array);
+    offset += UINT16_T_SIZE;
+    layers->network_offset = (uint16_t)offset;
 
-    if (ipv4_header->option_size > 0)
+    if (layers->ether_type == IPV4_PROTOCOL)
     {
-        options_byte_array = (uint8_t *)calloc(1, ipv4_header->option_size);
+        /* A header length below five words is malformed */
+        header_size = (size_t)(frame[offset] & 0xF) * 4;
 
-        if (options_byte_array == NULL)
+        if (frame_len < offset + IPV4_HEADER_SIZE || header_size < IPV4_HEADER_SIZE ||
+            frame_len < offset + header_size)
         {
-            perror("Memory Not Allocated");
-            exit(EXIT_FAILURE);
+            return false;
         }
 
-        offset = ETHERNET_HEADER_SIZE * 2 + IPV4_HEADER_SIZE * 2;
-        hex_to_byte_array(input_buffer + offset, options_byte_array, ipv4_header->option_size);
+        layers->ip_version = 4;
+        layers->protocol = frame[offset + 9];
+        layers->options_offset = (uint16_t)(offset + IPV4_HEADER_SIZE);
+        layers->options_len = (uint16_t)(header_size - IPV4_HEADER_SIZE);
+        layers->transport_offset = (uint16_t)(offset + header_size);
 
-        free(options_byte_array);
-        options_byte_array = NULL;
+        return true;
     }
 
-    return;
+    if (layers->ether_type == IPV6_PROTOCOL)
+    {
+        if (frame_len < offset + IPV6_HEADER_SIZE)
+        {
+            return false;
+        }
+
+        layers->ip_version = 6;
+        next_header = frame[offset + 6];
+        offset += IPV6_HEADER_SIZE;
+        layers->options_offset = (uint16_t)offset;
+
+        /* Step over the extension headers to reach the transport protocol */
+        while (next_header == IPV6_HOP_BY_HOP || next_header == IPV6_ROUTING ||
+               next_header == IPV6_FRAGMENT || next_header == IPV6_DESTINATION_OPTIONS)
+        {
+            if (frame_len < offset + UINT16_T_SIZE)
+            {
+                return false;
+            }
+
+            header_size = (next_header == IPV6_FRAGMENT) ? IPV6_FRAGMENT_HEADER_SIZE : ((size_t)frame[offset + 1] + 1) * 8;
+
+            if (frame_len < offset + header_size)
+            {
+                return false;
+            }
+
+            next_header = frame[offset];
+            offset += header_size;
+        }
+
+        layers->protocol = next_header;
+        layers->options_len = (uint16_t)(offset - layers->options_offset);
+        layers->transport_offset = (uint16_t)offset;
+
+        return true;
+    }
+
+    return false;
+}
+
+/* True with the descriptor filled if the frame is a complete IPv4/UDP packet */
+bool_t describe_frame(const uint8_t *frame, size_t frame_len, packet_descriptor_t *descriptor)
+{
+    packet_layers_t layers;
+    const uint8_t *network = NULL;
+    const uint8_t *transport = NULL;
+
+    if (!decode_layers(frame, frame_len, &layers) || layers.ip_version != 4 ||
+        layers.protocol != UDP_PROTOCOL || layer_transport_len(&layers) < UDP_HEADER_SIZE)
+    {
+        return false;
+    }
+
+    network = layer_network(&layers);
+    transport = layer_transport(&layers);
+    memcpy(descriptor->source_ip, network + 12, IP_SECTION_SIZE);
+    memcpy(descriptor->destination_ip, network + 16, IP_SECTION_SIZE);
+    descriptor->source_port = read_be16(transport);
+    descriptor->destination_port = read_be16(transport + 2);
+    descriptor->ip_len = read_be16(network + 2);
+    descriptor->udp_len = read_be16(transport + 4);
+    descriptor->protocol = layers.protocol;
+    descriptor->ttl = network[8];
+    descriptor->tos = network[1];
+
+    /*If Debug is turned on then this will work*/
+    PRINT_LAYERS(&layers);
+
+    return true;
 }
 
-void process_udp_header(const char *input_buffer, udp_header_t *udp_header, ipv4_header_t *ipv4_header)
+/* The header structs are only filled here, for printing */
+void print_layers(const packet_layers_t *layers)
 {
-    uint8_t offset = 0;
-    uint8_t udp_byte_array[UDP_HEADER_SIZE] = {0};
+    ethernet_header_t ethernet_header = {0};
+    ipv4_header_t ipv4_header = {0};
+    udp_header_t udp_header = {0};
+    uint8_t iteration = 0;
 
-    offset = ETHERNET_HEADER_SIZE;
-    offset += IPV4_HEADER_SIZE + ipv4_header->option_size;
-    hex_to_byte_array(input_buffer + offset * 2, udp_byte_array, UDP_HEADER_SIZE);
-    parse_udp_header(udp_header, udp_byte_array);
+    parse_eth_header(&ethernet_header, layers->frame);
+    ethernet_header.ip_protocol = layers->ether_type;
+    print_ethernet(&ethernet_header);
+
+    for (iteration = 0; iteration < layers->num_vlan_tags; iteration++)
+    {
+        printf("    VLAN ID: %u\n", layers->vlan_ids[iteration]);
+    }
+
+    if (layers->ip_version == 4)
+    {
+        parse_ipv4_header(&ipv4_header, layer_network(layers));
+        print_ip(&ipv4_header);
+    }
+
+    if (layers->protocol == UDP_PROTOCOL && layer_transport_len(layers) >= UDP_HEADER_SIZE)
+    {
+        parse_udp_header(&udp_header, layer_transport(layers));
+        print_udp(&udp_header);
+    }
 
     return;
 }
@@ -5,20 +5,31 @@
 #include <stdint.h>
 
 #ifdef DEBUG
-    #define PRINT_ETHERNET(ethernet_header) print_ethernet(ethernet_header)
-    #define PRINT_IP(ipv4_header) print_ip(ipv4_header)
-    #define PRINT_UDP(udp_header) print_udp(udp_header)
+    #define PRINT_LAYERS(layers) print_layers(layers)
 #else
-    #define PRINT_ETHERNET(ethernet_header) ((void)0)
-    #define PRINT_IP(ipv4_header) ((void)0)
-    #define PRINT_UDP(udp_header) ((void)0)
+    #define PRINT_LAYERS(layers) ((void)0)
 #endif
 
 #define ETHERNET_HEADER_SIZE 14
 #define IPV4_HEADER_SIZE 20
 #define UDP_HEADER_SIZE 8
+#define IPV6_HEADER_SIZE 40
+#define VLAN_TAG_SIZE 4
+#define MAX_VLAN_TAGS 2
+#define VLAN_ID_MASK 0x0FFF
 #define IPV4_PROTOCOL 0x0800
+#define IPV6_PROTOCOL 0x86DD
+#define VLAN_PROTOCOL 0x8100
+#define QINQ_PROTOCOL 0x88A8
+#define ICMP_PROTOCOL 0x01
+#define TCP_PROTOCOL 0x06
 #define UDP_PROTOCOL 0x11
+#define IPV6_HOP_BY_HOP 0
+#define IPV6_ROUTING 43
+#define IPV6_FRAGMENT 44
+#define IPV6_DESTINATION_OPTIONS 60
+#define IPV6_FRAGMENT_HEADER_SIZE 8
+#define IPV6_ADDRESS_SIZE 16
 #define MAC_SECTION_SIZE 6
 #define IP_SECTION_SIZE 4
 #define UINT16_T_SIZE 2
@@ -62,11 +73,68 @@ typedef struct udp_header
     uint16_t checksum;
 } udp_header_t;
 
+/* Where each layer of a frame starts. Nothing is copied: the views below point
+ * into the frame, which must outlive the layers. options covers the IPv4
+ * options or the IPv6 extension headers. */
+typedef struct packet_layers
+{
+    const uint8_t *frame;
+    size_t frame_len;
+    uint16_t ether_type;
+    uint16_t vlan_ids[MAX_VLAN_TAGS];
+    uint8_t num_vlan_tags;
+    uint8_t ip_version;
+    uint8_t protocol;
+    uint16_t network_offset;
+    uint16_t options_offset;
+    uint16_t options_len;
+    uint16_t transport_offset;
+} packet_layers_t;
+
+static inline uint16_t read_be16(const uint8_t *data)
+{
+    return (uint16_t)((data[0] << 8) | data[1]);
+}
+
+static inline const uint8_t *layer_network(const packet_layers_t *layers)
+{
+    return layers->frame + layers->network_offset;
+}
+
+static inline const uint8_t *layer_options(const packet_layers_t *layers)
+{
+    return layers->frame + layers->options_offset;
+}
+
+static inline const uint8_t *layer_transport(const packet_layers_t *layers)
+{
+    return layers->frame + layers->transport_offset;
+}
+
+static inline size_t layer_transport_len(const packet_layers_t *layers)
+{
+    return layers->frame_len - layers->transport_offset;
+}
+
+/* Fixed-size summary of an IPv4/UDP packet, all a flow table needs */
+typedef struct packet_descriptor
+{
+    uint8_t source_ip[IP_SECTION_SIZE];
+    uint8_t destination_ip[IP_SECTION_SIZE];
+    uint16_t source_port;
+    uint16_t destination_port;
+    uint16_t ip_len;
+    uint16_t udp_len;
+    uint8_t protocol;
+    uint8_t ttl;
+    uint8_t tos;
+} packet_descriptor_t;
+
 bool_t is_ipv4(ethernet_header_t *ethernet_header);
 bool_t is_udp(ipv4_header_t *ipv4_header);
-void process_ethernet_header(const char *input_buffer, ethernet_header_t *ethernet_header);
-void process_ipv4_header(const char *input_buffer, ipv4_header_t *ipv4_header);
-void process_udp_header(const char *input_buffer, udp_header_t *udp_header, ipv4_header_t *ipv4_header);
+bool_t decode_layers(const uint8_t *frame, size_t frame_len, packet_layers_t *layers);
+bool_t describe_frame(const uint8_t *frame, size_t frame_len, packet_descriptor_t *descriptor);
+void print_layers(const packet_layers_t *layers);
 void print_ethernet(const ethernet_header_t *ethernet_header);
 void print_ip(const ipv4_header_t *ipv4_header);
 void print_udp(const udp_header_t *udp_header);
@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "parallel-ingest.h"
+#include "file-handler.h"
+#include "mapped-file.h"
+#include "input-stream.h"
+#include "hex-decoder.h"
+#include "concurrent-hash.h"
+#include "cardinality.h"
+
+typedef struct ingest_worker
+{
+    const char *begin;
+    const char *end;
+    hash_table_t hash_table;
+    cardinality_t cardinality;
+    uint32_t invalid_records;
+    pthread_t thread;
+} ingest_worker_t;
+
+static void *ingest_worker_main(void *argument);
+static const char *next_record_boundary(const char *position, const char *end);
+
+/* Each worker owns a private table, so the records of its slice need no locking */
+static void *ingest_worker_main(void *argument)
+{
+    ingest_worker_t *worker = (ingest_worker_t *)argument;
+    const char *record = worker->begin;
+    const char *newline = NULL;
+    size_t record_len = 0;
+    header_batch_t batch = {0};
+
+    while (record < worker->end)
+    {
+        newline = (const char *)memchr(record, SEPARATOR, (size_t)(worker->end - record));
+        record_len = (newline != NULL) ? (size_t)(newline - record) : (size_t)(worker->end - record);
+
+        if (!process_record(record, record_len, &batch, &worker->hash_table))
+        {
+            worker->invalid_records++;
+        }
+
+        record += record_len + 1;
+    }
+
+    flush_header_batch(&batch, &worker->hash_table);
+
+    return NULL;
+}
+
+/* Move a split point forward to just after the next newline */
+static const char *next_record_boundary(const char *position, const char *end)
+{
+    const char *newline = NULL;
+
+    newline = (const char *)memchr(position, SEPARATOR, (size_t)(end - position));
+
+    return (newline != NULL) ? newline + 1 : end;
+}
+
+/* Split input.txt at record boundaries and count each slice on its own thread.
+ * Private tables are merged in slice order so first-seen order is preserved;
+ * with is_shared all workers insert into one concurrent table instead, which
+ * keeps the counts exact but orders flows by when a thread first claimed them */
+bool_t process_input_file_parallel(const char *file_name, hash_table_t *hash_table, uint32_t num_threads, bool_t is_shared)
+{
+    mapped_file_t input = {0};
+    concurrent_table_t shared_table;
+    ingest_worker_t *workers = NULL;
+    const char *begin = NULL;
+    const char *end = NULL;
+    const char *split = NULL;
+    uint32_t iteration = 0;
+    uint32_t invalid_records = 0;
+
+    if (!map_file(file_name, &input))
+    {
+        return false;
+    }
+
+    /* Slices need the plain text in memory, a compressed file can only be read front to back */
+    if (detect_compression(input.data, input.size) != COMPRESSION_NONE)
+    {
+        fprintf(stderr, "%s is compressed and cannot be split across threads, use -p instead of -j\n", file_name);
+        unmap_file(&input);
+
+        return false;
+    }
+
+    workers = (ingest_worker_t *)calloc(num_threads, sizeof(ingest_worker_t));
+
+    if (workers == NULL)
+    {
+        perror("Memory allocation failed for ingest workers");
+        unmap_file(&input);
+        exit(EXIT_FAILURE);
+    }
+
+    /* The kernel choice is a global, make it before any worker decodes */
+    init_hex_decoder();
+    init_jhash_lanes();
+
+    begin = (const char *)input.data;
+    end = begin + input.size;
+
+    if (is_shared)
+    {
+        init_concurrent_table(&shared_table, CONCURRENT_TABLE_SIZE);
+    }
+
+    for (iteration = 0; iteration < num_threads; iteration++)
+    {
+        workers[iteration].begin = begin;
+        split = (iteration == num_threads - 1) ? end : begin + (size_t)(end - begin) / (num_threads - iteration);
+        workers[iteration].end = (split > begin) ? next_record_boundary(split - 1, end) : begin;
+        begin = workers[iteration].end;
+
+        if (is_shared)
+        {
+            init_shared_hash_table(&workers[iteration].hash_table, &shared_table, hash_table->schema);
+        }
+        else
+        {
+            init_hash_table(&workers[iteration].hash_table, TABLE_SIZE, hash_table->schema);
+            enable_flow_stats(&workers[iteration].hash_table, hash_table->stats.enabled);
+            enable_first_inserts(&workers[iteration].hash_table);
+        }
+
+        enable_sampling(&workers[iteration].hash_table, hash_table->sampler);
+        workers[iteration].hash_table.filter = hash_table->filter;
+
+        /* Sketches stay per thread even with a shared table and are merged like private tables */
+        if (hash_table->cardinality != NULL)
+        {
+            init_cardinality(&workers[iteration].cardinality);
+            workers[iteration].hash_table.cardinality = &workers[iteration].cardinality;
+        }
+
+        if (pthread_create(&workers[iteration].thread, NULL, ingest_worker_main, &workers[iteration]) != 0)
+        {
+            perror("Failed to start ingest worker");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (iteration = 0; iteration < num_threads; iteration++)
+    {
+        pthread_join(workers[iteration].thread, NULL);
+
+        if (!is_shared)
+        {
+            merge_hash_table(hash_table, &workers[iteration].hash_table);
+        }
+
+        if (hash_table->cardinality != NULL)
+        {
+            merge_cardinality(hash_table->cardinality, &workers[iteration].cardinality);
+            free_cardinality(&workers[iteration].cardinality);
+        }
+
+        invalid_records += workers[iteration].invalid_records;
+        free_hash_table(&workers[iteration].hash_table);
+    }
+
+    if (is_shared)
+    {
+        export_concurrent_table(&shared_table, hash_table);
+        free_concurrent_table(&shared_table);
+    }
+
+    if (invalid_records > 0)
+    {
+        fprintf(stderr, "Invalid hex characters in %u records, packets cut short\n", invalid_records);
+    }
+
+    free(workers);
+    workers = NULL;
+    unmap_file(&input);
+
+    return true;
+}
\ No newline at end of file
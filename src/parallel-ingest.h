@@ -0,0 +1,12 @@
+#ifndef PARALLEL_INGEST_H_INCLUDED
+#define PARALLEL_INGEST_H_INCLUDED
+
+#include <stdint.h>
+#include "packets.h"
+#include "hash.h"
+
+#define MAX_THREADS 256
+
+bool_t process_input_file_parallel(const char *file_name, hash_table_t *hash_table, uint32_t num_threads, bool_t is_shared);
+
+#endif // PARALLEL_INGEST_H_INCLUDED
\ No newline at end of file
@@ -0,0 +1,344 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "pcap-reader.h"
+#include "mapped-file.h"
+#include "file-handler.h"
+#include "byte-order.h"
+
+static inline uint16_t read_u16(const uint8_t *data, bool_t swapped);
+static inline uint32_t read_u32(const uint8_t *data, bool_t swapped);
+static size_t parse_pcap(capture_parser_t *parser, const uint8_t *data, size_t size, uint64_t max_packets,
+                         header_batch_t *batch, hash_table_t *hash_table);
+static size_t parse_pcapng(capture_parser_t *parser, const uint8_t *data, size_t size, uint64_t max_packets,
+                           header_batch_t *batch, hash_table_t *hash_table);
+
+/* Read a 16 bit field written in the capture's byte order */
+static inline uint16_t read_u16(const uint8_t *data, bool_t swapped)
+{
+    uint16_t value = 0;
+
+    memcpy(&value, data, UINT16_T_SIZE);
+
+    return swapped ? custom_ntohs(value) : value;
+}
+
+/* Read a 32 bit field written in the capture's byte order */
+static inline uint32_t read_u32(const uint8_t *data, bool_t swapped)
+{
+    uint32_t value = 0;
+
+    memcpy(&value, data, sizeof(uint32_t));
+
+    return swapped ? custom_ntohl(value) : value;
+}
+
+/* Check the magic number to see whether a file is a binary pcap/pcapng capture.
+ * Only regular files are looked at: reading a pipe would eat its first bytes. */
+bool_t is_capture_file(const char *file_name)
+{
+    FILE *file = NULL;
+    struct stat file_stat;
+    uint8_t magic_bytes[sizeof(uint32_t)] = {0};
+    uint32_t magic = 0;
+
+    if (stat(file_name, &file_stat) != 0 || !S_ISREG(file_stat.st_mode))
+    {
+        return false;
+    }
+
+    file = fopen(file_name, "rb");
+
+    if (file == NULL)
+    {
+        return false;
+    }
+
+    if (fread(magic_bytes, 1, sizeof(magic_bytes), file) != sizeof(magic_bytes))
+    {
+        fclose(file);
+
+        return false;
+    }
+
+    fclose(file);
+    magic = read_u32(magic_bytes, false);
+
+    return magic == PCAP_MAGIC_MICRO || magic == PCAP_MAGIC_NANO ||
+           custom_ntohl(magic) == PCAP_MAGIC_MICRO || custom_ntohl(magic) == PCAP_MAGIC_NANO ||
+           magic == PCAPNG_SECTION_HEADER_BLOCK;
+}
+
+/* Classic pcap: one global header followed by record header + frame pairs */
+static size_t parse_pcap(capture_parser_t *parser, const uint8_t *data, size_t size, uint64_t max_packets,
+                         header_batch_t *batch, hash_table_t *hash_table)
+{
+    size_t offset = 0;
+    uint32_t captured_len = 0;
+
+    while (parser->num_packets < max_packets && size - offset >= PCAP_RECORD_HEADER_SIZE)
+    {
+        captured_len = read_u32(data + offset + 8, parser->swapped);
+
+        if (captured_len > CAPTURE_MAX_RECORD_SIZE)
+        {
+            fprintf(stderr, "Capture corrupt, a packet of %u bytes and the rest ignored\n", captured_len);
+            parser->is_failed = true;
+            break;
+        }
+
+        /* The rest of the packet comes with the next bytes */
+        if (captured_len > size - offset - PCAP_RECORD_HEADER_SIZE)
+        {
+            break;
+        }
+
+        add_to_header_batch(batch, data + offset + PCAP_RECORD_HEADER_SIZE, captured_len, hash_table);
+        offset += PCAP_RECORD_HEADER_SIZE + captured_len;
+        parser->num_packets++;
+    }
+
+    return offset;
+}
+
+/* pcapng: a sequence of blocks, each section carrying its own byte order and interfaces */
+static size_t parse_pcapng(capture_parser_t *parser, const uint8_t *data, size_t size, uint64_t max_packets,
+                           header_batch_t *batch, hash_table_t *hash_table)
+{
+    pcapng_interface_t *interfaces = parser->interfaces;
+    const uint8_t *block = NULL;
+    size_t offset = 0;
+    uint32_t block_type = 0;
+    uint32_t block_len = 0;
+    uint32_t interface_id = 0;
+    uint32_t captured_len = 0;
+    bool_t swapped = parser->swapped;
+
+    while (parser->num_packets < max_packets && size - offset >= PCAPNG_BLOCK_HEADER_SIZE)
+    {
+        block = data + offset;
+        block_type = read_u32(block, swapped);
+
+        /* A section header resets the byte order and the interface list */
+        if (block_type == PCAPNG_SECTION_HEADER_BLOCK)
+        {
+            swapped = read_u32(block + 8, false) != PCAPNG_BYTE_ORDER_MAGIC;
+        }
+
+        block_len = read_u32(block + 4, swapped);
+
+        if (block_len < PCAPNG_BLOCK_HEADER_SIZE || block_len > CAPTURE_MAX_RECORD_SIZE)
+        {
+            fprintf(stderr, "Capture corrupt, a block of %u bytes and the rest ignored\n", block_len);
+            parser->is_failed = true;
+            break;
+        }
+
+        /* The rest of the block comes with the next bytes */
+        if (block_len > size - offset)
+        {
+            break;
+        }
+
+        switch (block_type)
+        {
+        case PCAPNG_SECTION_HEADER_BLOCK:
+            parser->swapped = swapped;
+            parser->num_interfaces = 0;
+            break;
+
+        case PCAPNG_INTERFACE_DESCRIPTION_BLOCK:
+            if (parser->num_interfaces < PCAPNG_MAX_INTERFACES && block_len >= 20)
+            {
+                interfaces[parser->num_interfaces].link_type = read_u16(block + 8, swapped);
+                interfaces[parser->num_interfaces].snap_len = read_u32(block + 12, swapped);
+            }
+
+            parser->num_interfaces++;
+            break;
+
+        case PCAPNG_ENHANCED_PACKET_BLOCK:
+            if (block_len < 32)
+            {
+                break;
+            }
+
+            interface_id = read_u32(block + 8, swapped);
+            captured_len = read_u32(block + 20, swapped);
+
+            if (interface_id < parser->num_interfaces && interface_id < PCAPNG_MAX_INTERFACES &&
+                interfaces[interface_id].link_type == LINKTYPE_ETHERNET && captured_len <= block_len - 32)
+            {
+                add_to_header_batch(batch, block + 28, captured_len, hash_table);
+                parser->num_packets++;
+            }
+            break;
+
+        case PCAPNG_SIMPLE_PACKET_BLOCK:
+            /* Simple packets always belong to the first interface and are clipped to its snap length */
+            if (block_len < 16 || parser->num_interfaces == 0 || interfaces[0].link_type != LINKTYPE_ETHERNET)
+            {
+                break;
+            }
+
+            captured_len = read_u32(block + 8, swapped);
+
+            if (interfaces[0].snap_len != 0 && captured_len > interfaces[0].snap_len)
+            {
+                captured_len = interfaces[0].snap_len;
+            }
+
+            if (captured_len > block_len - 16)
+            {
+                captured_len = block_len - 16;
+            }
+
+            add_to_header_batch(batch, block + 12, captured_len, hash_table);
+            parser->num_packets++;
+            break;
+
+        case PCAPNG_OBSOLETE_PACKET_BLOCK:
+            if (block_len < 32)
+            {
+                break;
+            }
+
+            interface_id = read_u16(block + 8, swapped);
+            captured_len = read_u32(block + 20, swapped);
+
+            if (interface_id < parser->num_interfaces && interface_id < PCAPNG_MAX_INTERFACES &&
+                interfaces[interface_id].link_type == LINKTYPE_ETHERNET && captured_len <= block_len - 32)
+            {
+                add_to_header_batch(batch, block + 28, captured_len, hash_table);
+                parser->num_packets++;
+            }
+            break;
+
+        default:
+            /* Statistics, name resolution and custom blocks carry no packets */
+            break;
+        }
+
+        offset += block_len;
+    }
+
+    return offset;
+}
+
+void init_capture_parser(capture_parser_t *parser)
+{
+    memset(parser, 0, sizeof(capture_parser_t));
+    parser->interfaces = (pcapng_interface_t *)calloc(PCAPNG_MAX_INTERFACES, sizeof(pcapng_interface_t));
+
+    if (parser->interfaces == NULL)
+    {
+        perror("Memory allocation failed for pcapng interfaces");
+        exit(EXIT_FAILURE);
+    }
+
+    return;
+}
+
+/* Count the packets in the complete records of data, at most up to
+ * max_packets in all, and return the bytes used. Whatever is left over is
+ * an unfinished record to be given again with the bytes that follow it. */
+size_t parse_capture(capture_parser_t *parser, const uint8_t *data, size_t size, uint64_t max_packets,
+                     header_batch_t *batch, hash_table_t *hash_table)
+{
+    size_t offset = 0;
+    uint32_t magic = 0;
+
+    if (parser->is_failed)
+    {
+        return 0;
+    }
+
+    if (parser->format == CAPTURE_FORMAT_UNKNOWN)
+    {
+        if (size < PCAP_GLOBAL_HEADER_SIZE)
+        {
+            return 0;
+        }
+
+        magic = read_u32(data, false);
+
+        if (magic == PCAP_MAGIC_MICRO || magic == PCAP_MAGIC_NANO ||
+            custom_ntohl(magic) == PCAP_MAGIC_MICRO || custom_ntohl(magic) == PCAP_MAGIC_NANO)
+        {
+            parser->format = CAPTURE_FORMAT_PCAP;
+            parser->swapped = (magic != PCAP_MAGIC_MICRO && magic != PCAP_MAGIC_NANO);
+            offset = PCAP_GLOBAL_HEADER_SIZE;
+
+            if (read_u32(data + PCAP_LINKTYPE_OFFSET, parser->swapped) != LINKTYPE_ETHERNET)
+            {
+                fprintf(stderr, "Unsupported link type, only Ethernet captures are processed\n");
+                parser->is_failed = true;
+
+                return offset;
+            }
+        }
+        else if (magic == PCAPNG_SECTION_HEADER_BLOCK)
+        {
+            parser->format = CAPTURE_FORMAT_PCAPNG;
+        }
+        else
+        {
+            parser->is_failed = true;
+
+            return 0;
+        }
+    }
+
+    if (parser->format == CAPTURE_FORMAT_PCAP)
+    {
+        return offset + parse_pcap(parser, data + offset, size - offset, max_packets, batch, hash_table);
+    }
+
+    return parse_pcapng(parser, data, size, max_packets, batch, hash_table);
+}
+
+/* Report what the bytes left at the end of the capture mean, false when it
+ * never was a capture */
+bool_t finish_capture_parser(capture_parser_t *parser, const char *file_name, size_t leftover)
+{
+    bool_t is_capture = (parser->format != CAPTURE_FORMAT_UNKNOWN);
+
+    if (!is_capture)
+    {
+        fprintf(stderr, "Not a capture file: %s\n", file_name);
+    }
+    else if (!parser->is_failed && leftover > 0)
+    {
+        fprintf(stderr, (parser->format == CAPTURE_FORMAT_PCAP) ? "Capture truncated, last packet ignored\n"
+                                                                : "Capture truncated, last block ignored\n");
+    }
+
+    free(parser->interfaces);
+    parser->interfaces = NULL;
+
+    return is_capture;
+}
+
+/* Count the IP pairs of a pcap or pcapng capture without any text export */
+bool_t process_capture_file(const char *file_name, hash_table_t *hash_table)
+{
+    mapped_file_t capture = {0};
+    capture_parser_t parser;
+    header_batch_t batch = {0};
+    size_t consumed = 0;
+    bool_t is_capture = false;
+
+    if (!map_file(file_name, &capture))
+    {
+        return false;
+    }
+
+    init_capture_parser(&parser);
+    consumed = parse_capture(&parser, capture.data, capture.size, UINT64_MAX, &batch, hash_table);
+    flush_header_batch(&batch, hash_table);
+    is_capture = finish_capture_parser(&parser, file_name, capture.size - consumed);
+    unmap_file(&capture);
+
+    return is_capture;
+}
@@ -0,0 +1,58 @@
+#ifndef PCAP_READER_H_INCLUDED
+#define PCAP_READER_H_INCLUDED
+
+#include <stdint.h>
+#include "packets.h"
+#include "hash.h"
+#include "header-batch.h"
+
+#define PCAP_MAGIC_MICRO 0xA1B2C3D4
+#define PCAP_MAGIC_NANO 0xA1B23C4D
+#define PCAP_GLOBAL_HEADER_SIZE 24
+#define PCAP_RECORD_HEADER_SIZE 16
+#define PCAP_LINKTYPE_OFFSET 20
+#define PCAPNG_SECTION_HEADER_BLOCK 0x0A0D0D0A
+#define PCAPNG_INTERFACE_DESCRIPTION_BLOCK 0x00000001
+#define PCAPNG_OBSOLETE_PACKET_BLOCK 0x00000002
+#define PCAPNG_SIMPLE_PACKET_BLOCK 0x00000003
+#define PCAPNG_ENHANCED_PACKET_BLOCK 0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1A2B3C4D
+#define PCAPNG_BLOCK_HEADER_SIZE 12
+#define PCAPNG_MAX_INTERFACES 256
+#define LINKTYPE_ETHERNET 1
+#define CAPTURE_MAX_RECORD_SIZE (16 * 1024 * 1024)
+
+typedef enum
+{
+    CAPTURE_FORMAT_UNKNOWN = 0,
+    CAPTURE_FORMAT_PCAP,
+    CAPTURE_FORMAT_PCAPNG
+} capture_format_t;
+
+typedef struct pcapng_interface
+{
+    uint16_t link_type;
+    uint32_t snap_len;
+} pcapng_interface_t;
+
+/* Where parsing stopped in a capture, so it can go on with the next bytes.
+ * The format and byte order come from the first bytes, pcapng interfaces
+ * from the blocks seen so far. */
+typedef struct capture_parser
+{
+    capture_format_t format;
+    bool_t swapped;
+    pcapng_interface_t *interfaces;
+    uint32_t num_interfaces;
+    uint64_t num_packets;
+    bool_t is_failed;
+} capture_parser_t;
+
+bool_t is_capture_file(const char *file_name);
+void init_capture_parser(capture_parser_t *parser);
+size_t parse_capture(capture_parser_t *parser, const uint8_t *data, size_t size, uint64_t max_packets,
+                     header_batch_t *batch, hash_table_t *hash_table);
+bool_t finish_capture_parser(capture_parser_t *parser, const char *file_name, size_t leftover);
+bool_t process_capture_file(const char *file_name, hash_table_t *hash_table);
+
+#endif // PCAP_READER_H_INCLUDED
\ No newline at end of file
@@ -0,0 +1,354 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "pipeline.h"
+#include "spsc-ring.h"
+#include "file-handler.h"
+#include "hex-decoder.h"
+#include "input-stream.h"
+
+typedef struct input_block
+{
+    char *data;
+    size_t len;
+} input_block_t;
+
+/* The last batch of every block is flagged so the aggregator can keep block order */
+typedef struct descriptor_batch
+{
+    packet_descriptor_t descriptors[PIPELINE_BATCH_SIZE];
+    uint32_t count;
+    uint32_t invalid_records;
+    bool_t is_end_of_block;
+} descriptor_batch_t;
+
+typedef struct pipeline pipeline_t;
+
+typedef struct decoder_context
+{
+    pipeline_t *pipeline;
+    uint32_t index;
+    pthread_t thread;
+} decoder_context_t;
+
+/* reader -> block_rings[d] -> decoder d -> batch_rings[d] -> aggregator,
+ * block k always goes to decoder k % num_decoders */
+struct pipeline
+{
+    input_stream_t input_stream;
+    uint32_t num_decoders;
+    const sampler_t *sampler;
+    spsc_ring_t block_rings[MAX_DECODERS];
+    spsc_ring_t batch_rings[MAX_DECODERS];
+    decoder_context_t decoders[MAX_DECODERS];
+    pthread_t reader;
+};
+
+static void *reader_main(void *argument);
+static void *decoder_main(void *argument);
+static descriptor_batch_t *new_batch(void);
+static size_t last_separator(const char *data, size_t len);
+
+/* Position just after the last record separator, 0 if there is none */
+static size_t last_separator(const char *data, size_t len)
+{
+    while (len > 0 && data[len - 1] != SEPARATOR)
+    {
+        len--;
+    }
+
+    return len;
+}
+
+/* Read large blocks that end on a record boundary and deal them out round robin */
+static void *reader_main(void *argument)
+{
+    pipeline_t *pipeline = (pipeline_t *)argument;
+    input_block_t *block = NULL;
+    char *carry = NULL;
+    char *data = NULL;
+    size_t carry_len = 0;
+    size_t capacity = 0;
+    size_t len = 0;
+    size_t read_len = 0;
+    size_t block_len = 0;
+    uint64_t sequence = 0;
+    uint32_t iteration = 0;
+    bool_t is_eof = false;
+
+    while (!is_eof)
+    {
+        capacity = PIPELINE_BLOCK_SIZE + carry_len;
+        data = (char *)malloc(capacity);
+
+        if (data == NULL)
+        {
+            perror("Memory allocation failed for input block");
+            exit(EXIT_FAILURE);
+        }
+
+        /* The unfinished record from the previous block starts this one */
+        if (carry_len > 0)
+        {
+            memcpy(data, carry, carry_len);
+        }
+
+        len = carry_len;
+        free(carry);
+        carry = NULL;
+        carry_len = 0;
+
+        read_len = read_input_stream(&pipeline->input_stream, data + len, capacity - len);
+        is_eof = (read_len < capacity - len);
+        len += read_len;
+
+        if (len == 0)
+        {
+            free(data);
+            break;
+        }
+
+        block_len = is_eof ? len : last_separator(data, len);
+
+        /* A record longer than a whole block: keep reading into a bigger one */
+        if (block_len == 0)
+        {
+            carry = data;
+            carry_len = len;
+            continue;
+        }
+
+        if (block_len < len)
+        {
+            carry_len = len - block_len;
+            carry = (char *)malloc(carry_len);
+
+            if (carry == NULL)
+            {
+                perror("Memory allocation failed for input block");
+                exit(EXIT_FAILURE);
+            }
+
+            memcpy(carry, data + block_len, carry_len);
+        }
+
+        block = (input_block_t *)malloc(sizeof(input_block_t));
+
+        if (block == NULL)
+        {
+            perror("Memory allocation failed for input block");
+            exit(EXIT_FAILURE);
+        }
+
+        block->data = data;
+        block->len = block_len;
+        push_spsc_ring(&pipeline->block_rings[sequence % pipeline->num_decoders], block);
+        sequence++;
+    }
+
+    /* A NULL block tells each decoder the input is over */
+    for (iteration = 0; iteration < pipeline->num_decoders; iteration++)
+    {
+        push_spsc_ring(&pipeline->block_rings[iteration], NULL);
+    }
+
+    return NULL;
+}
+
+static descriptor_batch_t *new_batch(void)
+{
+    descriptor_batch_t *batch = NULL;
+
+    batch = (descriptor_batch_t *)malloc(sizeof(descriptor_batch_t));
+
+    if (batch == NULL)
+    {
+        perror("Memory allocation failed for descriptor batch");
+        exit(EXIT_FAILURE);
+    }
+
+    batch->count = 0;
+    batch->invalid_records = 0;
+    batch->is_end_of_block = false;
+
+    return batch;
+}
+
+/* Hex-decode and parse every record of a block into fixed-size descriptors */
+static void *decoder_main(void *argument)
+{
+    decoder_context_t *context = (decoder_context_t *)argument;
+    spsc_ring_t *block_ring = &context->pipeline->block_rings[context->index];
+    spsc_ring_t *batch_ring = &context->pipeline->batch_rings[context->index];
+    uint8_t frame[MAX_RECORD_BYTES] = {0};
+    input_block_t *block = NULL;
+    descriptor_batch_t *batch = NULL;
+    const char *record = NULL;
+    const char *end = NULL;
+    const char *newline = NULL;
+    size_t record_len = 0;
+    size_t frame_len = 0;
+    bool_t is_complete = false;
+
+    while ((block = (input_block_t *)pop_spsc_ring(block_ring)) != NULL)
+    {
+        batch = new_batch();
+        record = block->data;
+        end = block->data + block->len;
+
+        while (record < end)
+        {
+            newline = (const char *)memchr(record, SEPARATOR, (size_t)(end - record));
+            record_len = (newline != NULL) ? (size_t)(newline - record) : (size_t)(end - record);
+            frame_len = decode_record(record, record_len, context->pipeline->sampler, frame, &is_complete);
+
+            if (!is_complete)
+            {
+                batch->invalid_records++;
+            }
+
+            if (describe_frame(frame, frame_len, &batch->descriptors[batch->count]) &&
+                ++batch->count == PIPELINE_BATCH_SIZE)
+            {
+                push_spsc_ring(batch_ring, batch);
+                batch = new_batch();
+            }
+
+            record += record_len + 1;
+        }
+
+        batch->is_end_of_block = true;
+        push_spsc_ring(batch_ring, batch);
+        free(block->data);
+        free(block);
+    }
+
+    push_spsc_ring(batch_ring, NULL);
+
+    return NULL;
+}
+
+/* Read, decode and aggregate input.txt on separate threads connected by SPSC rings;
+ * the calling thread is the aggregator and consumes blocks in file order */
+bool_t process_input_file_pipelined(const char *file_name, hash_table_t *hash_table, uint32_t num_decoders, bool_t verbose)
+{
+    pipeline_t *pipeline = NULL;
+    key_batch_t key_batch = {0};
+    descriptor_batch_t *batch = NULL;
+    char ring_name[32] = {0};
+    uint64_t sequence = 0;
+    uint32_t invalid_records = 0;
+    uint32_t iteration = 0;
+    uint32_t last_decoder = 0;
+
+    pipeline = (pipeline_t *)calloc(STRUCT_MULTIPLIER, sizeof(pipeline_t));
+
+    if (pipeline == NULL)
+    {
+        perror("Memory allocation failed for pipeline");
+        exit(EXIT_FAILURE);
+    }
+
+    if (!open_input_stream(&pipeline->input_stream, file_name))
+    {
+        free(pipeline);
+
+        return false;
+    }
+
+    pipeline->num_decoders = num_decoders;
+    pipeline->sampler = hash_table->sampler;
+    init_hex_decoder();
+
+    for (iteration = 0; iteration < num_decoders; iteration++)
+    {
+        init_spsc_ring(&pipeline->block_rings[iteration], BLOCK_RING_CAPACITY);
+        init_spsc_ring(&pipeline->batch_rings[iteration], BATCH_RING_CAPACITY);
+        pipeline->decoders[iteration].pipeline = pipeline;
+        pipeline->decoders[iteration].index = iteration;
+
+        if (pthread_create(&pipeline->decoders[iteration].thread, NULL, decoder_main, &pipeline->decoders[iteration]) != 0)
+        {
+            perror("Failed to start decoder thread");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (pthread_create(&pipeline->reader, NULL, reader_main, pipeline) != 0)
+    {
+        perror("Failed to start reader thread");
+        exit(EXIT_FAILURE);
+    }
+
+    /* Aggregate: block k comes from decoder k % num_decoders, a NULL there means no block k */
+    while ((batch = (descriptor_batch_t *)pop_spsc_ring(&pipeline->batch_rings[sequence % num_decoders])) != NULL)
+    {
+        for (iteration = 0; iteration < batch->count; iteration++)
+        {
+            batch_descriptor(&batch->descriptors[iteration], &key_batch, hash_table);
+        }
+
+        invalid_records += batch->invalid_records;
+
+        if (batch->is_end_of_block)
+        {
+            sequence++;
+        }
+
+        free(batch);
+    }
+
+    flush_key_batch(&key_batch, hash_table);
+
+    /* The other decoders have nothing left but their end marker */
+    last_decoder = (uint32_t)(sequence % num_decoders);
+
+    for (iteration = 0; iteration < num_decoders; iteration++)
+    {
+        while (iteration != last_decoder && pop_spsc_ring(&pipeline->batch_rings[iteration]) != NULL)
+        {
+            /* Drain until the end marker */
+        }
+    }
+
+    pthread_join(pipeline->reader, NULL);
+
+    for (iteration = 0; iteration < num_decoders; iteration++)
+    {
+        pthread_join(pipeline->decoders[iteration].thread, NULL);
+    }
+
+    if (invalid_records > 0)
+    {
+        fprintf(stderr, "Invalid hex characters in %u records, packets cut short\n", invalid_records);
+    }
+
+    if (verbose)
+    {
+        for (iteration = 0; iteration < num_decoders; iteration++)
+        {
+            snprintf(ring_name, sizeof(ring_name), "reader->decoder %u", iteration);
+            print_spsc_ring_stats(ring_name, &pipeline->block_rings[iteration]);
+            snprintf(ring_name, sizeof(ring_name), "decoder %u->aggregator", iteration);
+            print_spsc_ring_stats(ring_name, &pipeline->batch_rings[iteration]);
+        }
+
+        if (pipeline->input_stream.compression != COMPRESSION_NONE)
+        {
+            print_spsc_ring_stats("decompressor->reader", &pipeline->input_stream.full_ring);
+        }
+    }
+
+    for (iteration = 0; iteration < num_decoders; iteration++)
+    {
+        free_spsc_ring(&pipeline->block_rings[iteration]);
+        free_spsc_ring(&pipeline->batch_rings[iteration]);
+    }
+
+    close_input_stream(&pipeline->input_stream);
+    free(pipeline);
+    pipeline = NULL;
+
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,16 @@
+#ifndef PIPELINE_H_INCLUDED
+#define PIPELINE_H_INCLUDED
+
+#include <stdint.h>
+#include "packets.h"
+#include "hash.h"
+
+#define PIPELINE_BLOCK_SIZE (1024 * 1024)
+#define PIPELINE_BATCH_SIZE 256
+#define BLOCK_RING_CAPACITY 8
+#define BATCH_RING_CAPACITY 64
+#define MAX_DECODERS 64
+
+bool_t process_input_file_pipelined(const char *file_name, hash_table_t *hash_table, uint32_t num_decoders, bool_t verbose);
+
+#endif // PIPELINE_H_INCLUDED
\ No newline at end of file
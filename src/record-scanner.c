@@ -0,0 +1,152 @@
+#include <stdlib.h>
+#include <string.h>
+#include "record-scanner.h"
+#include "file-handler.h"
+
+bool_t open_record_scanner(record_scanner_t *scanner, const char *file_name, size_t head_len)
+{
+    memset(scanner, 0, sizeof(record_scanner_t));
+    scanner->head_len = head_len;
+
+    if (try_map_file(file_name, &scanner->mapped))
+    {
+        if (detect_compression(scanner->mapped.data, scanner->mapped.size) == COMPRESSION_NONE)
+        {
+            return true;
+        }
+
+        /* A compressed file is streamed through its decompressor instead */
+        unmap_file(&scanner->mapped);
+    }
+
+    if (!open_input_stream(&scanner->stream, file_name))
+    {
+        return false;
+    }
+
+    scanner->block = (char *)malloc(SCANNER_BLOCK_SIZE);
+    scanner->head = (char *)malloc(head_len > 0 ? head_len : 1);
+
+    if (scanner->block == NULL || scanner->head == NULL)
+    {
+        perror("Memory allocation failed for record scanner");
+        exit(EXIT_FAILURE);
+    }
+
+    return true;
+}
+
+/* A record that does not fit in a block: keep its head, then read blocks
+ * until its newline without looking at anything but the newline */
+static void skip_long_record(record_scanner_t *scanner)
+{
+    const char *newline = NULL;
+    size_t read_len = 0;
+
+    memcpy(scanner->head, scanner->block, scanner->head_len);
+
+    do
+    {
+        read_len = read_input_stream(&scanner->stream, scanner->block, SCANNER_BLOCK_SIZE);
+        newline = (const char *)memchr(scanner->block, SEPARATOR, read_len);
+    } while (newline == NULL && read_len > 0);
+
+    scanner->is_eof = (read_len == 0);
+    scanner->block_start = (newline != NULL) ? (size_t)(newline - scanner->block) + 1 : read_len;
+    scanner->block_len = read_len;
+
+    return;
+}
+
+static bool_t next_block_record(record_scanner_t *scanner, const char **record, size_t *record_len)
+{
+    const char *start = NULL;
+    const char *newline = NULL;
+    size_t read_len = 0;
+
+    while (true)
+    {
+        start = scanner->block + scanner->block_start;
+        newline = (const char *)memchr(start, SEPARATOR, scanner->block_len - scanner->block_start);
+
+        if (newline != NULL)
+        {
+            *record = start;
+            *record_len = (size_t)(newline - start);
+            scanner->block_start += *record_len + 1;
+
+            return true;
+        }
+
+        /* The last record may have no newline */
+        if (scanner->is_eof)
+        {
+            *record = start;
+            *record_len = scanner->block_len - scanner->block_start;
+            scanner->block_start = scanner->block_len;
+
+            return *record_len > 0;
+        }
+
+        /* Keep the partial record and fill the rest of the block behind it */
+        memmove(scanner->block, start, scanner->block_len - scanner->block_start);
+        scanner->block_len -= scanner->block_start;
+        scanner->block_start = 0;
+
+        if (scanner->block_len == SCANNER_BLOCK_SIZE)
+        {
+            skip_long_record(scanner);
+            *record = scanner->head;
+            *record_len = scanner->head_len;
+
+            return true;
+        }
+
+        read_len = read_input_stream(&scanner->stream, scanner->block + scanner->block_len,
+                                     SCANNER_BLOCK_SIZE - scanner->block_len);
+        scanner->block_len += read_len;
+        scanner->is_eof = (read_len == 0);
+    }
+}
+
+/* The next record without its newline, false after the last one */
+bool_t next_record(record_scanner_t *scanner, const char **record, size_t *record_len)
+{
+    const char *start = NULL;
+    const char *end = NULL;
+    const char *newline = NULL;
+
+    if (scanner->block != NULL)
+    {
+        return next_block_record(scanner, record, record_len);
+    }
+
+    if (scanner->position >= scanner->mapped.size)
+    {
+        return false;
+    }
+
+    start = (const char *)scanner->mapped.data + scanner->position;
+    end = (const char *)scanner->mapped.data + scanner->mapped.size;
+    newline = (const char *)memchr(start, SEPARATOR, (size_t)(end - start));
+    *record = start;
+    *record_len = (newline != NULL) ? (size_t)(newline - start) : (size_t)(end - start);
+    scanner->position += *record_len + 1;
+
+    return true;
+}
+
+void close_record_scanner(record_scanner_t *scanner)
+{
+    if (scanner->block != NULL)
+    {
+        close_input_stream(&scanner->stream);
+    }
+
+    unmap_file(&scanner->mapped);
+    free(scanner->block);
+    free(scanner->head);
+    memset(scanner, 0, sizeof(record_scanner_t));
+
+    return;
+}
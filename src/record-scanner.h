@@ -0,0 +1,35 @@
+#ifndef RECORD_SCANNER_H_INCLUDED
+#define RECORD_SCANNER_H_INCLUDED
+
+#include <stdio.h>
+#include "packets.h"
+#include "mapped-file.h"
+#include "input-stream.h"
+
+#define SCANNER_BLOCK_SIZE (1024 * 1024)
+
+/* Newline separated records of input.txt, one at a time. A regular file is
+ * mapped and each record is a pointer into the mapping; anything else, a pipe
+ * or a gzip/zstd file, is read SCANNER_BLOCK_SIZE bytes at a time. Either way
+ * a record's end is found with memchr, and only its first head_len characters
+ * are ever copied, so the payload hex of a long record is skipped at memchr
+ * speed. record_len is the record's full length, capped at head_len when it
+ * is read in blocks. */
+typedef struct record_scanner
+{
+    mapped_file_t mapped;
+    size_t position;
+    input_stream_t stream;
+    char *block;
+    size_t block_start;
+    size_t block_len;
+    char *head;
+    size_t head_len;
+    bool_t is_eof;
+} record_scanner_t;
+
+bool_t open_record_scanner(record_scanner_t *scanner, const char *file_name, size_t head_len);
+bool_t next_record(record_scanner_t *scanner, const char **record, size_t *record_len);
+void close_record_scanner(record_scanner_t *scanner);
+
+#endif // RECORD_SCANNER_H_INCLUDED
@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <string.h>
+#include "sampling.h"
+
+#define ETHER_TYPE_OFFSET (2 * MAC_SECTION_SIZE)
+
+void init_sampler(sampler_t *sampler, uint32_t rate, uint32_t seed)
+{
+    sampler->rate = (rate == 0) ? 1 : rate;
+    sampler->seed = seed;
+    sampler->threshold = (uint32_t)((((uint64_t)UINT32_MAX + 1) / sampler->rate) - 1);
+
+    return;
+}
+
+/* Look only as far as the IPv4 addresses: the Ethernet type, up to two VLAN
+ * tags, and the pair. Frames that are not IPv4 are never counted, so they are
+ * dropped here too. */
+bool_t is_frame_sampled(const sampler_t *sampler, const uint8_t *frame, size_t frame_len)
+{
+    size_t offset = ETHER_TYPE_OFFSET;
+    uint16_t ether_type = 0;
+    uint32_t num_tags = 0;
+
+    if (sampler == NULL)
+    {
+        return true;
+    }
+
+    if (frame_len < ETHERNET_HEADER_SIZE)
+    {
+        return false;
+    }
+
+    ether_type = read_be16(frame + offset);
+
+    while ((ether_type == VLAN_PROTOCOL || ether_type == QINQ_PROTOCOL) && num_tags < MAX_VLAN_TAGS &&
+           frame_len >= offset + VLAN_TAG_SIZE + UINT16_T_SIZE)
+    {
+        offset += VLAN_TAG_SIZE;
+        ether_type = read_be16(frame + offset);
+        num_tags++;
+    }
+
+    offset += UINT16_T_SIZE;
+
+    if (ether_type != IPV4_PROTOCOL || frame_len < offset + IPV4_HEADER_SIZE)
+    {
+        return false;
+    }
+
+    return is_pair_sampled(sampler, ip_to_uint32(frame + offset + 12), ip_to_uint32(frame + offset + 16));
+}
+
+/* What one kept packet counts for. A row keyed by the IP pair or something
+ * finer is a whole kept flow, so its count is exact; coarser rows (a host, a
+ * destination port) only hold 1 in rate of their pairs and are scaled. */
+uint32_t sampled_packet_weight(const sampler_t *sampler, key_schema_t schema)
+{
+    if (sampler == NULL || schema == KEY_IP_PAIR || schema == KEY_FIVE_TUPLE)
+    {
+        return INITIAL_VALUE;
+    }
+
+    return sampler->rate;
+}
+
+/* Mark the report as an estimate; packet_count is the total the tables add up to */
+void print_sampling_note(const sampler_t *sampler, key_schema_t schema, uint64_t packet_count)
+{
+    uint64_t estimate = packet_count * (sampler->rate / sampled_packet_weight(sampler, schema));
+
+    printf("Estimates from 1 in %u IP pairs sampled (seed %u): about %llu packets in total.\n",
+           sampler->rate, sampler->seed, (unsigned long long)estimate);
+
+    if (sampled_packet_weight(sampler, schema) == INITIAL_VALUE)
+    {
+        puts("Only sampled flows are listed; each listed count is exact for its flow.");
+    }
+    else
+    {
+        printf("Listed counts are scaled by %u and are estimates.\n", sampler->rate);
+    }
+
+    return;
+}
@@ -0,0 +1,41 @@
+#ifndef SAMPLING_H_INCLUDED
+#define SAMPLING_H_INCLUDED
+
+#include <stdint.h>
+#include "packets.h"
+#include "hash.h"
+
+#define SAMPLE_PEEK_BYTES (ETHERNET_HEADER_SIZE + MAX_VLAN_TAGS * VLAN_TAG_SIZE + IPV4_HEADER_SIZE)
+#define MAX_SAMPLE_RATE 65536
+#define DEFAULT_SAMPLE_SEED 0
+
+/* Flow-consistent 1 in rate sampling: the IP pair hash, mixed with the seed
+ * by one more jhash round, keeps a packet when it is at most threshold. Every
+ * packet of a pair gets the same answer, so a kept flow is complete, and the
+ * same seed keeps the same pairs on every run. */
+struct sampler
+{
+    uint32_t rate;
+    uint32_t seed;
+    uint32_t threshold;
+};
+
+void init_sampler(sampler_t *sampler, uint32_t rate, uint32_t seed);
+bool_t is_frame_sampled(const sampler_t *sampler, const uint8_t *frame, size_t frame_len);
+uint32_t sampled_packet_weight(const sampler_t *sampler, key_schema_t schema);
+void print_sampling_note(const sampler_t *sampler, key_schema_t schema, uint64_t packet_count);
+
+static inline bool_t is_pair_sampled(const sampler_t *sampler, uint32_t source_ip, uint32_t destination_ip)
+{
+    uint32_t a = source_ip;
+    uint32_t b = destination_ip;
+
+    jhash(&a, &b);
+    a = b;
+    b = sampler->seed;
+    jhash(&a, &b);
+
+    return b <= sampler->threshold;
+}
+
+#endif // SAMPLING_H_INCLUDED
@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+#include "spsc-ring.h"
+
+/* capacity is rounded up to a power of two so indexes can be masked */
+void init_spsc_ring(spsc_ring_t *ring, uint32_t capacity)
+{
+    uint32_t power_of_two = 2;
+
+    while (power_of_two < capacity)
+    {
+        power_of_two *= 2;
+    }
+
+    ring->items = (void **)calloc(power_of_two, sizeof(void *));
+
+    if (ring->items == NULL)
+    {
+        perror("Memory allocation failed for ring buffer");
+        exit(EXIT_FAILURE);
+    }
+
+    ring->capacity = power_of_two;
+    ring->mask = power_of_two - 1;
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->head, 0);
+    ring->full_waits = 0;
+    ring->empty_waits = 0;
+    ring->depth_total = 0;
+    ring->depth_samples = 0;
+    ring->max_depth = 0;
+
+    return;
+}
+
+/* Producer side only */
+bool_t try_push_spsc_ring(spsc_ring_t *ring, void *item)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    if (tail - head == ring->capacity)
+    {
+        return false;
+    }
+
+    ring->items[tail & ring->mask] = item;
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+
+    return true;
+}
+
+/* Consumer side only, samples the queue depth on every successful pop */
+bool_t try_pop_spsc_ring(spsc_ring_t *ring, void **item)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    uint32_t depth = tail - head;
+
+    if (depth == 0)
+    {
+        return false;
+    }
+
+    *item = ring->items[head & ring->mask];
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+    ring->depth_total += depth;
+    ring->depth_samples++;
+
+    if (depth > ring->max_depth)
+    {
+        ring->max_depth = depth;
+    }
+
+    return true;
+}
+
+void push_spsc_ring(spsc_ring_t *ring, void *item)
+{
+    while (!try_push_spsc_ring(ring, item))
+    {
+        /* Downstream is the bottleneck */
+        ring->full_waits++;
+        sched_yield();
+    }
+
+    return;
+}
+
+void *pop_spsc_ring(spsc_ring_t *ring)
+{
+    void *item = NULL;
+
+    while (!try_pop_spsc_ring(ring, &item))
+    {
+        /* Upstream is the bottleneck */
+        ring->empty_waits++;
+        sched_yield();
+    }
+
+    return item;
+}
+
+/* A ring that is mostly full with many producer waits points at a slow consumer, and the reverse */
+void print_spsc_ring_stats(const char *name, const spsc_ring_t *ring)
+{
+    fprintf(stderr, "%-22s capacity %4u, avg depth %7.2f, max depth %4u, producer waits %10llu, consumer waits %10llu\n",
+            name, ring->capacity,
+            ring->depth_samples > 0 ? (double)ring->depth_total / (double)ring->depth_samples : 0.0,
+            ring->max_depth, (unsigned long long)ring->full_waits, (unsigned long long)ring->empty_waits);
+
+    return;
+}
+
+void free_spsc_ring(spsc_ring_t *ring)
+{
+    free(ring->items);
+    ring->items = NULL;
+
+    return;
+}
\ No newline at end of file
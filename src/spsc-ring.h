@@ -0,0 +1,34 @@
+#ifndef SPSC_RING_H_INCLUDED
+#define SPSC_RING_H_INCLUDED
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include "packets.h"
+
+#define CACHE_LINE_SIZE 64
+
+/* Bounded single-producer/single-consumer queue of pointers. Head and tail
+ * sit on their own cache lines; each side keeps its own wait statistics. */
+typedef struct spsc_ring
+{
+    void **items;
+    uint32_t capacity;
+    uint32_t mask;
+    _Alignas(CACHE_LINE_SIZE) _Atomic uint32_t tail;
+    uint64_t full_waits;
+    _Alignas(CACHE_LINE_SIZE) _Atomic uint32_t head;
+    uint64_t empty_waits;
+    uint64_t depth_total;
+    uint64_t depth_samples;
+    uint32_t max_depth;
+} spsc_ring_t;
+
+void init_spsc_ring(spsc_ring_t *ring, uint32_t capacity);
+bool_t try_push_spsc_ring(spsc_ring_t *ring, void *item);
+bool_t try_pop_spsc_ring(spsc_ring_t *ring, void **item);
+void push_spsc_ring(spsc_ring_t *ring, void *item);
+void *pop_spsc_ring(spsc_ring_t *ring);
+void print_spsc_ring_stats(const char *name, const spsc_ring_t *ring);
+void free_spsc_ring(spsc_ring_t *ring);
+
+#endif // SPSC_RING_H_INCLUDED
\ No newline at end of file
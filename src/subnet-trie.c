@@ -0,0 +1,512 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "subnet-trie.h"
+#include "packet-filter.h"
+
+#define SUBNET_NUMBER_WIDTH 6
+#define SUBNET_COLUMN_WIDTH 21
+#define SUBNET_FLOWS_WIDTH 15
+#define SUBNET_TITLE_SIZE 64
+
+static const char *const subnet_side_names[NUM_SUBNET_SIDES] = {"src", "dst", "pair"};
+static const char *const subnet_side_titles[NUM_SUBNET_SIDES] = {"Source", "Destination", "IP Pair"};
+
+static inline uint64_t subnet_monotonic_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * NANOSECONDS_PER_SECOND + (uint64_t)now.tv_nsec;
+}
+
+static inline uint64_t prefix_mask(uint32_t bits)
+{
+    return (bits == 0) ? 0 : ~0ULL << (SUBNET_KEY_BITS - bits);
+}
+
+static inline uint32_t key_bit(uint64_t key, uint32_t position)
+{
+    return (uint32_t)(key >> (SUBNET_KEY_BITS - 1 - position)) & 1;
+}
+
+/* Leading bits two keys share */
+static inline uint32_t common_prefix_len(uint64_t first, uint64_t second)
+{
+    uint64_t difference = first ^ second;
+
+#if defined(__GNUC__)
+    return (difference == 0) ? SUBNET_KEY_BITS : (uint32_t)__builtin_clzll(difference);
+#else
+    uint32_t bits = 0;
+
+    while (bits < SUBNET_KEY_BITS && key_bit(difference, bits) == 0)
+    {
+        bits++;
+    }
+
+    return bits;
+#endif
+}
+
+/* Spread the 32 bits of value over the even positions of 64 */
+static inline uint64_t spread_bits(uint32_t value)
+{
+    uint64_t spread = value;
+
+    spread = (spread | (spread << 16)) & 0x0000FFFF0000FFFFULL;
+    spread = (spread | (spread << 8)) & 0x00FF00FF00FF00FFULL;
+    spread = (spread | (spread << 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    spread = (spread | (spread << 2)) & 0x3333333333333333ULL;
+    spread = (spread | (spread << 1)) & 0x5555555555555555ULL;
+
+    return spread;
+}
+
+/* Inverse of spread_bits, the odd positions are ignored */
+static inline uint32_t gather_bits(uint64_t spread)
+{
+    spread &= 0x5555555555555555ULL;
+    spread = (spread | (spread >> 1)) & 0x3333333333333333ULL;
+    spread = (spread | (spread >> 2)) & 0x0F0F0F0F0F0F0F0FULL;
+    spread = (spread | (spread >> 4)) & 0x00FF00FF00FF00FFULL;
+    spread = (spread | (spread >> 8)) & 0x0000FFFF0000FFFFULL;
+    spread = (spread | (spread >> 16)) & 0x00000000FFFFFFFFULL;
+
+    return (uint32_t)spread;
+}
+
+static inline uint64_t subnet_key(subnet_side_t side, uint32_t source_ip, uint32_t destination_ip)
+{
+    switch (side)
+    {
+    case SUBNET_SOURCE:
+        return (uint64_t)source_ip << SUBNET_ADDRESS_BITS;
+
+    case SUBNET_DESTINATION:
+        return (uint64_t)destination_ip << SUBNET_ADDRESS_BITS;
+
+    case SUBNET_PAIR:
+    default:
+        return (spread_bits(source_ip) << 1) | spread_bits(destination_ip);
+    }
+}
+
+/* Parse a comma separated list of src/N, dst/N or pair/N, where src and dst
+ * may be narrowed to one network with @A.B.C.D/M, M at most N */
+bool_t parse_subnet_views(const char *text, subnet_view_t *views, uint32_t *num_views)
+{
+    const char *end = NULL;
+    const char *at = NULL;
+    const char *slash = NULL;
+    char *number_end = NULL;
+    subnet_view_t *view = NULL;
+    unsigned long prefix_len = 0;
+    size_t len = 0;
+    uint32_t side = 0;
+
+    if (text == NULL || *text == '\0')
+    {
+        return false;
+    }
+
+    *num_views = 0;
+
+    while (*text != '\0')
+    {
+        end = strchr(text, ',');
+        len = (end != NULL) ? (size_t)(end - text) : strlen(text);
+        slash = memchr(text, '/', len);
+        at = memchr(text, '@', len);
+
+        if (*num_views == MAX_SUBNET_VIEWS || slash == NULL || (at != NULL && at < slash))
+        {
+            return false;
+        }
+
+        view = &views[*num_views];
+
+        for (side = 0; side < NUM_SUBNET_SIDES; side++)
+        {
+            if ((size_t)(slash - text) == strlen(subnet_side_names[side]) &&
+                strncmp(text, subnet_side_names[side], (size_t)(slash - text)) == 0)
+            {
+                break;
+            }
+        }
+
+        if (side == NUM_SUBNET_SIDES || slash[1] < '0' || slash[1] > '9')
+        {
+            return false;
+        }
+
+        prefix_len = strtoul(slash + 1, &number_end, 10);
+
+        if (number_end != ((at != NULL) ? at : text + len) || prefix_len > SUBNET_ADDRESS_BITS)
+        {
+            return false;
+        }
+
+        view->side = (subnet_side_t)side;
+        view->prefix_len = (uint32_t)prefix_len;
+        view->within = 0;
+        view->within_len = 0;
+
+        if (at != NULL && (view->side == SUBNET_PAIR ||
+                           !parse_ipv4_prefix(at + 1, (size_t)(text + len - at - 1), &view->within, &view->within_len) ||
+                           view->within_len > view->prefix_len))
+        {
+            return false;
+        }
+
+        (*num_views)++;
+        text += len + (end != NULL);
+    }
+
+    return end == NULL;
+}
+
+/* The table must keep the addresses the view rolls up */
+bool_t is_subnet_view_supported(const subnet_view_t *view, key_schema_t schema)
+{
+    bool_t has_source = (schema == KEY_SOURCE || schema == KEY_IP_PAIR || schema == KEY_FIVE_TUPLE);
+    bool_t has_destination = (schema != KEY_SOURCE);
+
+    switch (view->side)
+    {
+    case SUBNET_SOURCE:
+        return has_source;
+
+    case SUBNET_DESTINATION:
+        return has_destination;
+
+    case SUBNET_PAIR:
+    default:
+        return has_source && has_destination;
+    }
+}
+
+void init_subnet_trie(subnet_trie_t *trie, subnet_side_t side)
+{
+    memset(trie, 0, sizeof(subnet_trie_t));
+    trie->side = side;
+    trie->key_bits = (side == SUBNET_PAIR) ? SUBNET_KEY_BITS : SUBNET_ADDRESS_BITS;
+    init_arena(&trie->arena, ARENA_BLOCK_SIZE);
+
+    return;
+}
+
+static subnet_node_t *new_subnet_node(subnet_trie_t *trie, uint64_t key, uint32_t bits, uint64_t packets,
+                                      uint32_t flows)
+{
+    subnet_node_t *node = (subnet_node_t *)arena_alloc(&trie->arena, sizeof(subnet_node_t));
+
+    node->key = key & prefix_mask(bits);
+    node->bits = bits;
+    node->packets = packets;
+    node->flows = flows;
+    node->child[0] = NULL;
+    node->child[1] = NULL;
+    trie->num_nodes++;
+
+    return node;
+}
+
+/* Add one flow's packets to every node on its path. Where the key leaves a
+ * node's prefix early, a new inner node takes the node's place with the old
+ * node and a new leaf as its children. */
+void add_to_subnet_trie(subnet_trie_t *trie, uint32_t source_ip, uint32_t destination_ip, uint64_t packets)
+{
+    uint64_t key = subnet_key(trie->side, source_ip, destination_ip);
+    subnet_node_t **link = &trie->root;
+    subnet_node_t *node = NULL;
+    subnet_node_t *split = NULL;
+    uint32_t common = 0;
+    uint32_t direction = 0;
+
+    while ((node = *link) != NULL)
+    {
+        common = common_prefix_len(key, node->key);
+
+        if (common < node->bits)
+        {
+            split = new_subnet_node(trie, key, common, node->packets + packets, node->flows + 1);
+            direction = key_bit(key, common);
+            split->child[direction] = new_subnet_node(trie, key, trie->key_bits, packets, 1);
+            split->child[!direction] = node;
+            *link = split;
+
+            return;
+        }
+
+        node->packets += packets;
+        node->flows++;
+
+        /* Same address, or same pair, as an earlier flow */
+        if (node->bits == trie->key_bits)
+        {
+            return;
+        }
+
+        link = &node->child[key_bit(key, node->bits)];
+    }
+
+    *link = new_subnet_node(trie, key, trie->key_bits, packets, 1);
+
+    return;
+}
+
+/* One pass over the finished table, a flow at a time */
+void build_subnet_trie(subnet_trie_t *trie, const hash_table_t *hash_table)
+{
+    const data_list_node_t *node = NULL;
+    uint32_t flow_id = 0;
+
+    for (flow_id = 0; flow_id < hash_table->list.count; flow_id++)
+    {
+        node = list_node(&hash_table->list, flow_id);
+        add_to_subnet_trie(trie, ip_to_uint32(node->key.source_ip), ip_to_uint32(node->key.destination_ip),
+                           node->ref_count);
+    }
+
+    return;
+}
+
+static void add_subnet_group(subnet_rollup_t *rollup, uint64_t key, const subnet_node_t *node)
+{
+    if (rollup->count == rollup->capacity)
+    {
+        rollup->capacity = (rollup->capacity == 0) ? SUBNET_ROLLUP_INITIAL : rollup->capacity * NEXT_MULTIPLIER;
+        rollup->groups = (subnet_group_t *)realloc(rollup->groups, rollup->capacity * sizeof(subnet_group_t));
+
+        if (rollup->groups == NULL)
+        {
+            perror("Memory allocation failed for subnet roll-up");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    rollup->groups[rollup->count].key = key;
+    rollup->groups[rollup->count].packets = node->packets;
+    rollup->groups[rollup->count].flows = node->flows;
+    rollup->count++;
+
+    return;
+}
+
+/* The first node at least bits long holds its whole subnet; siblings above
+ * that length part before it, so they never share a subnet */
+static void collect_subnets(const subnet_node_t *node, uint32_t bits, subnet_rollup_t *rollup)
+{
+    if (node->bits >= bits)
+    {
+        add_subnet_group(rollup, node->key & prefix_mask(bits), node);
+
+        return;
+    }
+
+    collect_subnets(node->child[0], bits, rollup);
+    collect_subnets(node->child[1], bits, rollup);
+
+    return;
+}
+
+/* Pairs come out of the trie in interleaved order, print them by source then destination */
+static int compare_pair_groups(const void *first, const void *second)
+{
+    uint64_t first_key = ((const subnet_group_t *)first)->key;
+    uint64_t second_key = ((const subnet_group_t *)second)->key;
+    uint64_t first_pair = ((uint64_t)gather_bits(first_key >> 1) << SUBNET_ADDRESS_BITS) | gather_bits(first_key);
+    uint64_t second_pair = ((uint64_t)gather_bits(second_key >> 1) << SUBNET_ADDRESS_BITS) | gather_bits(second_key);
+
+    return (first_pair > second_pair) - (first_pair < second_pair);
+}
+
+/* Replace the groups in rollup with the view's, in address order. The walk
+ * visits only nodes shorter than the prefix plus one per group. */
+uint32_t roll_up_subnets(const subnet_trie_t *trie, const subnet_view_t *view, subnet_rollup_t *rollup)
+{
+    const subnet_node_t *node = trie->root;
+    uint64_t within = (uint64_t)view->within << SUBNET_ADDRESS_BITS;
+    uint32_t bits = (trie->side == SUBNET_PAIR) ? 2 * view->prefix_len : view->prefix_len;
+
+    rollup->count = 0;
+
+    while (node != NULL && node->bits < view->within_len)
+    {
+        if (common_prefix_len(node->key, within) < node->bits)
+        {
+            return 0;
+        }
+
+        node = node->child[key_bit(within, node->bits)];
+    }
+
+    if (node != NULL && common_prefix_len(node->key, within) >= view->within_len)
+    {
+        collect_subnets(node, bits, rollup);
+    }
+
+    if (trie->side == SUBNET_PAIR)
+    {
+        qsort(rollup->groups, rollup->count, sizeof(subnet_group_t), compare_pair_groups);
+    }
+
+    return rollup->count;
+}
+
+static void print_subnet_cell(uint32_t address, uint32_t prefix_len)
+{
+    printf("| %3u.%3u.%3u.%3u/%-2u ", address >> 24, (address >> 16) & 0xFF, (address >> 8) & 0xFF, address & 0xFF,
+           prefix_len);
+
+    return;
+}
+
+static void print_subnet_rule(const subnet_view_t *view)
+{
+    fputs("+-----", stdout);
+    fputs("+--------------------", stdout);
+
+    if (view->side == SUBNET_PAIR)
+    {
+        fputs("+--------------------", stdout);
+    }
+
+    puts("+--------------+--------------+");
+
+    return;
+}
+
+/* The roll-up as a table, one row per subnet (or pair of subnets) in address order */
+void print_subnet_rollup(const subnet_rollup_t *rollup, const subnet_view_t *view)
+{
+    char title[SUBNET_TITLE_SIZE];
+    uint32_t width = SUBNET_NUMBER_WIDTH + SUBNET_COLUMN_WIDTH + SUBNET_FLOWS_WIDTH + COUNT_COLUMN_WIDTH;
+    uint32_t group = 0;
+    uint64_t key = 0;
+
+    width += (view->side == SUBNET_PAIR) ? SUBNET_COLUMN_WIDTH : 0;
+
+    if (view->within_len > 0)
+    {
+        snprintf(title, sizeof(title), "%s /%u Roll-up in %u.%u.%u.%u/%u", subnet_side_titles[view->side],
+                 view->prefix_len, view->within >> 24, (view->within >> 16) & 0xFF, (view->within >> 8) & 0xFF,
+                 view->within & 0xFF, view->within_len);
+    }
+    else
+    {
+        snprintf(title, sizeof(title), "%s /%u Roll-up", subnet_side_titles[view->side], view->prefix_len);
+    }
+
+    print_table_rule(width);
+    print_table_title(title, (width - 2 - (uint32_t)strlen(title)) / 2, width);
+    print_subnet_rule(view);
+    fputs("|  No ", stdout);
+    fputs((view->side == SUBNET_DESTINATION) ? "| Destination Subnet " : "|   Source Subnet    ", stdout);
+
+    if (view->side == SUBNET_PAIR)
+    {
+        fputs("| Destination Subnet ", stdout);
+    }
+
+    puts("|    Flows     | Packet Count |");
+    print_subnet_rule(view);
+
+    for (group = 0; group < rollup->count; group++)
+    {
+        key = rollup->groups[group].key;
+        printf("| %3u ", group + 1);
+
+        if (view->side == SUBNET_PAIR)
+        {
+            print_subnet_cell(gather_bits(key >> 1), view->prefix_len);
+            print_subnet_cell(gather_bits(key), view->prefix_len);
+        }
+        else
+        {
+            print_subnet_cell((uint32_t)(key >> SUBNET_ADDRESS_BITS), view->prefix_len);
+        }
+
+        printf("| %12u | %12llu |\n", rollup->groups[group].flows, (unsigned long long)rollup->groups[group].packets);
+        print_subnet_rule(view);
+    }
+
+    return;
+}
+
+/* Build the tries the views need once, then run every view against them.
+ * With verbose the build and query times go to stderr. */
+void print_subnet_views(const hash_table_t *hash_table, const subnet_view_t *views, uint32_t num_views, bool_t verbose)
+{
+    subnet_trie_t tries[NUM_SUBNET_SIDES];
+    subnet_rollup_t rollup = {0};
+    bool_t is_built[NUM_SUBNET_SIDES] = {false};
+    uint64_t start = 0;
+    uint32_t side = 0;
+    uint32_t view = 0;
+
+    for (view = 0; view < num_views; view++)
+    {
+        side = views[view].side;
+
+        if (!is_built[side])
+        {
+            start = subnet_monotonic_ns();
+            init_subnet_trie(&tries[side], (subnet_side_t)side);
+            build_subnet_trie(&tries[side], hash_table);
+            is_built[side] = true;
+
+            if (verbose)
+            {
+                fprintf(stderr, "Subnet trie (%s): %u flows, %u nodes, %zu bytes, built in %llu ns\n",
+                        subnet_side_names[side], hash_table->list.count, tries[side].num_nodes,
+                        tries[side].arena.total_bytes, (unsigned long long)(subnet_monotonic_ns() - start));
+            }
+        }
+
+        start = subnet_monotonic_ns();
+        roll_up_subnets(&tries[side], &views[view], &rollup);
+
+        if (verbose)
+        {
+            fprintf(stderr, "Roll-up %s/%u: %u groups in %llu ns\n", subnet_side_names[side], views[view].prefix_len,
+                    rollup.count, (unsigned long long)(subnet_monotonic_ns() - start));
+        }
+
+        print_subnet_rollup(&rollup, &views[view]);
+    }
+
+    for (side = 0; side < NUM_SUBNET_SIDES; side++)
+    {
+        if (is_built[side])
+        {
+            free_subnet_trie(&tries[side]);
+        }
+    }
+
+    free_subnet_rollup(&rollup);
+
+    return;
+}
+
+void free_subnet_rollup(subnet_rollup_t *rollup)
+{
+    free(rollup->groups);
+    rollup->groups = NULL;
+    rollup->count = 0;
+    rollup->capacity = 0;
+
+    return;
+}
+
+void free_subnet_trie(subnet_trie_t *trie)
+{
+    free_arena(&trie->arena);
+    trie->root = NULL;
+    trie->num_nodes = 0;
+
+    return;
+}
@@ -0,0 +1,84 @@
+#ifndef SUBNET_TRIE_H_INCLUDED
+#define SUBNET_TRIE_H_INCLUDED
+
+#include <stdint.h>
+#include "hash.h"
+#include "arena.h"
+
+#define MAX_SUBNET_VIEWS 8
+#define SUBNET_KEY_BITS 64
+#define SUBNET_ADDRESS_BITS 32
+#define SUBNET_ROLLUP_INITIAL 64
+
+typedef enum
+{
+    SUBNET_SOURCE = 0,
+    SUBNET_DESTINATION,
+    SUBNET_PAIR,
+    NUM_SUBNET_SIDES
+} subnet_side_t;
+
+/* One roll-up to print: side/prefix_len, optionally only inside within/within_len */
+typedef struct subnet_view
+{
+    subnet_side_t side;
+    uint32_t prefix_len;
+    uint32_t within;
+    uint32_t within_len;
+} subnet_view_t;
+
+/* A node covers every key that starts with the top bits of key. Leaves are
+ * whole keys (bits == key_bits); inner nodes only exist where two keys part,
+ * so each has both children and the trie has fewer than two nodes per
+ * distinct key. packets and flows are totals of the whole subtree. */
+typedef struct subnet_node
+{
+    uint64_t key;
+    uint64_t packets;
+    uint32_t flows;
+    uint32_t bits;
+    struct subnet_node *child[2];
+} subnet_node_t;
+
+/* Path-compressed binary trie over addresses, most significant bit first. A
+ * source or destination key is the address in the top 32 bits; a pair key
+ * interleaves the source and destination bits, so a /n of both addresses is
+ * a 2n bit prefix. A roll-up at any length is one walk that stops at the first
+ * node at least that long, whose totals are already the subnet's. Nodes come
+ * from an arena and are released together. */
+typedef struct subnet_trie
+{
+    subnet_node_t *root;
+    subnet_side_t side;
+    uint32_t key_bits;
+    uint32_t num_nodes;
+    arena_t arena;
+} subnet_trie_t;
+
+typedef struct subnet_group
+{
+    uint64_t key;
+    uint64_t packets;
+    uint32_t flows;
+} subnet_group_t;
+
+/* Groups of one roll-up in address order, reused between queries */
+typedef struct subnet_rollup
+{
+    subnet_group_t *groups;
+    uint32_t count;
+    uint32_t capacity;
+} subnet_rollup_t;
+
+bool_t parse_subnet_views(const char *text, subnet_view_t *views, uint32_t *num_views);
+bool_t is_subnet_view_supported(const subnet_view_t *view, key_schema_t schema);
+void init_subnet_trie(subnet_trie_t *trie, subnet_side_t side);
+void add_to_subnet_trie(subnet_trie_t *trie, uint32_t source_ip, uint32_t destination_ip, uint64_t packets);
+void build_subnet_trie(subnet_trie_t *trie, const hash_table_t *hash_table);
+uint32_t roll_up_subnets(const subnet_trie_t *trie, const subnet_view_t *view, subnet_rollup_t *rollup);
+void print_subnet_rollup(const subnet_rollup_t *rollup, const subnet_view_t *view);
+void print_subnet_views(const hash_table_t *hash_table, const subnet_view_t *views, uint32_t num_views, bool_t verbose);
+void free_subnet_rollup(subnet_rollup_t *rollup);
+void free_subnet_trie(subnet_trie_t *trie);
+
+#endif // SUBNET_TRIE_H_INCLUDED